@@ -0,0 +1,440 @@
+/**
+ * @file arrow.c
+ * @brief minimal Apache Arrow IPC file writer
+ * @date 17/10/2026
+ */
+
+/*
+ * An Arrow file is "ARROW1\0\0", the schema message, one message per record batch, the end of stream marker,
+ * the footer and finally the footer size and "ARROW1". A message is a 0xFFFFFFFF continuation marker,
+ * the size of its metadata, the metadata (a flatbuffer) padded to 8 bytes and then the body (the column buffers).
+ *
+ * The flatbuffers are written front to back by the small builder below: a table is written first with
+ * placeholders for its references, and whatever it refers to (strings, vectors, other tables) is written after it
+ * and then patched in, so that every reference points forward as flatbuffers require.
+ * Field ids and enum values are from the Arrow format Schema.fbs, Message.fbs and File.fbs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "arrow.h"
+#include "error.h"
+
+extern int slow5tools_verbosity_level;
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_ALIGN 8
+#define ARROW_METADATA_V5 4
+#define ARROW_CONTINUATION 0xFFFFFFFFU
+
+// MessageHeader union
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+
+// Type union
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_LARGE_LIST 21
+
+// FloatingPoint precision
+#define ARROW_PRECISION_SINGLE 1
+#define ARROW_PRECISION_DOUBLE 2
+
+#define FB_MAX_FIELDS 8
+
+struct arrow_writer {
+    FILE *fp;
+    arrow_field_t *fields;
+    int32_t n_fields;
+    int64_t pos;            // bytes written so far
+    int64_t *blocks;        // offset, metadata size and body size of every record batch
+    int64_t n_blocks;
+    int64_t cap_blocks;
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} fb_t;
+
+static void fb_grow(fb_t *b, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->data = (uint8_t *) realloc(b->data, b->cap);
+        MALLOC_CHK(b->data);
+    }
+    memset(b->data + b->len, 0, n);
+}
+
+static size_t fb_put(fb_t *b, const void *src, size_t n) {
+    fb_grow(b, n);
+    size_t pos = b->len;
+    if (src) {
+        memcpy(b->data + pos, src, n);
+    }
+    b->len += n;
+    return pos;
+}
+
+static void fb_pad(fb_t *b, size_t align) {
+    size_t pad = (align - b->len % align) % align;
+    fb_put(b, NULL, pad);
+}
+
+// point the uoffset at slot to target (which must come after it)
+static void fb_patch(fb_t *b, size_t slot, size_t target) {
+    uint32_t off = (uint32_t) (target - slot);
+    memcpy(b->data + slot, &off, sizeof off);
+}
+
+/* write a table with n fields (by id), size[i] bytes each (0 if absent) with the values val[i] (NULL for references,
+ * to be patched), the absolute position of each field is returned in pos */
+static size_t fb_table(fb_t *b, int n, const uint8_t *size, const void *const *val, size_t *pos) {
+    // widest fields first, each aligned to its size, after the soffset to the vtable
+    uint16_t rel[FB_MAX_FIELDS] = { 0 };
+    size_t off = sizeof(int32_t);
+    for (uint8_t sz = 8; sz > 0; sz /= 2) {
+        for (int i = 0; i < n; i++) {
+            if (size[i] == sz) {
+                off = (off + sz - 1) / sz * sz;
+                rel[i] = (uint16_t) off;
+                off += sz;
+            }
+        }
+    }
+
+    fb_pad(b, sizeof(uint16_t));
+    size_t vtable = b->len;
+    uint16_t vt[2 + FB_MAX_FIELDS];
+    vt[0] = (uint16_t) (sizeof(uint16_t) * (2 + n));
+    off = (off + 3) / 4 * 4;
+    vt[1] = (uint16_t) off;
+    for (int i = 0; i < n; i++) {
+        vt[2 + i] = rel[i];
+    }
+    fb_put(b, vt, vt[0]);
+
+    fb_pad(b, ARROW_ALIGN);
+    size_t table = b->len;
+    int32_t soffset = (int32_t) (table - vtable);
+    fb_put(b, NULL, off);
+    memcpy(b->data + table, &soffset, sizeof soffset);
+    for (int i = 0; i < n; i++) {
+        if (size[i]) {
+            pos[i] = table + rel[i];
+            if (val[i]) {
+                memcpy(b->data + pos[i], val[i], size[i]);
+            }
+        }
+    }
+    return table;
+}
+
+static size_t fb_string(fb_t *b, const char *str) {
+    fb_pad(b, sizeof(uint32_t));
+    uint32_t len = (uint32_t) strlen(str);
+    size_t pos = fb_put(b, &len, sizeof len);
+    fb_put(b, str, len + 1); // null terminated
+    return pos;
+}
+
+// a vector of n references, slot i is at pos + 4 + 4 * i
+static size_t fb_ref_vector(fb_t *b, uint32_t n) {
+    fb_pad(b, sizeof(uint32_t));
+    size_t pos = fb_put(b, &n, sizeof n);
+    fb_put(b, NULL, sizeof(uint32_t) * n);
+    return pos;
+}
+
+// a vector of n structs of 8 byte alignment
+static size_t fb_struct_vector(fb_t *b, const void *data, uint32_t n, size_t elem_size) {
+    fb_pad(b, sizeof(uint32_t));
+    if ((b->len + sizeof n) % ARROW_ALIGN) {
+        fb_put(b, NULL, sizeof(uint32_t));
+    }
+    size_t pos = fb_put(b, &n, sizeof n);
+    fb_put(b, data, elem_size * n);
+    return pos;
+}
+
+// Field { name: string (0), nullable: bool (1), type_type (2), type (3), dictionary (4), children: [Field] (5) }
+static size_t fb_field(fb_t *b, const char *name, enum arrow_type type, uint8_t nullable) {
+    uint8_t type_type;
+    switch (type) {
+        case ARROW_FLOAT:
+        case ARROW_DOUBLE:
+            type_type = ARROW_TYPE_FLOATING_POINT;
+            break;
+        case ARROW_UTF8:
+            type_type = ARROW_TYPE_UTF8;
+            break;
+        case ARROW_LARGE_LIST_INT16:
+            type_type = ARROW_TYPE_LARGE_LIST;
+            break;
+        default:
+            type_type = ARROW_TYPE_INT;
+            break;
+    }
+    uint8_t size[6] = { 4, 1, 1, 4, 0, 4 };
+    const void *val[6] = { NULL, &nullable, &type_type, NULL, NULL, NULL };
+    size_t pos[6];
+    size_t table = fb_table(b, 6, size, val, pos);
+
+    fb_patch(b, pos[0], fb_string(b, name));
+
+    size_t type_table;
+    if (type_type == ARROW_TYPE_INT) { // Int { bitWidth: int (0), is_signed: bool (1) }
+        int32_t bit_width = arrow_type_width(type) * 8;
+        uint8_t is_signed = type <= ARROW_INT64;
+        uint8_t tsize[2] = { 4, 1 };
+        const void *tval[2] = { &bit_width, &is_signed };
+        size_t tpos[2];
+        type_table = fb_table(b, 2, tsize, tval, tpos);
+    } else if (type_type == ARROW_TYPE_FLOATING_POINT) { // FloatingPoint { precision: short (0) }
+        int16_t precision = type == ARROW_FLOAT ? ARROW_PRECISION_SINGLE : ARROW_PRECISION_DOUBLE;
+        uint8_t tsize[1] = { 2 };
+        const void *tval[1] = { &precision };
+        size_t tpos[1];
+        type_table = fb_table(b, 1, tsize, tval, tpos);
+    } else { // Utf8 and LargeList have no fields
+        type_table = fb_table(b, 0, NULL, NULL, NULL);
+    }
+    fb_patch(b, pos[3], type_table);
+
+    if (type == ARROW_LARGE_LIST_INT16) {
+        size_t children = fb_ref_vector(b, 1);
+        fb_patch(b, pos[5], children);
+        fb_patch(b, children + sizeof(uint32_t), fb_field(b, "item", ARROW_INT16, 0));
+    } else {
+        fb_patch(b, pos[5], fb_ref_vector(b, 0));
+    }
+    return table;
+}
+
+// Schema { endianness: short (0), fields: [Field] (1) }
+static size_t fb_schema(fb_t *b, const arrow_field_t *fields, int32_t n_fields) {
+    int16_t little_endian = 0;
+    uint8_t size[2] = { 2, 4 };
+    const void *val[2] = { &little_endian, NULL };
+    size_t pos[2];
+    size_t table = fb_table(b, 2, size, val, pos);
+    size_t vec = fb_ref_vector(b, n_fields);
+    fb_patch(b, pos[1], vec);
+    for (int32_t i = 0; i < n_fields; i++) {
+        fb_patch(b, vec + sizeof(uint32_t) * (i + 1), fb_field(b, fields[i].name, fields[i].type, 1));
+    }
+    return table;
+}
+
+// Message { version: short (0), header_type: ubyte (1), header (2), bodyLength: long (3) }, returns the slot of header
+static size_t fb_message(fb_t *b, uint8_t header_type, int64_t body_length) {
+    fb_put(b, NULL, sizeof(uint32_t)); // root
+    int16_t version = ARROW_METADATA_V5;
+    uint8_t size[4] = { 2, 1, 4, 8 };
+    const void *val[4] = { &version, &header_type, NULL, &body_length };
+    size_t pos[4];
+    fb_patch(b, 0, fb_table(b, 4, size, val, pos));
+    return pos[2];
+}
+
+static int arrow_fwrite(arrow_writer_t *w, const void *data, size_t n) {
+    if (n && fwrite(data, 1, n, w->fp) != n) {
+        ERROR("Writing the Arrow file failed - %s.", strerror(errno));
+        return -1;
+    }
+    w->pos += n;
+    return 0;
+}
+
+static int arrow_pad(arrow_writer_t *w) {
+    static const uint8_t zeros[ARROW_ALIGN] = { 0 };
+    return arrow_fwrite(w, zeros, (ARROW_ALIGN - w->pos % ARROW_ALIGN) % ARROW_ALIGN);
+}
+
+// continuation marker, metadata size and the metadata padded to 8 bytes, returns the number of bytes written or -1
+static int64_t arrow_write_metadata(arrow_writer_t *w, fb_t *b) {
+    fb_pad(b, ARROW_ALIGN);
+    uint32_t head[2] = { ARROW_CONTINUATION, (uint32_t) b->len };
+    if (arrow_fwrite(w, head, sizeof head) < 0 || arrow_fwrite(w, b->data, b->len) < 0) {
+        return -1;
+    }
+    return sizeof head + b->len;
+}
+
+static void arrow_free(arrow_writer_t *w) {
+    for (int32_t i = 0; i < w->n_fields; i++) {
+        free((char *) w->fields[i].name);
+    }
+    free(w->fields);
+    free(w->blocks);
+    free(w);
+}
+
+int arrow_type_width(enum arrow_type type) {
+    switch (type) {
+        case ARROW_INT8:
+        case ARROW_UINT8:
+            return 1;
+        case ARROW_INT16:
+        case ARROW_UINT16:
+            return 2;
+        case ARROW_INT32:
+        case ARROW_UINT32:
+        case ARROW_FLOAT:
+            return 4;
+        case ARROW_INT64:
+        case ARROW_UINT64:
+        case ARROW_DOUBLE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+arrow_writer_t *arrow_open(FILE *fp, const arrow_field_t *fields, int32_t n_fields) {
+    arrow_writer_t *w = (arrow_writer_t *) calloc(1, sizeof *w);
+    MALLOC_CHK(w);
+    w->fp = fp;
+    w->n_fields = n_fields;
+    w->fields = (arrow_field_t *) malloc(sizeof *w->fields * n_fields);
+    MALLOC_CHK(w->fields);
+    for (int32_t i = 0; i < n_fields; i++) {
+        w->fields[i].name = strdup(fields[i].name);
+        MALLOC_CHK(w->fields[i].name);
+        w->fields[i].type = fields[i].type;
+    }
+
+    static const char magic[ARROW_ALIGN] = ARROW_MAGIC; // padded with zeros
+    fb_t b = { NULL, 0, 0 };
+    size_t header = fb_message(&b, ARROW_HEADER_SCHEMA, 0);
+    fb_patch(&b, header, fb_schema(&b, w->fields, n_fields));
+    int ret = arrow_fwrite(w, magic, sizeof magic) < 0 || arrow_write_metadata(w, &b) < 0 ? -1 : 0;
+    free(b.data);
+    if (ret < 0) {
+        arrow_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int arrow_write_batch(arrow_writer_t *w, const arrow_column_t *cols, int64_t length) {
+    // FieldNode { length, null_count } and Buffer { offset, length } in the depth first order of the fields
+    int64_t *nodes = (int64_t *) malloc(sizeof(int64_t) * 2 * 2 * w->n_fields);
+    MALLOC_CHK(nodes);
+    int64_t *buffers = (int64_t *) malloc(sizeof(int64_t) * 2 * 5 * w->n_fields);
+    MALLOC_CHK(buffers);
+    const void **buffer_data = (const void **) malloc(sizeof(void *) * 5 * w->n_fields);
+    MALLOC_CHK(buffer_data);
+    uint32_t n_nodes = 0;
+    uint32_t n_buffers = 0;
+    int64_t body = 0;
+
+#define ARROW_ADD_BUFFER(ptr, bytes) { \
+        buffer_data[n_buffers] = (ptr); \
+        buffers[2 * n_buffers] = body; \
+        buffers[2 * n_buffers + 1] = (bytes); \
+        body += ((bytes) + ARROW_ALIGN - 1) / ARROW_ALIGN * ARROW_ALIGN; \
+        n_buffers++; \
+    }
+
+    for (int32_t i = 0; i < w->n_fields; i++) {
+        const arrow_column_t *col = &cols[i];
+        nodes[2 * n_nodes] = length;
+        nodes[2 * n_nodes + 1] = col->null_count;
+        n_nodes++;
+        ARROW_ADD_BUFFER(col->null_count ? col->validity : NULL, col->null_count ? (length + 7) / 8 : 0);
+        enum arrow_type type = w->fields[i].type;
+        if (type == ARROW_UTF8) {
+            const int32_t *offsets = (const int32_t *) col->offsets;
+            ARROW_ADD_BUFFER(offsets, sizeof(int32_t) * (length + 1));
+            ARROW_ADD_BUFFER(col->values, offsets[length]);
+        } else if (type == ARROW_LARGE_LIST_INT16) {
+            const int64_t *offsets = (const int64_t *) col->offsets;
+            ARROW_ADD_BUFFER(offsets, sizeof(int64_t) * (length + 1));
+            nodes[2 * n_nodes] = offsets[length];
+            nodes[2 * n_nodes + 1] = 0;
+            n_nodes++;
+            ARROW_ADD_BUFFER(NULL, 0);
+            ARROW_ADD_BUFFER(col->values, sizeof(int16_t) * offsets[length]);
+        } else {
+            ARROW_ADD_BUFFER(col->values, arrow_type_width(type) * length);
+        }
+    }
+#undef ARROW_ADD_BUFFER
+
+    // RecordBatch { length: long (0), nodes: [FieldNode] (1), buffers: [Buffer] (2) }
+    fb_t b = { NULL, 0, 0 };
+    size_t header = fb_message(&b, ARROW_HEADER_RECORD_BATCH, body);
+    uint8_t size[3] = { 8, 4, 4 };
+    const void *val[3] = { &length, NULL, NULL };
+    size_t pos[3];
+    fb_patch(&b, header, fb_table(&b, 3, size, val, pos));
+    fb_patch(&b, pos[1], fb_struct_vector(&b, nodes, n_nodes, sizeof(int64_t) * 2));
+    fb_patch(&b, pos[2], fb_struct_vector(&b, buffers, n_buffers, sizeof(int64_t) * 2));
+
+    int64_t offset = w->pos;
+    int64_t metadata = arrow_write_metadata(w, &b);
+    int ret = metadata < 0 ? -1 : 0;
+    for (uint32_t j = 0; ret == 0 && j < n_buffers; j++) {
+        if (arrow_fwrite(w, buffer_data[j], buffers[2 * j + 1]) < 0 || arrow_pad(w) < 0) {
+            ret = -1;
+        }
+    }
+    free(b.data);
+    free(nodes);
+    free(buffers);
+    free(buffer_data);
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (w->n_blocks == w->cap_blocks) {
+        w->cap_blocks = w->cap_blocks ? w->cap_blocks * 2 : 64;
+        w->blocks = (int64_t *) realloc(w->blocks, sizeof(int64_t) * 3 * w->cap_blocks);
+        MALLOC_CHK(w->blocks);
+    }
+    w->blocks[3 * w->n_blocks] = offset;
+    w->blocks[3 * w->n_blocks + 1] = metadata;
+    w->blocks[3 * w->n_blocks + 2] = body;
+    w->n_blocks++;
+    return 0;
+}
+
+int arrow_close(arrow_writer_t *w) {
+    // end of stream marker
+    uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    int ret = arrow_fwrite(w, eos, sizeof eos);
+
+    // Footer { version: short (0), schema: Schema (1), dictionaries: [Block] (2), recordBatches: [Block] (3) }
+    // Block { offset: long, metaDataLength: int, (padding), bodyLength: long }
+    fb_t b = { NULL, 0, 0 };
+    fb_put(&b, NULL, sizeof(uint32_t)); // root
+    int16_t version = ARROW_METADATA_V5;
+    uint8_t size[4] = { 2, 4, 4, 4 };
+    const void *val[4] = { &version, NULL, NULL, NULL };
+    size_t pos[4];
+    fb_patch(&b, 0, fb_table(&b, 4, size, val, pos));
+    fb_patch(&b, pos[1], fb_schema(&b, w->fields, w->n_fields));
+    fb_patch(&b, pos[2], fb_struct_vector(&b, NULL, 0, 24));
+    uint8_t *blocks = (uint8_t *) calloc(w->n_blocks ? w->n_blocks : 1, 24);
+    MALLOC_CHK(blocks);
+    for (int64_t i = 0; i < w->n_blocks; i++) {
+        int32_t metadata = (int32_t) w->blocks[3 * i + 1];
+        memcpy(blocks + 24 * i, &w->blocks[3 * i], sizeof(int64_t));
+        memcpy(blocks + 24 * i + 8, &metadata, sizeof metadata);
+        memcpy(blocks + 24 * i + 16, &w->blocks[3 * i + 2], sizeof(int64_t));
+    }
+    fb_patch(&b, pos[3], fb_struct_vector(&b, blocks, (uint32_t) w->n_blocks, 24));
+    free(blocks);
+
+    int32_t footer = (int32_t) b.len;
+    if (ret == 0 && (arrow_fwrite(w, b.data, b.len) < 0 || arrow_fwrite(w, &footer, sizeof footer) < 0 || arrow_fwrite(w, ARROW_MAGIC, strlen(ARROW_MAGIC)) < 0)) {
+        ret = -1;
+    }
+    free(b.data);
+    arrow_free(w);
+    return ret;
+}
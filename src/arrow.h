@@ -0,0 +1,51 @@
+#ifndef ARROW_H
+#define ARROW_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* minimal writer of the Apache Arrow IPC file format (Feather v2), enough for flat tables of
+ * integers, floating point numbers, strings and int16 lists, no dictionaries or compression
+ * readable with pyarrow.ipc.open_file, pandas.read_feather, polars.read_ipc or duckdb (arrow extension) */
+
+enum arrow_type {
+    ARROW_INT8,
+    ARROW_INT16,
+    ARROW_INT32,
+    ARROW_INT64,
+    ARROW_UINT8,
+    ARROW_UINT16,
+    ARROW_UINT32,
+    ARROW_UINT64,
+    ARROW_FLOAT,
+    ARROW_DOUBLE,
+    ARROW_UTF8,             // int32 offsets
+    ARROW_LARGE_LIST_INT16  // int64 offsets, so that a batch can hold more than 2^31 samples
+};
+
+typedef struct {
+    const char *name;
+    enum arrow_type type;
+} arrow_field_t;
+
+/* one column of a record batch */
+typedef struct {
+    int64_t null_count;
+    const uint8_t *validity;    // LSB first bitmap of length bits, 1 is valid (NULL if null_count is 0)
+    const void *values;         // length fixed width values, the bytes of ARROW_UTF8 or the int16 samples of ARROW_LARGE_LIST_INT16
+    const void *offsets;        // length+1 int32 (ARROW_UTF8) or int64 (ARROW_LARGE_LIST_INT16) offsets into values, NULL for fixed width
+} arrow_column_t;
+
+typedef struct arrow_writer arrow_writer_t;
+
+/* the width in bytes of a fixed width type, 0 for ARROW_UTF8 and ARROW_LARGE_LIST_INT16 */
+int arrow_type_width(enum arrow_type type);
+
+/* start an Arrow file with the given schema on fp, returns NULL on error */
+arrow_writer_t *arrow_open(FILE *fp, const arrow_field_t *fields, int32_t n_fields);
+/* append a record batch of length rows, cols has one column per field, returns 0 on success and -1 on error */
+int arrow_write_batch(arrow_writer_t *w, const arrow_column_t *cols, int64_t length);
+/* write the footer and free w (fp is not closed), returns 0 on success and -1 on error */
+int arrow_close(arrow_writer_t *w);
+
+#endif
@@ -11,6 +11,8 @@
 #define DEFAULT_RETAIN_DIR_STRUCTURE 0
 #define DEFAULT_DUMP_ALL 0
 #define DEFAULT_CONTINUE_MERGE 0
+#define DEFAULT_PIN_THREADS 0
+#define DEFAULT_MMAP 0
 
 #define TO_STR(x) TO_STR2(x)
 #define TO_STR2(x) #x
@@ -45,6 +47,12 @@
 #define HELP_MSG_PROCESSES \
     "    -p, --iop INT                 number of I/O processes [" TO_STR(DEFAULT_NUM_PROCESSES) "]\n"
 
+#define HELP_MSG_PIN \
+    "        --pin                     pin worker threads to CPU cores (Linux only)\n"
+
+#define HELP_MSG_MMAP \
+    "        --mmap                    memory map the BLOW5 input instead of reading it record by record\n"
+
 #define HELP_MSG_BATCH \
     "    -K, --batchsize INT           number of records loaded to the memory at once [" TO_STR(DEFAULT_BATCH_SIZE) "]\n"
 
@@ -28,6 +28,8 @@
     "    -s, --sig-compress SIG_MTD    signal compression method [ex-zd] (only for blow5 format)\n" \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
+    HELP_MSG_MMAP \
     "        --from FORMAT             specify input file format [auto]\n" \
     "    -b, --bits INT                specify the number of least significant bits to eliminate [auto]\n" \
     HELP_MSG_HELP \
@@ -43,7 +45,7 @@ static inline uint8_t slow5_suggest_qts(const struct slow5_file *p,
                                         struct dataset *d);
 static inline void slow5_hdrcmp_log(const char *a, uint32_t i, const char *x,
                                     const char *v);
-static int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int64_t batch_size, struct program_meta *meta, uint8_t b, const struct dataset *d);
+static int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int pin_threads, int use_mmap, int64_t batch_size, struct program_meta *meta, uint8_t b, const struct dataset *d);
 static int slow5_get_dataset(const struct slow5_file *p, struct dataset *d);
 static int slow5_hdr_get_dataset(const struct slow5_hdr *h, struct dataset *d);
 static int slow5_hdrcmp(const struct slow5_hdr *h, const char *a,
@@ -234,14 +236,18 @@ static int8_t parse_bits(const char *s)
 
 static void depress_parse_rec_to_mem(core_t *core, db_t *db, int32_t i) {
     //
-    struct slow5_rec *read = NULL;
+    struct slow5_rec **read_ptr = core_rec(core); // reused by this thread for every record
     const struct dataset *d;
 
-    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, &read, core->fp) != 0) {
+    if (db->mapped) {
+        db_mem_record_own(db, i);
+    }
+    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, read_ptr, core->fp) != 0) {
         exit(EXIT_FAILURE);
     } else {
         free(db->mem_records[i]);
     }
+    struct slow5_rec *read = *read_ptr;
 
     if (core->param) {
         d = (const struct dataset *) core->param;
@@ -254,20 +260,17 @@ static void depress_parse_rec_to_mem(core_t *core, db_t *db, int32_t i) {
 
     slow5_rec_qts_round(read, (uint8_t) core->lossy);
 
-    struct slow5_press *press_ptr = slow5_press_init(core->press_method);
-    if(!press_ptr){
-        ERROR("Could not initialize the slow5 compression method%s","");
-        exit(EXIT_FAILURE);
-    }
+    struct slow5_press *press_ptr = core_press(core);
     size_t len;
-    if ((db->read_record[i].buffer = slow5_rec_to_mem(read, core->fp->header->aux_meta, core->format_out, press_ptr, &len)) == NULL) {
-        slow5_press_free(press_ptr);
-        slow5_rec_free(read);
+    if (core->format_out == SLOW5_FORMAT_ASCII) {
+        db->read_record[i].buffer = rec_to_ascii_mem(read, core->fp->header->aux_meta, press_ptr, &len);
+    } else {
+        db->read_record[i].buffer = slow5_rec_to_mem(read, core->fp->header->aux_meta, core->format_out, press_ptr, &len);
+    }
+    if (db->read_record[i].buffer == NULL) {
         exit(EXIT_FAILURE);
     }
-    slow5_press_free(press_ptr);
     db->read_record[i].len = len;
-    slow5_rec_free(read);
 }
 
 int degrade_main(int argc, char **argv, struct program_meta *meta) {
@@ -293,6 +296,8 @@ int degrade_main(int argc, char **argv, struct program_meta *meta) {
         {"threads",         required_argument,  NULL, 't' },
         {"batchsize",       required_argument, NULL, 'K'},
         {"bits",            required_argument, NULL, 'b'},
+        {"pin",             no_argument,        NULL, 0},
+        {"mmap",            no_argument,        NULL, 0},
         {NULL, 0, NULL, 0}
     };
 
@@ -348,6 +353,13 @@ int degrade_main(int argc, char **argv, struct program_meta *meta) {
                     WARNING("%s", "bits > 4: basecalling accuracy may be adversely affected!");
                 }
                 break;
+            case 0:
+                if (!strcmp(long_opts[longindex].name, "pin")) {
+                    user_opts.flag_pin_threads = 1;
+                } else if (!strcmp(long_opts[longindex].name, "mmap")) {
+                    user_opts.flag_mmap = 1;
+                }
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -441,7 +453,7 @@ int degrade_main(int argc, char **argv, struct program_meta *meta) {
 
         // TODO if output is the same format just duplicate file
         slow5_press_method_t press_out = {user_opts.record_press_out,user_opts.signal_press_out};
-        if (slow5_convert_parallel(s5p, user_opts.f_out, (enum slow5_fmt) user_opts.fmt_out, press_out, user_opts.num_threads, user_opts.read_id_batch_capacity, meta, (uint8_t) b, dp) != 0) {
+        if (slow5_convert_parallel(s5p, user_opts.f_out, (enum slow5_fmt) user_opts.fmt_out, press_out, user_opts.num_threads, user_opts.flag_pin_threads, user_opts.flag_mmap, user_opts.read_id_batch_capacity, meta, (uint8_t) b, dp) != 0) {
             ERROR("File conversion failed.%s", "");
             view_ret = EXIT_FAILURE;
         }
@@ -481,7 +493,7 @@ err:
     return view_ret;
 }
 
-static int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int64_t batch_size, struct program_meta *meta, uint8_t b, const struct dataset *d) {
+static int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int pin_threads, int use_mmap, int64_t batch_size, struct program_meta *meta, uint8_t b, const struct dataset *d) {
     if (from == NULL || to_fp == NULL || to_format == SLOW5_FORMAT_UNKNOWN) {
         return -1;
     }
@@ -490,70 +502,90 @@ static int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slo
         return -2;
     }
 
+    // Setup multithreading structures
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = from;
+    core.format_out = to_format;
+    core.press_method = to_compress;
+    core.lossy = (int) b;
+    core.param = (void *) d;
+    core.pool = pool_init(core.num_thread, pin_threads);
+    core_press_init(&core);
+    core_rec_init(&core);
+
     double time_get_to_mem = 0;
     double time_thread_execution = 0;
     double time_write = 0;
     int flag_end_of_file = 0;
+    // the same batch arrays are reused for every batch
+    db_t *db = db_batch_init(batch_size);
+    blow5_mmap_t *map = use_mmap ? blow5_mmap_init(from) : NULL;
+    db->mapped = map != NULL;
     while(1) {
 
-        db_t db = { 0 };
-        db.mem_records = (char **) malloc(batch_size * sizeof(char*));
-        db.mem_bytes = (size_t *) malloc(batch_size * sizeof(size_t));
-        MALLOC_CHK(db.mem_records);
-        MALLOC_CHK(db.mem_bytes);
         int64_t record_count = 0;
         size_t bytes;
         char *mem;
         double realtime = slow5_realtime();
         while (record_count < batch_size) {
-            if (!(mem = (char *) slow5_get_next_mem(&bytes, from))) {
+            mem = map ? blow5_mmap_next(map, &bytes) : (char *) slow5_get_next_mem(&bytes, from);
+            if (!mem) {
                 if (slow5_errno != SLOW5_ERR_EOF) {
+                    for (int64_t i = 0; i < record_count && !map; i++) {
+                        free(db->mem_records[i]);
+                    }
+                    blow5_mmap_free(map);
+                    db_batch_free(db);
+                    core_rec_free(&core);
+                    core_press_free(&core);
+                    pool_free(core.pool);
                     return EXIT_FAILURE;
                 } else {
                     flag_end_of_file = 1;
                     break;
                 }
             } else {
-                db.mem_records[record_count] = mem;
-                db.mem_bytes[record_count] = bytes;
+                db->mem_records[record_count] = mem;
+                db->mem_bytes[record_count] = bytes;
                 record_count++;
             }
         }
         time_get_to_mem += slow5_realtime() - realtime;
 
         realtime = slow5_realtime();
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = num_threads;
-        core.fp = from;
-        core.format_out = to_format;
-        core.press_method = to_compress;
-        core.lossy = (int) b;
-        core.param = (void *) d;
-
-        db.n_batch = record_count;
-        db.read_record = (raw_record_t*) malloc(record_count * sizeof *db.read_record);
-        MALLOC_CHK(db.read_record);
-        work_db(&core,&db,depress_parse_rec_to_mem);
+        db->n_batch = record_count;
+        work_db(&core,db,depress_parse_rec_to_mem);
         time_thread_execution += slow5_realtime() - realtime;
 
         realtime = slow5_realtime();
+        int write_ret = raw_records_fwrite(to_fp, db->read_record, record_count);
+        if (write_ret != 0) {
+            ERROR("Writing the converted records failed - %s.", strerror(errno));
+        }
         for (int64_t i = 0; i < record_count; i++) {
-            fwrite(db.read_record[i].buffer,1,db.read_record[i].len,to_fp);
-            free(db.read_record[i].buffer);
+            free(db->read_record[i].buffer);
+        }
+        if (write_ret != 0) {
+            blow5_mmap_free(map);
+            db_batch_free(db);
+            core_rec_free(&core);
+            core_press_free(&core);
+            pool_free(core.pool);
+            return -2;
         }
         time_write += slow5_realtime() - realtime;
 
-        // Free everything
-        free(db.mem_bytes);
-        free(db.mem_records);
-        free(db.read_record);
-
         if(flag_end_of_file == 1){
             break;
         }
 
     }
+    blow5_mmap_free(map);
+    db_batch_free(db);
+    core_rec_free(&core);
+    core_press_free(&core);
+    pool_free(core.pool);
     if (to_format == SLOW5_FORMAT_BINARY) {
         if (slow5_eof_fwrite(to_fp) == -1) {
             return -2;
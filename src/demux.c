@@ -309,6 +309,8 @@ static core_t *demux_core_init(struct slow5_file *in, struct demux_info *d,
     c->param = (void *) d;
     c->press_method.record_method = opt->record_press_out;
     c->press_method.signal_method = opt->signal_press_out;
+    c->pool = pool_init(c->num_thread, opt->flag_pin_threads);
+    core_press_init(c);
 
     return c;
 }
@@ -522,6 +524,8 @@ static int demux3(struct slow5_file *in, struct slow5_file **out,
         return -1;
     }
 
+    core_press_free(core);
+    pool_free(core->pool);
     free(core);
     demux_db_destroy(db);
 
@@ -1226,9 +1230,7 @@ static void update_db_rec(core_t *core, db_t *db, struct slow5_rec *rec, int i)
     size_t len;
     struct slow5_press *press;
 
-    press = slow5_press_init(core->press_method);
-    if (!press)
-        exit(EXIT_FAILURE);
+    press = core_press(core);
 
     db->read_record[i].buffer = slow5_rec_to_mem(rec, core->aux_meta,
                                                  core->format_out, press,
@@ -1236,7 +1238,6 @@ static void update_db_rec(core_t *core, db_t *db, struct slow5_rec *rec, int i)
     if (!db->read_record[i].buffer)
         exit(EXIT_FAILURE);
     db->read_record[i].len = (int) len; // TODO should be size_t or uint32_t
-    slow5_press_free(press);
 }
 
 /*
@@ -8,6 +8,7 @@
 #ifndef DISABLE_HDF5
 
 #include <getopt.h>
+#include <poll.h>
 #include <sys/wait.h>
 
 #include <string>
@@ -22,6 +23,7 @@
 #include "slow5_extra.h"
 #include "read_fast5.h"
 #include "misc.h"
+#include "thread.h"
 
 #define USAGE_MSG "Usage: %s [OPTIONS] [FAST5_FILE/DIR] ...\n"
 #define HELP_LARGE_MSG \
@@ -34,6 +36,8 @@
     HELP_MSG_OUTPUT_FILE \
     HELP_MSG_PRESS \
     HELP_MSG_PROCESSES \
+    "    -t, --threads INT             number of compression threads per I/O process [" TO_STR(DEFAULT_NUM_THREADS) " divided by -p, at least 1]\n" \
+    HELP_MSG_BATCH \
     HELP_MSG_LOSSLESS \
     HELP_MSG_CONTINUE_F2S \
     HELP_MSG_RETAIN_DIR_STRUCTURE \
@@ -42,12 +46,264 @@
 
 extern int slow5tools_verbosity_level;
 
+/* with -p > 1 and no -d, the files are handed out in the input order and the I/O processes send their output to the parent
+ * through a pipe as frames of a uint8_t type and a uint64_t length followed by the payload, which starts with the int32_t index of
+ * the fast5 file. The parent writes the frames of each fast5 file in the input order, frames of later files are kept in memory
+ * (at most about F2S_REORDER_BUF bytes, the processes ahead are not read from beyond that) until the files before them are done */
+#define F2S_FRAME_HDR 1     // run_id '\0' record attributes '\0' header bytes, before the records of a fast5 file that has any
+#define F2S_FRAME_RECS 2    // encoded records of a batch
+#define F2S_FRAME_END 3     // no more frames for this fast5 file
+#define F2S_COPY_BUF (1024*1024)
+#define F2S_REORDER_BUF (256*1024*1024)
+
+// the output of an I/O process writing to the merged file
+typedef struct {
+    FILE *fp;           // pipe to the parent
+    int32_t file;       // index of the fast5 file being converted
+    int hdr_sent;
+    char *hdr_buf;      // the header of the fast5 file is written by read_fast5 into this open_memstream buffer
+    size_t hdr_len;
+} f2s_merge_t;
+
+// records read by the HDF5 reader in one batch
+typedef struct {
+    slow5_rec_t **recs;
+    int64_t n;
+} f2s_recs_t;
+
+/* compresses and writes the records of one output file on a thread pool while the calling thread keeps on reading fast5
+ * HDF5 reads stay on the calling thread of each I/O process, at most F2S_REC_BATCHES batches of records are in memory */
+#define F2S_REC_BATCHES (PIPELINE_DEPTH + 1)
+typedef struct {
+    core_t core;
+    pipeline_t pl;
+    rec_sink_t sink;
+    int64_t batch_size;
+    int32_t n_batches;      // f2s_recs_t allocated so far
+    f2s_recs_t *cur;        // batch being filled by the HDF5 reader
+    queue_t full_q;         // batches waiting to be compressed
+    queue_t empty_q;        // batches handed back to the HDF5 reader
+    pthread_t tid;
+    int running;            // the pipeline thread has been started and not yet joined
+    f2s_merge_t *merge;     // records go to the parent instead of the slow5 file (NULL otherwise)
+} f2s_writer_t;
+
+static db_t *f2s_batch_init(int64_t cap) {
+    db_t *db = db_batch_init(cap);
+    db->param = malloc(cap * sizeof(slow5_rec_t *));
+    MALLOC_CHK(db->param);
+    return db;
+}
+
+static void f2s_batch_free(db_t *db) {
+    free(db->param);
+    db_batch_free(db);
+}
+
+// take the next batch from the HDF5 reader, its records are moved to db so that the reader can go on straight away
+static db_t *f2s_read_batch(core_t *core, db_t *db, void *arg) {
+    f2s_writer_t *w = (f2s_writer_t *) arg;
+    f2s_recs_t *b = (f2s_recs_t *) queue_pop(&w->full_q);
+    if (b == NULL) {
+        return NULL;
+    }
+    if (db == NULL) {
+        db = f2s_batch_init(w->batch_size);
+    }
+    memcpy(db->param, b->recs, b->n * sizeof *b->recs);
+    db->n_batch = b->n;
+    b->n = 0;
+    queue_push(&w->empty_q, b);
+    return db;
+}
+
+static void f2s_encode_rec(core_t *core, db_t *db, int32_t i) {
+    slow5_rec_t **recs = (slow5_rec_t **) db->param;
+    size_t len;
+    db->read_record[i].buffer = slow5_rec_to_mem(recs[i], core->fp->header->aux_meta, core->format_out, core_press(core), &len);
+    if (db->read_record[i].buffer == NULL) {
+        ERROR("Could not encode the SLOW5 record for read id '%s'.", recs[i]->read_id);
+        exit(EXIT_FAILURE);
+    }
+    db->read_record[i].len = len;
+    slow5_rec_free(recs[i]);
+}
+
+// len is the size of payload, the frame also carries the index of the fast5 file
+static void f2s_frame_fwrite(f2s_merge_t *merge, uint8_t type, uint64_t len, const void *payload) {
+    FILE *fp = merge->fp;
+    uint64_t frame_len = sizeof merge->file + len;
+    if (fwrite(&type, sizeof type, 1, fp) != 1 || fwrite(&frame_len, sizeof frame_len, 1, fp) != 1 ||
+        fwrite(&merge->file, sizeof merge->file, 1, fp) != 1 || (payload && fwrite(payload, 1, len, fp) != len)) {
+        ERROR("Could not send the converted records to the parent process. %s.", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// the record attributes of a header, the records of two headers are only interchangeable if these are the same
+static std::string f2s_aux_spec(slow5_hdr_t *header) {
+    std::string spec;
+    slow5_aux_meta_t *aux_meta = header->aux_meta;
+    for (uint32_t r = 0; aux_meta && r < aux_meta->num; r++) {
+        spec += std::string(aux_meta->attrs[r]) + "\t" + std::to_string(aux_meta->types[r]);
+        if (aux_meta->types[r] == SLOW5_ENUM || aux_meta->types[r] == SLOW5_ENUM_ARRAY) {
+            uint8_t n = 0;
+            const char **labels = (const char **) slow5_get_aux_enum_labels(header, aux_meta->attrs[r], &n);
+            for (uint8_t l = 0; labels && l < n; l++) {
+                spec += std::string("\t") + labels[l];
+            }
+        }
+        spec += "\n";
+    }
+    return spec;
+}
+
+static void f2s_send_header(f2s_writer_t *w) {
+    if (w->merge->hdr_sent) {
+        return;
+    }
+    w->merge->hdr_sent = 1;
+    slow5_hdr_t *header = w->core.fp->header;
+    fflush(w->core.fp->fp); //makes the header available in hdr_buf
+    const char *run_id = slow5_hdr_get("run_id", 0, header);
+    std::string payload = run_id ? run_id : "";
+    payload += '\0';
+    payload += f2s_aux_spec(header);
+    payload += '\0';
+    payload.append(w->merge->hdr_buf, w->merge->hdr_len);
+    f2s_frame_fwrite(w->merge, F2S_FRAME_HDR, payload.size(), payload.data());
+}
+
+static int f2s_write_batch(core_t *core, db_t *db, void *arg) {
+    f2s_writer_t *w = (f2s_writer_t *) arg;
+    FILE *fp = core->fp->fp;
+    if (w->merge) {
+        f2s_send_header(w);
+        uint64_t len = 0;
+        for (int64_t i = 0; i < db->n_batch; i++) {
+            len += db->read_record[i].len;
+        }
+        fp = w->merge->fp;
+        f2s_frame_fwrite(w->merge, F2S_FRAME_RECS, len, NULL);
+    }
+    if (raw_records_fwrite(fp, db->read_record, db->n_batch) < 0) {
+        ERROR("Could not write the SLOW5 records to %s. %s.", core->fp->meta.pathname, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        free(db->read_record[i].buffer);
+    }
+    db->n_batch = 0;
+    return 0;
+}
+
+static void *f2s_writer_thread(void *arg) {
+    f2s_writer_t *w = (f2s_writer_t *) arg;
+    pipeline_db(&w->core, &w->pl);
+    pthread_exit(0);
+}
+
+// rec_sink_t push of read_fast5, blocks while all batches are in use
+static int f2s_writer_push(slow5_rec_t *rec, void *arg) {
+    f2s_writer_t *w = (f2s_writer_t *) arg;
+    if (w->cur == NULL) {
+        w->cur = (f2s_recs_t *) queue_trypop(&w->empty_q);
+        if (w->cur == NULL && w->n_batches < F2S_REC_BATCHES) {
+            w->cur = (f2s_recs_t *) malloc(sizeof *w->cur);
+            MALLOC_CHK(w->cur);
+            w->cur->recs = (slow5_rec_t **) malloc(w->batch_size * sizeof *w->cur->recs);
+            MALLOC_CHK(w->cur->recs);
+            w->cur->n = 0;
+            w->n_batches++;
+        } else if (w->cur == NULL) {
+            w->cur = (f2s_recs_t *) queue_pop(&w->empty_q);
+        }
+    }
+    w->cur->recs[w->cur->n++] = rec;
+    if (w->cur->n == w->batch_size) {
+        queue_push(&w->full_q, w->cur);
+        w->cur = NULL;
+    }
+    return 0;
+}
+
+// start the pipeline thread writing the records of slow5File
+static void f2s_writer_start(f2s_writer_t *w, slow5_file_t *slow5File) {
+    w->core.fp = slow5File;
+    queue_init(&w->full_q, PIPELINE_DEPTH);
+    int ret = pthread_create(&w->tid, NULL, f2s_writer_thread, (void *) w);
+    NEG_CHK(ret);
+    w->running = 1;
+}
+
+// wait until every record pushed so far is written, the writer can then be started again for another file
+static void f2s_writer_finish(f2s_writer_t *w) {
+    if (w->cur && w->cur->n > 0) {
+        queue_push(&w->full_q, w->cur);
+    } else if (w->cur) {
+        queue_push(&w->empty_q, w->cur);
+    }
+    w->cur = NULL;
+    queue_close(&w->full_q);
+    int ret = pthread_join(w->tid, NULL);
+    NEG_CHK(ret);
+    queue_free(&w->full_q);
+    w->running = 0;
+    VERBOSE("%s: waiting for fast5 records %.3fs, compression %.3fs, writing %.3fs", w->core.fp->meta.pathname, w->pl.time_read, w->pl.time_work, w->pl.time_write);
+}
+
+static f2s_writer_t *f2s_writer_open(opt_t *user_opts, slow5_file_t *slow5File, f2s_merge_t *merge) {
+    f2s_writer_t *w = (f2s_writer_t *) calloc(1, sizeof *w);
+    MALLOC_CHK(w);
+    w->merge = merge;
+    w->core.num_thread = user_opts->num_threads;
+    w->core.pool = pool_init(w->core.num_thread, 0);
+    w->core.format_out = user_opts->fmt_out;
+    w->core.press_method = {user_opts->record_press_out, user_opts->signal_press_out};
+    core_press_init(&w->core);
+
+    w->batch_size = user_opts->read_id_batch_capacity;
+    queue_init(&w->empty_q, F2S_REC_BATCHES);
+
+    w->pl.read_db = f2s_read_batch;
+    w->pl.func = f2s_encode_rec;
+    w->pl.write_db = f2s_write_batch;
+    w->pl.free_db = f2s_batch_free;
+    w->pl.arg = w;
+    w->pl.depth = PIPELINE_DEPTH;
+
+    w->sink.push = f2s_writer_push;
+    w->sink.arg = w;
+
+    f2s_writer_start(w, slow5File);
+    return w;
+}
+
+// wait until every record is written, must be called before the BLOW5 EOF is written
+static void f2s_writer_close(f2s_writer_t *w) {
+    if (w->running) {
+        f2s_writer_finish(w);
+    }
+
+    f2s_recs_t *b;
+    while ((b = (f2s_recs_t *) queue_trypop(&w->empty_q)) != NULL) {
+        free(b->recs);
+        free(b);
+    }
+    queue_free(&w->empty_q);
+    core_press_free(&w->core);
+    pool_free(w->core.pool);
+    free(w);
+}
+
 // what a child process should do, i.e. open a tmp file, go through the fast5 files
-void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, reads_count* readsCount,  char *input_dir, proc_arg_t args){
+void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, reads_count* readsCount,  char *input_dir, proc_arg_t args, f2s_merge_t *merge){
     int ret = 0;
     static size_t call_count = 0;
     slow5_file_t* slow5File = NULL;
     slow5_file_t* slow5File_outputdir_single_fast5 = NULL;
+    f2s_writer_t* writer = NULL;
+    f2s_writer_t* writer_outputdir_single_fast5 = NULL;
     FILE *slow5_file_pointer = NULL;
     FILE *slow5_file_pointer_outputdir_single_fast5 = NULL;
     std::string slow5_path;
@@ -63,7 +319,8 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
         slow5_path_outputdir_single_fast5 = slow5_path;
     }
     fast5_file_t fast5_file;
-    for (int i = args.starti; i < args.endi; i++) {
+    int i;
+    while ((i = proc_next_file(&args)) >= 0) {
         readsCount->total_5++;
         fast5_file = fast5_open(fast5_files[i].c_str());
         fast5_file.fast5_path = fast5_files[i].c_str();
@@ -111,11 +368,17 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
                     ERROR("%s","Could not initialise the SLOW5 header.");
                     exit(EXIT_FAILURE);
                 }
-                ret = read_fast5(user_opts, &fast5_file, slow5File, 0, &warning_map);
+                if(!writer){ // the thread pool and compression contexts are kept for the next files
+                    writer = f2s_writer_open(user_opts, slow5File, NULL);
+                }else{
+                    f2s_writer_start(writer, slow5File);
+                }
+                ret = read_fast5(user_opts, &fast5_file, slow5File, 0, &warning_map, &writer->sink);
                 if(ret < 0){
                     ERROR("Bad fast5: Could not read contents of the fast5 file '%s'.", fast5_files[i].c_str());
                     exit(EXIT_FAILURE);
                 }
+                f2s_writer_finish(writer);
                 if(user_opts->fmt_out == SLOW5_FORMAT_BINARY){
                     if (slow5_eof_fwrite(slow5File->fp) < 0){
                         ERROR("Could write the BLOW5 end of file marker in '%s'.", slow5_path.c_str());
@@ -127,7 +390,7 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
 
             }else{ // single-fast5
                 if(!slow5_file_pointer_outputdir_single_fast5){
-                    slow5_path_outputdir_single_fast5 += "/"+std::to_string(args.starti)+extension;
+                    slow5_path_outputdir_single_fast5 += "/"+std::to_string(args.proc_index)+extension;
                     slow5_file_pointer_outputdir_single_fast5 = fopen(slow5_path_outputdir_single_fast5.c_str(), "w");
                     // An error occured
                     if (!slow5_file_pointer_outputdir_single_fast5) {
@@ -145,14 +408,51 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
                         ERROR("%s","Could not initialise the SLOW5 header.");
                         exit(EXIT_FAILURE);
                     }
+                    writer_outputdir_single_fast5 = f2s_writer_open(user_opts, slow5File_outputdir_single_fast5, NULL);
                 }
-                ret = read_fast5(user_opts, &fast5_file, slow5File_outputdir_single_fast5, call_count++, &warning_map);
+                ret = read_fast5(user_opts, &fast5_file, slow5File_outputdir_single_fast5, call_count++, &warning_map, &writer_outputdir_single_fast5->sink);
                 if(ret<0){
                     ERROR("Could not read contents of the fast5 file '%s'.", fast5_files[i].c_str());
                     exit(EXIT_FAILURE);
                 }
             }
         }
+        else if(merge){ // the parent writes the output, each fast5 file gets its own header which the parent checks against the first one
+            slow5_path = user_opts->arg_fname_out ? user_opts->arg_fname_out : "stdout";
+            merge->file = i;
+            merge->hdr_sent = 0;
+            slow5_file_pointer = open_memstream(&merge->hdr_buf, &merge->hdr_len);
+            if (!slow5_file_pointer) {
+                ERROR("Could not open a memory stream for the header. %s.", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            slow5File = slow5_init_empty(slow5_file_pointer, slow5_path.c_str(), SLOW5_FORMAT_BINARY);
+            if (slow5File == NULL){
+                ERROR("%s","Could not initialise the slow5lib data structure.");
+                exit(EXIT_FAILURE);
+            }
+            ret = slow5_hdr_initialize(slow5File->header, user_opts->flag_lossy);
+            if(ret<0){
+                ERROR("%s","Could not initialise the SLOW5 header.");
+                exit(EXIT_FAILURE);
+            }
+            if(!writer){
+                writer = f2s_writer_open(user_opts, slow5File, merge);
+            }else{
+                f2s_writer_start(writer, slow5File);
+            }
+            ret = read_fast5(user_opts, &fast5_file, slow5File, 0, &warning_map, &writer->sink);
+            if(ret<0){
+                ERROR("Could not read contents of the fast5 file '%s'.", fast5_files[i].c_str());
+                exit(EXIT_FAILURE);
+            }
+            f2s_writer_finish(writer);
+            f2s_frame_fwrite(merge, F2S_FRAME_END, 0, NULL);
+            slow5_close(slow5File);
+            slow5File = NULL;
+            free(merge->hdr_buf);
+            merge->hdr_buf = NULL;
+        }
         else{ // output dir not set hence, writing to file/stdout
             if(call_count==0){
                 slow5_path = "stdout";
@@ -180,8 +480,9 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
                     ERROR("%s","Could not initialise the SLOW5 header.");
                     exit(EXIT_FAILURE);
                 }
+                writer = f2s_writer_open(user_opts, slow5File, NULL);
             }
-            ret = read_fast5(user_opts, &fast5_file, slow5File, call_count++, &warning_map);
+            ret = read_fast5(user_opts, &fast5_file, slow5File, call_count++, &warning_map, &writer->sink);
             if(ret<0){
                 ERROR("Could not read contents of the fast5 file '%s'.", fast5_files[i].c_str());
                 exit(EXIT_FAILURE);
@@ -190,7 +491,11 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
         H5Fclose(fast5_file.hdf5_file);
     }
 
+    if(output_dir && writer){
+        f2s_writer_close(writer);
+    }
     if(slow5File_outputdir_single_fast5 && slow5_file_pointer_outputdir_single_fast5) {
+        f2s_writer_close(writer_outputdir_single_fast5);
         if(user_opts->fmt_out == SLOW5_FORMAT_BINARY){
             if(slow5_eof_fwrite(slow5File_outputdir_single_fast5->fp) < 0){
                 ERROR("Could write the BLOW5 end of file marker in '%s'.", slow5_path.c_str());
@@ -200,6 +505,7 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
         slow5_close(slow5File_outputdir_single_fast5);
     }
     if(slow5File && !output_dir) {
+        f2s_writer_close(writer);
         if(user_opts->fmt_out == SLOW5_FORMAT_BINARY){
             if(slow5_eof_fwrite(slow5File->fp) < 0){
                 ERROR("Could write the BLOW5 end of file marker in '%s'.", slow5_path.c_str());
@@ -208,9 +514,235 @@ void f2s_child_worker(opt_t *user_opts, std::vector<std::string>& fast5_files, r
         }
         slow5_close(slow5File); //if stdout was used stdout is now closed.
     }
+    if(merge){
+        if(writer){
+            f2s_writer_close(writer);
+        }
+        if(fclose(merge->fp) == EOF){
+            ERROR("Could not send the converted records to the parent process. %s.", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
     INFO("Summary - total fast5: %lu, bad fast5: %lu", readsCount->total_5, readsCount->bad_5_file);
 }
 
+// read n bytes unless the other end is closed first, returns the number of bytes read
+static size_t f2s_read_full(int fd, void *buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = read(fd, (char *) buf + done, n - done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            ERROR("Could not read from an I/O process. %s.", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (ret == 0) {
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+// the parent side of the merged file
+typedef struct {
+    FILE *out;
+    const char *out_path;
+    int flag_allow_run_id_mismatch;
+    int32_t next_file;      // the fast5 file whose frames are written now
+    int hdr_written;
+    std::string run_id;     // of the header written
+    std::string spec;
+    int run_id_warned;
+    uint64_t n_bytes;
+    std::vector<std::vector<std::pair<uint8_t, std::string>>> pending;     // frames of the fast5 files after next_file
+    uint64_t pending_bytes;
+} f2s_merge_out_t;
+
+static void f2s_merge_fwrite(f2s_merge_out_t *mo, const char *buf, size_t n) {
+    if (fwrite(buf, 1, n, mo->out) != n) {
+        ERROR("Could not write the SLOW5 records to %s. %s.", mo->out_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* the first header received becomes the header of out, like with -p 1 the other fast5 files must have the same record
+ * attributes and run_id (unless -a, then the first run_id is kept) */
+static void f2s_merge_header(f2s_merge_out_t *mo, const std::string &payload) {
+    size_t end_run_id = payload.find('\0');
+    size_t end_spec = payload.find('\0', end_run_id + 1);
+    if (end_run_id == std::string::npos || end_spec == std::string::npos) {
+        ERROR("Unexpected header from an I/O process for fast5 file %d.", mo->next_file);
+        exit(EXIT_FAILURE);
+    }
+    std::string run_id = payload.substr(0, end_run_id);
+    std::string spec = payload.substr(end_run_id + 1, end_spec - end_run_id - 1);
+    if (!mo->hdr_written) {
+        if (fwrite(payload.data() + end_spec + 1, 1, payload.size() - end_spec - 1, mo->out) != payload.size() - end_spec - 1) {
+            ERROR("Could not write the SLOW5 header to %s. %s.", mo->out_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        mo->run_id = run_id;
+        mo->spec = spec;
+        mo->hdr_written = 1;
+        return;
+    }
+    if (spec != mo->spec) {
+        ERROR("The fast5 files do not have the same record attributes and cannot be written to one file. Convert to a directory (-d) and use slow5tools merge.%s", "");
+        exit(EXIT_FAILURE);
+    }
+    if (run_id != mo->run_id) {
+        if (!mo->flag_allow_run_id_mismatch) {
+            ERROR("Ancient fast5: Different run_ids found in an individual multi-fast5 file. Cannot create a single header slow5/blow5. Consider --allow option.%s", "");
+            exit(EXIT_FAILURE);
+        }
+        if (!mo->run_id_warned) {
+            WARNING("slow5tools-v%s: %s.", SLOW5TOOLS_VERSION, "Ancient fast5: Different run_ids found in an individual multi-fast5 file. First seen run_id will be set in slow5 header");
+            mo->run_id_warned = 1;
+        }
+    }
+}
+
+// a whole frame of next_file
+static void f2s_merge_frame(f2s_merge_out_t *mo, uint8_t type, const std::string &payload) {
+    if (type == F2S_FRAME_HDR) {
+        f2s_merge_header(mo, payload);
+    } else if (type == F2S_FRAME_RECS && mo->hdr_written) {
+        f2s_merge_fwrite(mo, payload.data(), payload.size());
+        mo->n_bytes += payload.size();
+    } else if (type == F2S_FRAME_END) {
+        mo->next_file++;
+    } else {
+        ERROR("Unexpected output from an I/O process for fast5 file %d.", mo->next_file);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// write the frames kept for the fast5 files that are now next
+static void f2s_merge_pending(f2s_merge_out_t *mo) {
+    while (mo->next_file < (int32_t) mo->pending.size() && !mo->pending[mo->next_file].empty()) {
+        std::vector<std::pair<uint8_t, std::string>> frames;
+        frames.swap(mo->pending[mo->next_file]);
+        int32_t file = mo->next_file;
+        for (size_t f = 0; f < frames.size(); f++) {
+            mo->pending_bytes -= frames[f].second.size();
+            if (mo->next_file != file) { // the END of file was received, the rest belongs to no file
+                ERROR("Unexpected output from an I/O process for fast5 file %d.", file);
+                exit(EXIT_FAILURE);
+            }
+            f2s_merge_frame(mo, frames[f].first, frames[f].second);
+        }
+    }
+}
+
+/* write the frames of the I/O processes to out in the order of the fast5 files, until every process has closed its pipe
+ * the files are handed out in the input order, so a process that sent a frame of a file after next_file is not converting
+ * next_file and is not read from while too many frames are kept */
+static void f2s_merge_children(FILE *out, const char *out_path, int *fds, int32_t n, int32_t n_files, opt_t *user_opts) {
+    f2s_merge_out_t mo;
+    mo.out = out;
+    mo.out_path = out_path;
+    mo.flag_allow_run_id_mismatch = user_opts->flag_allow_run_id_mismatch;
+    mo.next_file = 0;
+    mo.hdr_written = 0;
+    mo.run_id_warned = 0;
+    mo.n_bytes = 0;
+    mo.pending.resize(n_files);
+    mo.pending_bytes = 0;
+
+    std::vector<int32_t> last_file(n, -1);  // of the last frame from each process
+    std::vector<struct pollfd> pfds;
+    std::vector<int32_t> procs;
+    char *buf = (char *) malloc(F2S_COPY_BUF);
+    MALLOC_CHK(buf);
+    int32_t n_open = n;
+
+    while (n_open > 0) {
+        pfds.clear();
+        procs.clear();
+        for (int32_t t = 0; t < n; t++) {
+            if (fds[t] >= 0 && (mo.pending_bytes < F2S_REORDER_BUF || last_file[t] <= mo.next_file)) {
+                struct pollfd pfd = {fds[t], POLLIN, 0};
+                pfds.push_back(pfd);
+                procs.push_back(t);
+            }
+        }
+        if (pfds.empty()) { // the process converting next_file has exited without finishing it
+            ERROR("The I/O processes stopped before fast5 file %d was converted.", mo.next_file);
+            exit(EXIT_FAILURE);
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERROR("Polling the I/O processes failed. %s.", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (size_t p = 0; p < pfds.size(); p++) {
+            int32_t t = procs[p];
+            if (!(pfds[p].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            uint8_t type;
+            uint64_t len;
+            int32_t file;
+            size_t got = f2s_read_full(fds[t], &type, sizeof type);
+            if (got == 0) { //the process is done
+                close(fds[t]);
+                fds[t] = -1;
+                n_open--;
+                continue;
+            }
+            if (f2s_read_full(fds[t], &len, sizeof len) != sizeof len || len < sizeof file ||
+                f2s_read_full(fds[t], &file, sizeof file) != sizeof file) {
+                ERROR("I/O process %d stopped in the middle of sending its output.", t);
+                exit(EXIT_FAILURE);
+            }
+            len -= sizeof file;
+            if (file < mo.next_file || file >= n_files || file < last_file[t]) {
+                ERROR("Unexpected output from I/O process %d.", t);
+                exit(EXIT_FAILURE);
+            }
+            last_file[t] = file;
+
+            if (file == mo.next_file && type == F2S_FRAME_RECS && mo.hdr_written) { // straight to out
+                uint64_t left = len;
+                while (left > 0) {
+                    size_t chunk = left < F2S_COPY_BUF ? left : F2S_COPY_BUF;
+                    if (f2s_read_full(fds[t], buf, chunk) != chunk) {
+                        ERROR("I/O process %d stopped in the middle of sending its output.", t);
+                        exit(EXIT_FAILURE);
+                    }
+                    f2s_merge_fwrite(&mo, buf, chunk);
+                    left -= chunk;
+                }
+                mo.n_bytes += len;
+                continue;
+            }
+            std::string payload(len, '\0');
+            if (f2s_read_full(fds[t], &payload[0], len) != len) {
+                ERROR("I/O process %d stopped in the middle of sending its output.", t);
+                exit(EXIT_FAILURE);
+            }
+            if (file == mo.next_file) {
+                f2s_merge_frame(&mo, type, payload);
+                f2s_merge_pending(&mo);
+            } else {
+                mo.pending_bytes += payload.size();
+                mo.pending[file].push_back({type, std::move(payload)});
+            }
+        }
+    }
+    if (mo.next_file != n_files) {
+        ERROR("The I/O processes stopped before fast5 file %d was converted.", mo.next_file);
+        exit(EXIT_FAILURE);
+    }
+    VERBOSE("%" PRIu64 " bytes of records from %d I/O processes written to %s", mo.n_bytes, n, out_path);
+    free(buf);
+}
+
 void f2s_iop(opt_t *user_opts, std::vector<std::string> &fast5_files, reads_count *readsCount, char *input_dir) {
     int32_t num_fast5_files = fast5_files.size();
     int32_t iop = user_opts->num_processes;
@@ -219,6 +751,10 @@ void f2s_iop(opt_t *user_opts, std::vector<std::string> &fast5_files, reads_coun
         user_opts->num_processes = iop;
     }
     VERBOSE("%zu proceses will be used.",user_opts->num_processes);
+    if (user_opts->arg_num_threads == NULL) { // share the default number of threads among the processes
+        user_opts->num_threads = DEFAULT_NUM_THREADS / iop > 0 ? DEFAULT_NUM_THREADS / iop : 1;
+    }
+    VERBOSE("%zu compression threads per process will be used.", user_opts->num_threads);
 
     //create processes
 //    pid_t pids[iop];
@@ -244,18 +780,53 @@ void f2s_iop(opt_t *user_opts, std::vector<std::string> &fast5_files, reads_coun
             proc_args[t].endi = i;
         }
         proc_args[t].proc_index = t;
+        proc_args[t].order = NULL;
+        proc_args[t].next = NULL;
+    }
+
+    //hand out the files on demand, largest first, so that a few large files do not keep one process busy long after the others are done
+    std::vector<int32_t> file_order;
+    if(iop>1 && proc_queue_init(proc_args, iop, fast5_files, file_order) < 0){
+        exit(EXIT_FAILURE);
+    }
+    //a single output file is written in the input order, so the files are handed out in that order to keep the reorder window small
+    if(iop>1 && user_opts->arg_dir_out == NULL){
+        for(size_t f = 0; f < file_order.size(); f++){
+            file_order[f] = f;
+        }
     }
 
     if(iop==1){
-        f2s_child_worker(user_opts, fast5_files,readsCount, input_dir, proc_args[0]);
+        f2s_child_worker(user_opts, fast5_files,readsCount, input_dir, proc_args[0], NULL);
         free(proc_args);
         free(pids);
         return;
     }
 
+    //without an output directory the processes send their records through a pipe to this process, which writes a single file
+    int merged = user_opts->arg_dir_out == NULL;
+    FILE *merged_fp = NULL;
+    const char *merged_path = user_opts->arg_fname_out ? user_opts->arg_fname_out : "stdout";
+    std::vector<int> fds(iop, -1);
+    if(merged){
+        merged_fp = user_opts->arg_fname_out ? fopen(user_opts->arg_fname_out, "wb") : stdout;
+        if(!merged_fp){
+            ERROR("Output file %s could not be opened for writing. %s.", user_opts->arg_fname_out, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        fflush(merged_fp);
+    }
+
     //create processes
     VERBOSE("Spawning %d I/O processes to circumvent HDF hell.", iop);
     for(t = 0; t < iop; t++){
+        int pipefd[2];
+        if(merged){
+            if(pipe(pipefd) < 0){
+                ERROR("Could not create a pipe. %s.", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
         pids[t] = fork();
 
         if(pids[t]==-1){
@@ -264,14 +835,34 @@ void f2s_iop(opt_t *user_opts, std::vector<std::string> &fast5_files, reads_coun
             exit(EXIT_FAILURE);
         }
         if(pids[t]==0){ //child
-            f2s_child_worker(user_opts, fast5_files, readsCount, input_dir,  proc_args[t]);
+            f2s_merge_t merge = {NULL, 0, 0, NULL, 0};
+            if(merged){
+                close(pipefd[0]);
+                for(int32_t u = 0; u < t; u++){
+                    close(fds[u]);
+                }
+                merge.fp = fdopen(pipefd[1], "w");
+                if(!merge.fp){
+                    ERROR("Could not open the pipe to the parent process. %s.", strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+            }
+            f2s_child_worker(user_opts, fast5_files, readsCount, input_dir,  proc_args[t], merged ? &merge : NULL);
             exit(EXIT_SUCCESS);
         }
         if(pids[t]>0){ //parent
+            if(merged){
+                close(pipefd[1]);
+                fds[t] = pipefd[0];
+            }
             continue;
         }
     }
 
+    if(merged){
+        f2s_merge_children(merged_fp, merged_path, fds.data(), iop, num_fast5_files, user_opts);
+    }
+
     //wait for processes
     int status,w;
     for (t = 0; t < iop; t++) {
@@ -304,6 +895,17 @@ void f2s_iop(opt_t *user_opts, std::vector<std::string> &fast5_files, reads_coun
             exit(EXIT_FAILURE);
         }
     }
+    if(merged){
+        if(user_opts->fmt_out == SLOW5_FORMAT_BINARY && slow5_eof_fwrite(merged_fp) < 0){
+            ERROR("Could write the BLOW5 end of file marker in '%s'.", merged_path);
+            exit(EXIT_FAILURE);
+        }
+        if(fclose(merged_fp) == EOF){
+            ERROR("Could not close %s. %s.", merged_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    proc_queue_free(&proc_args[0]);
     free(proc_args);
     free(pids);
 }
@@ -336,6 +938,8 @@ int f2s_main(int argc, char **argv, struct program_meta *meta) {
             {"allow",       no_argument,       NULL, 'a'},  //8
             {"retain",      no_argument,       NULL,  0 },  //9
             {"dump-all",    required_argument, NULL,  0 },  //10
+            {"threads",     required_argument, NULL, 't'},  //11
+            {"batchsize",   required_argument, NULL, 'K'},  //12
             {NULL, 0, NULL, 0 }
     };
 
@@ -346,7 +950,7 @@ int f2s_main(int argc, char **argv, struct program_meta *meta) {
     int longindex = 0;
 
     // Parse options
-    while ((opt = getopt_long(argc, argv, "c:s:ho:p:d:a", long_opts, &longindex)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:s:ho:p:d:at:K:", long_opts, &longindex)) != -1) {
         DEBUG("opt='%c', optarg=\"%s\", optind=%d, opterr=%d, optopt='%c'",
                   opt, optarg, optind, opterr, optopt);
         switch (opt) {
@@ -374,6 +978,12 @@ int f2s_main(int argc, char **argv, struct program_meta *meta) {
             case 'o':
                 user_opts.arg_fname_out = optarg;
                 break;
+            case 't':
+                user_opts.arg_num_threads = optarg;
+                break;
+            case 'K':
+                user_opts.arg_batch = optarg;
+                break;
             case 0  :
                 switch (longindex) {
                     case 0:
@@ -404,6 +1014,14 @@ int f2s_main(int argc, char **argv, struct program_meta *meta) {
         EXIT_MSG(EXIT_FAILURE, argv, meta);
         return EXIT_FAILURE;
     }
+    if(parse_num_threads(&user_opts,argc,argv,meta) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
+    if(parse_batch_size(&user_opts,argc,argv) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
     if(parse_arg_lossless(&user_opts, argc, argv, meta) < 0){
         EXIT_MSG(EXIT_FAILURE, argv, meta);
         return EXIT_FAILURE;
@@ -463,8 +1081,7 @@ int f2s_main(int argc, char **argv, struct program_meta *meta) {
         user_opts.num_processes = 1;
     }
     if(user_opts.num_processes>1 && !user_opts.arg_dir_out){
-        ERROR("An output directory (-d DIR) must be specified unless the number of  I/O processes is 1 (-p 1). %s","");
-        return EXIT_FAILURE;
+        VERBOSE("The %zu I/O processes will write a single merged file.", user_opts.num_processes);
     }
 
     if (check_for_similar_file_names(fast5_files)){
@@ -11,12 +11,15 @@
 #include "thread.h"
 #include "cmd.h"
 #include "misc.h"
+#include "read_fast5.h"
 
-#define READ_ID_INIT_CAPACITY (128)
+#define GET_COALESCE_GAP (64*1024) //records at most this far apart in the file are fetched with a single read
+#define GET_COALESCE_MAX (16*1024*1024) //but a single read is never larger than this
+#define GET_ID_BLOCK (256*1024) //bytes of the read id list read at once
 
-#define USAGE_MSG "Usage: %s [OPTIONS] [SLOW5_FILE] [READ_ID]...\n"
+#define USAGE_MSG "Usage: %s [OPTIONS] [SLOW5_FILE/DIR]... [READ_ID]...\n"
 #define HELP_LARGE_MSG \
-    "Display the read entry for each specified read id from a slow5 file.\n" \
+    "Display the read entry for each specified read id from one or more slow5 files (or directories of them).\n" \
     "With no READ_ID, read from standard input newline separated read ids.\n" \
     USAGE_MSG \
     "\n" \
@@ -26,6 +29,7 @@
     HELP_MSG_PRESS \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
     "    -l --list [FILE]              list of read ids provided as a single-column text file with one read id per line.\n" \
     "    --skip                        warn and continue if a read_id was not found.\n" \
     "    --index [FILE]                path to a custom slow5 index (experimental).\n" \
@@ -34,38 +38,544 @@
 
 extern int slow5tools_verbosity_level;
 
-void work_per_single_read_get(core_t *core, db_t *db, int32_t i) {
+KHASH_MAP_INIT_STR(get_s2i32, int32_t)
+
+int compare_headers(slow5_hdr_t *output_header, slow5_hdr_t *input_header, int64_t output_g, int64_t input_g, const char *i_file_path, const char *j_run_id);
+
+/* the input files, records are written with the header of the first one or the merged header of all of them */
+typedef struct {
+    std::vector<std::string> paths;
+    slow5_file_t **fps;
+    int32_t n;
+    slow5_hdr_t *out_header;                 // merged header of many files, NULL for a single file
+    std::vector<std::vector<size_t>> rg_map; // read group in file f -> read group in the output header, empty for a single file
+    khash_t(get_s2i32) *id_to_file;          // read id -> file, NULL for a single file
+} get_files_t;
+
+/* location of a requested record in the file, from the index */
+typedef struct {
+    int64_t i;          // position of the read id in the batch
+    int32_t file;       // index into get_files_t
+    uint64_t offset;
+    uint64_t size;
+} get_loc_t;
+
+/* the found records of a batch sorted by file offset, grouped into runs that are fetched with a single read */
+typedef struct {
+    get_loc_t *locs;
+    int64_t n_locs;
+    int64_t *run_start; // run r is locs[run_start[r]] to locs[run_start[r+1]-1]
+    int64_t n_runs;
+    int64_t cap;
+} get_plan_t;
+
+static int cmp_get_loc(const void *a, const void *b) {
+    const get_loc_t *x = (const get_loc_t *) a;
+    const get_loc_t *y = (const get_loc_t *) b;
+    if (x->file != y->file) {
+        return x->file < y->file ? -1 : 1;
+    }
+    if (x->offset != y->offset) {
+        return x->offset < y->offset ? -1 : 1;
+    }
+    return x->i < y->i ? -1 : (x->i > y->i);
+}
 
-    char *id = db->read_id[i];
+// header the records are written with
+static slow5_hdr_t *get_out_header(const get_files_t *files) {
+    return files->out_header ? files->out_header : files->fps[0]->header;
+}
 
-    int len = 0;
-    //fprintf(stderr, "Fetching %s\n", id); // TODO print here or during ordered loop later?
-    slow5_rec_t *record=NULL;
+// file holding read_id, -1 if it is in none
+static int32_t get_file_of(const get_files_t *files, const char *read_id) {
+    if (files->id_to_file == NULL) {
+        return 0;
+    }
+    khint_t k = kh_get(get_s2i32, files->id_to_file, read_id);
+    return k == kh_end(files->id_to_file) ? -1 : kh_value(files->id_to_file, k);
+}
 
-    len = slow5_get(id,&record,core->fp);
+// look up the first n read ids of the batch in the index, sort them by file and offset and group neighbouring records into runs
+// ids that are not in the index get a NULL record and are counted in db->n_err
+static void get_plan_batch(get_plan_t *plan, db_t *db, int64_t n, const get_files_t *files, int skip_flag) {
+    if (plan->cap < n) {
+        plan->cap = n;
+        plan->locs = (get_loc_t *) realloc(plan->locs, plan->cap * sizeof *plan->locs);
+        MALLOC_CHK(plan->locs);
+        plan->run_start = (int64_t *) realloc(plan->run_start, (plan->cap + 1) * sizeof *plan->run_start);
+        MALLOC_CHK(plan->run_start);
+    }
 
-    if (record == NULL || len < 0) {
-        ++ db->n_err;
-        db->read_record[i].buffer = NULL;
-        db->read_record[i].len = -1;
-    }else {
-        if (core->benchmark == false){
-            size_t record_size;
-            struct slow5_press* compress = slow5_press_init(core->press_method);
-            if(!compress){
-                ERROR("Could not initialize the slow5 compression method%s","");
-                exit(EXIT_FAILURE);
+    db->n_err = 0;
+    plan->n_locs = 0;
+    for (int64_t i = 0; i < n; i++) {
+        struct slow5_rec_idx rec_idx;
+        int32_t f = get_file_of(files, db->read_id[i]);
+        if (f < 0 || slow5_idx_get(files->fps[f]->index, db->read_id[i], &rec_idx) < 0) {
+            if (skip_flag) {
+                WARNING("Read ID '%s' was not found. Skipping.", db->read_id[i]);
+            } else {
+                ERROR("Read ID '%s' was not found.", db->read_id[i]);
             }
-            db->read_record[i].buffer = slow5_rec_to_mem(record,core->fp->header->aux_meta, core->format_out, compress, &record_size);
-            db->read_record[i].len = record_size;
-            slow5_press_free(compress);
+            db->read_record[i].buffer = NULL;
+            db->read_record[i].len = -1;
+            ++ db->n_err;
+            continue;
         }
-        slow5_rec_free(record);
+        get_loc_t *loc = &plan->locs[plan->n_locs++];
+        loc->i = i;
+        loc->file = f;
+        loc->offset = rec_idx.offset;
+        loc->size = rec_idx.size;
+    }
+    qsort(plan->locs, plan->n_locs, sizeof *plan->locs, cmp_get_loc);
+
+    // only BLOW5 records are fetched in runs, SLOW5 records go through slow5_get one by one (still in file order)
+    plan->n_runs = 0;
+    for (int64_t j = 0; j < plan->n_locs; j++) {
+        const get_loc_t *cur = &plan->locs[j];
+        if (j > 0 && files->fps[cur->file]->format == SLOW5_FORMAT_BINARY) {
+            const get_loc_t *first = &plan->locs[plan->run_start[plan->n_runs - 1]];
+            const get_loc_t *prev = &plan->locs[j - 1];
+            uint64_t prev_end = prev->offset + prev->size;
+            if (cur->file == prev->file && cur->offset <= prev_end + GET_COALESCE_GAP && cur->offset + cur->size - first->offset <= GET_COALESCE_MAX) {
+                continue;
+            }
+        }
+        plan->run_start[plan->n_runs++] = j;
     }
-    free(id);
+    plan->run_start[plan->n_runs] = plan->n_locs;
 }
 
-bool fetch_record(slow5_file_t *fp, const char *read_id, char **argv, program_meta *meta, slow5_fmt format_out,
+/* per batch state of the batched get, hung off db->param */
+typedef struct {
+    char *arena;        // a block of the read id list, parsed in place, db->read_id point into it
+    size_t arena_cap;
+    size_t *id_off;     // offsets of the read ids in the arena while parsing
+    int64_t n_ids;      // number of read ids in the batch (db->n_batch is the number of runs)
+    get_plan_t plan;
+} get_batch_t;
+
+typedef struct {
+    FILE *list;         // newline separated read ids
+    char *carry;        // unparsed bytes left over by the previous batch
+    size_t carry_len;
+    size_t carry_cap;
+    int eof;
+    get_files_t *files;
+    int64_t batch_size;
+    int skip_flag;
+    bool benchmark;
+    FILE *out;
+    int ret;
+} get_arg_t;
+
+static db_t *get_batch_init(int64_t cap) {
+    db_t *db = (db_t *) calloc(1, sizeof *db);
+    MALLOC_CHK(db);
+    db->capacity = cap;
+    db->read_id = (char **) malloc(cap * sizeof *db->read_id);
+    MALLOC_CHK(db->read_id);
+    db->read_record = (raw_record_t *) malloc(cap * sizeof *db->read_record);
+    MALLOC_CHK(db->read_record);
+    get_batch_t *b = (get_batch_t *) calloc(1, sizeof *b);
+    MALLOC_CHK(b);
+    b->arena_cap = GET_ID_BLOCK;
+    b->arena = (char *) malloc(b->arena_cap);
+    MALLOC_CHK(b->arena);
+    b->id_off = (size_t *) malloc(cap * sizeof *b->id_off);
+    MALLOC_CHK(b->id_off);
+    db->param = b;
+    return db;
+}
+
+static void get_batch_free(db_t *db) {
+    get_batch_t *b = (get_batch_t *) db->param;
+    free(b->arena);
+    free(b->id_off);
+    free(b->plan.locs);
+    free(b->plan.run_start);
+    free(b);
+    free(db->read_id);
+    free(db->read_record);
+    free(db);
+}
+
+// parse up to ga->batch_size read ids from the list, a block at a time, into the arena of the batch
+// the ids are terminated in place so that there is no allocation per read id
+static int64_t get_parse_ids(get_arg_t *ga, db_t *db) {
+    get_batch_t *b = (get_batch_t *) db->param;
+    if (b->arena_cap <= ga->carry_len) {
+        b->arena_cap = ga->carry_len + GET_ID_BLOCK;
+        b->arena = (char *) realloc(b->arena, b->arena_cap);
+        MALLOC_CHK(b->arena);
+    }
+    memcpy(b->arena, ga->carry, ga->carry_len);
+    size_t len = ga->carry_len; // bytes in the arena, at most arena_cap-1 so that a last line without '\n' can be terminated
+    size_t pos = 0;             // start of the next line
+    ga->carry_len = 0;
+
+    int64_t n = 0;
+    while (n < ga->batch_size) {
+        char *nl = (char *) memchr(b->arena + pos, '\n', len - pos);
+        if (nl == NULL) {
+            if (!ga->eof) {
+                if (len == b->arena_cap - 1) { // a single block does not fit the rest of the batch
+                    b->arena_cap *= 2;
+                    b->arena = (char *) realloc(b->arena, b->arena_cap);
+                    MALLOC_CHK(b->arena);
+                }
+                size_t want = b->arena_cap - 1 - len;
+                if (want > GET_ID_BLOCK) {
+                    want = GET_ID_BLOCK; // keep what is carried over to the next batch small
+                }
+                size_t nread = fread(b->arena + len, 1, want, ga->list);
+                if (nread == 0) {
+                    if (ferror(ga->list)) {
+                        ERROR("Reading the read id list failed - %s.", strerror(errno));
+                        ga->ret = EXIT_FAILURE;
+                        return 0;
+                    }
+                    ga->eof = 1;
+                }
+                len += nread;
+                continue;
+            } else if (pos < len) {
+                nl = b->arena + len; // last line without a newline
+            } else {
+                break;
+            }
+        }
+        size_t start = pos;
+        size_t end = nl - b->arena;
+        pos = end < len ? end + 1 : len;
+        if (end > start && b->arena[end - 1] == '\r') {
+            end--; // Ignore '\r' at the end of the line
+        }
+        if (end == start) {
+            continue;
+        }
+        b->arena[end] = '\0';
+        b->id_off[n++] = start;
+    }
+
+    // keep the rest for the next batch
+    if (len > pos) {
+        if (ga->carry_cap < len - pos) {
+            ga->carry_cap = len - pos;
+            ga->carry = (char *) realloc(ga->carry, ga->carry_cap);
+            MALLOC_CHK(ga->carry);
+        }
+        memcpy(ga->carry, b->arena + pos, len - pos);
+        ga->carry_len = len - pos;
+    }
+    for (int64_t i = 0; i < n; i++) {
+        db->read_id[i] = b->arena + b->id_off[i];
+    }
+    return n;
+}
+
+// reader stage: the next batch of read ids with its fetch plan, NULL at the end of the list
+static db_t *get_read_batch(core_t *core, db_t *db, void *arg) {
+    get_arg_t *ga = (get_arg_t *) arg;
+    if (ga->ret != 0 || (ga->eof && ga->carry_len == 0)) {
+        return NULL;
+    }
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = get_batch_init(ga->batch_size);
+    }
+    get_batch_t *b = (get_batch_t *) db->param;
+    b->n_ids = get_parse_ids(ga, db);
+    if (b->n_ids == 0) {
+        if (new_db) {
+            get_batch_free(new_db);
+        }
+        return NULL;
+    }
+    get_plan_batch(&b->plan, db, b->n_ids, ga->files, ga->skip_flag);
+    db->n_batch = b->plan.n_runs;
+    return db;
+}
+
+// writer stage: write the fetched records in the requested order
+static int get_write_batch(core_t *core, db_t *db, void *arg) {
+    get_arg_t *ga = (get_arg_t *) arg;
+    get_batch_t *b = (get_batch_t *) db->param;
+    VERBOSE("Fetched %ld reads of %ld", b->n_ids - db->n_err, b->n_ids);
+    if (ga->benchmark) {
+        return 0;
+    }
+    int ret = 0;
+    for (int64_t i = 0; i < b->n_ids; ++ i) {
+        void *buffer = db->read_record[i].buffer;
+        int len = db->read_record[i].len;
+        if (buffer == NULL || len < 0) {
+            if (ga->skip_flag) continue;
+            if (ret == 0) {
+                ERROR("Could not write the fetched read.%s","");
+            }
+            ret = -1;
+        } else {
+            if (ret == 0 && fwrite(buffer,1,len,ga->out) != (size_t) len) {
+                ERROR("Could not write the fetched read - %s.", strerror(errno));
+                ret = -1;
+            }
+            free(buffer);
+        }
+    }
+    return ret;
+}
+
+static void pread_full(int fd, char *buf, size_t count, uint64_t offset) {
+    while (count > 0) {
+        ssize_t n = pread(fd, buf, count, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ERROR("Reading the records failed - %s.", n < 0 ? strerror(errno) : "unexpected end of file");
+            exit(EXIT_FAILURE);
+        }
+        buf += n;
+        count -= n;
+        offset += n;
+    }
+}
+
+// encode the record just fetched from file f with the output header, into slot i of the batch
+static void get_rec_to_mem(core_t *core, db_t *db, int64_t i, int32_t f) {
+    slow5_rec_t *record = *core_rec(core);
+    const get_files_t *files = (const get_files_t *) core->param;
+    if (!files->rg_map.empty()) {
+        record->read_group = files->rg_map[f][record->read_group];
+    }
+    if (core->benchmark == false){
+        size_t record_size;
+        struct slow5_press* compress = core_press(core);
+        db->read_record[i].buffer = slow5_rec_to_mem(record,get_out_header(files)->aux_meta, core->format_out, compress, &record_size);
+        db->read_record[i].len = record_size;
+    }
+}
+
+// fetch run r of the batch plan with one read and decode its records into their slots in the batch
+void work_per_run_get(core_t *core, db_t *db, int32_t r) {
+    get_plan_t *plan = &((get_batch_t *) db->param)->plan;
+    const get_loc_t *first = &plan->locs[plan->run_start[r]];
+    const get_loc_t *last = &plan->locs[plan->run_start[r + 1] - 1];
+    slow5_file_t *fp = ((const get_files_t *) core->param)->fps[first->file];
+    slow5_rec_t **record_ptr = core_rec(core); // reused by this thread for every record
+
+    if (fp->format != SLOW5_FORMAT_BINARY) {
+        int64_t i = first->i;
+        int len = slow5_get(db->read_id[i], record_ptr, fp);
+        if (*record_ptr == NULL || len < 0) {
+            db->read_record[i].buffer = NULL;
+            db->read_record[i].len = -1;
+        } else {
+            get_rec_to_mem(core, db, i, first->file);
+        }
+        return;
+    }
+
+    int fd = fileno(fp->fp);
+    char *run = NULL; // a lone record is read straight into its own buffer
+    if (first != last) {
+        size_t run_len = last->offset + last->size - first->offset;
+        run = (char *) malloc(run_len);
+        MALLOC_CHK(run);
+        pread_full(fd, run, run_len, first->offset);
+    }
+    for (const get_loc_t *loc = first; loc <= last; loc++) {
+        // skip the record size prefix, slow5_rec_depress_parse takes ownership of mem
+        size_t bytes = loc->size - sizeof(slow5_rec_size_t);
+        char *mem = (char *) malloc(bytes);
+        MALLOC_CHK(mem);
+        if (run) {
+            memcpy(mem, run + (loc->offset - first->offset) + sizeof(slow5_rec_size_t), bytes);
+        } else {
+            pread_full(fd, mem, bytes, loc->offset + sizeof(slow5_rec_size_t));
+        }
+        if (slow5_rec_depress_parse(&mem, &bytes, db->read_id[loc->i], record_ptr, fp) != 0) {
+            ERROR("Could not decode the record '%s'.", db->read_id[loc->i]);
+            exit(EXIT_FAILURE);
+        }
+        free(mem);
+        get_rec_to_mem(core, db, loc->i, loc->file);
+    }
+    free(run);
+}
+
+static bool get_is_dir(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// positional arguments after the first one are inputs if they are directories or slow5/blow5 files, read ids otherwise
+static bool get_is_input(const char *arg) {
+    return get_is_dir(arg) || parse_path_to_fmt(arg) != SLOW5_FORMAT_UNKNOWN;
+}
+
+// open input file i and load its index, on the worker threads
+static void get_open_file(core_t *core, db_t *db, int32_t i) {
+    const char *path = db->slow5_files[i].c_str();
+    slow5_file_t *fp = slow5_open(path, "r");
+    if (!fp) {
+        ERROR("cannot open %s.", path);
+    } else if (slow5_idx_load(fp) < 0) {
+        ERROR("Error loading index file for %s", path);
+        slow5_close(fp);
+        fp = NULL;
+    }
+    db->slow5_file_pointers[i] = fp;
+}
+
+// open the input files and load their indexes in parallel, then map every read id to the file it is in
+static int get_open_files(get_files_t *files, core_t *core) {
+    files->n = files->paths.size();
+    files->fps = (slow5_file_t **) calloc(files->n, sizeof *files->fps);
+    MALLOC_CHK(files->fps);
+
+    db_t db = { 0 };
+    db.n_batch = files->n;
+    db.slow5_files = files->paths;
+    db.slow5_file_pointers = files->fps;
+    work_db(core, &db, get_open_file);
+    for (int32_t f = 0; f < files->n; f++) {
+        if (files->fps[f] == NULL) {
+            return -1;
+        }
+    }
+
+    // the keys are owned by the indexes of the files
+    files->id_to_file = kh_init(get_s2i32);
+    int64_t num_dup = 0;
+    for (int32_t f = 0; f < files->n; f++) {
+        const struct slow5_idx *idx = files->fps[f]->index;
+        for (uint64_t j = 0; j < idx->num_ids; j++) {
+            int absent;
+            khint_t k = kh_put(get_s2i32, files->id_to_file, idx->ids[j], &absent);
+            if (absent < 0) {
+                ERROR("Could not build the read id map%s", "");
+                return -1;
+            } else if (absent) {
+                kh_value(files->id_to_file, k) = f;
+            } else {
+                num_dup++;
+            }
+        }
+    }
+    if (num_dup) {
+        WARNING("%" PRId64 " read ids are in more than one file. The first file listed is used for them.", num_dup);
+    }
+    return 0;
+}
+
+static bool get_same_aux_fields(slow5_hdr_t *a, slow5_hdr_t *b) {
+    uint32_t num_a = a->aux_meta ? a->aux_meta->num : 0;
+    uint32_t num_b = b->aux_meta ? b->aux_meta->num : 0;
+    if (num_a != num_b) {
+        return false;
+    }
+    for (uint32_t r = 0; r < num_a; r++) {
+        const char *attr = a->aux_meta->attrs[r];
+        if (strcmp(attr, b->aux_meta->attrs[r]) || a->aux_meta->types[r] != b->aux_meta->types[r]) {
+            return false;
+        }
+        if (a->aux_meta->types[r] == SLOW5_ENUM || a->aux_meta->types[r] == SLOW5_ENUM_ARRAY) {
+            uint8_t n_a, n_b;
+            const char **labels_a = (const char **) slow5_get_aux_enum_labels(a, attr, &n_a);
+            const char **labels_b = (const char **) slow5_get_aux_enum_labels(b, attr, &n_b);
+            if (!labels_a || !labels_b || n_a != n_b) {
+                return false;
+            }
+            for (uint8_t l = 0; l < n_a; l++) {
+                if (strcmp(labels_a[l], labels_b[l])) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// copy the auxiliary fields of a header, enum labels included, NULL if it has none
+static struct slow5_aux_meta *get_copy_aux_meta(slow5_hdr_t *hdr, const char *path) {
+    if (hdr->aux_meta == NULL) {
+        return NULL;
+    }
+    struct slow5_aux_meta *aux_meta = slow5_aux_meta_init_empty();
+    for (uint32_t r = 0; r < hdr->aux_meta->num; r++) {
+        const char *attr = hdr->aux_meta->attrs[r];
+        enum slow5_aux_type type = hdr->aux_meta->types[r];
+        int ret;
+        if (type == SLOW5_ENUM || type == SLOW5_ENUM_ARRAY) {
+            uint8_t n;
+            const char **labels = (const char **) slow5_get_aux_enum_labels(hdr, attr, &n);
+            ret = labels ? slow5_aux_meta_add_enum(aux_meta, attr, type, labels, n) : -1;
+        } else {
+            ret = slow5_aux_meta_add(aux_meta, attr, type);
+        }
+        if (ret) {
+            ERROR("Could not initialize the record attribute '%s' from %s", attr, path);
+            slow5_aux_meta_free(aux_meta);
+            return NULL;
+        }
+    }
+    return aux_meta;
+}
+
+// build the output header of many files: the files must have the same auxiliary fields as the first one and
+// their read groups are added to it, matched on run_id like merge does. The input headers are left untouched.
+static int get_merge_headers(get_files_t *files) {
+    slow5_hdr_t *out = files->out_header = slow5_hdr_init_empty();
+    MALLOC_CHK(out);
+    if (files->fps[0]->header->aux_meta) {
+        out->aux_meta = get_copy_aux_meta(files->fps[0]->header, files->paths[0].c_str());
+        if (out->aux_meta == NULL) {
+            return -1;
+        }
+    }
+    int flag_warnings = 0;
+    files->rg_map.resize(files->n);
+    for (int32_t f = 0; f < files->n; f++) {
+        slow5_hdr_t *hdr = files->fps[f]->header;
+        const char *path = files->paths[f].c_str();
+        if (f > 0 && !get_same_aux_fields(files->fps[0]->header, hdr)) {
+            ERROR("%s does not have the same auxiliary fields as %s. Merge them with slow5tools merge first.", path, files->paths[0].c_str());
+            return -1;
+        }
+        for (uint32_t j = 0; j < hdr->num_read_groups; j++) {
+            char *run_id_j = slow5_hdr_get("run_id", j, hdr);
+            if (!run_id_j) {
+                ERROR("No run_id found in %s.", path);
+                return -1;
+            }
+            uint32_t k;
+            for (k = 0; k < out->num_read_groups; k++) {
+                char *run_id_k = slow5_hdr_get("run_id", k, out);
+                if (run_id_k && strcmp(run_id_j, run_id_k) == 0) {
+                    flag_warnings |= compare_headers(out, hdr, k, j, path, run_id_j);
+                    break;
+                }
+            }
+            if (k == out->num_read_groups) {
+                khash_t(slow5_s2s) *rg = slow5_hdr_get_data(j, hdr);
+                if (slow5_hdr_add_rg_data(out, rg) < 0) {
+                    ERROR("Could not add the read groups of %s to the output header.", path);
+                    return -1;
+                }
+            }
+            files->rg_map[f].push_back(k);
+        }
+    }
+    if (flag_warnings) {
+        WARNING("Attributes are different for the same run_id(s). Differing attributes are left empty in the output header%s", ".");
+    }
+    return 0;
+}
+
+bool fetch_record(const get_files_t *files, const char *read_id, char **argv, program_meta *meta, slow5_fmt format_out,
                   slow5_press_method_t press_method, bool benchmark, FILE *slow5_file_pointer) {
 
     bool success = true;
@@ -74,19 +584,25 @@ bool fetch_record(slow5_file_t *fp, const char *read_id, char **argv, program_me
     //fprintf(stderr, "Fetching %s\n", read_id);
     slow5_rec_t *record=NULL;
 
-    len = slow5_get(read_id, &record,fp);
+    int32_t f = get_file_of(files, read_id);
+    if (f >= 0) {
+        len = slow5_get(read_id, &record, files->fps[f]);
+    }
 
-    if (record == NULL || len < 0) {
+    if (f < 0 || record == NULL || len < 0) {
         success = false;
 
     } else {
+        if (!files->rg_map.empty()) {
+            record->read_group = files->rg_map[f][record->read_group];
+        }
         if (benchmark == false){
             struct slow5_press* compress = slow5_press_init(press_method);
             if(!compress){
                 ERROR("Could not initialize the slow5 compression method%s","");
                 exit(EXIT_FAILURE);
             }
-            slow5_rec_fwrite(slow5_file_pointer,record,fp->header->aux_meta, format_out, compress);
+            slow5_rec_fwrite(slow5_file_pointer,record,get_out_header(files)->aux_meta, format_out, compress);
             slow5_press_free(compress);
         }
         slow5_rec_free(record);
@@ -119,6 +635,7 @@ int get_main(int argc, char **argv, struct program_meta *meta) {
         {"help",        no_argument, NULL, 'h' }, //8
         {"benchmark",   no_argument, NULL, 'e' }, //9
         {"index",       required_argument, NULL, 0 }, //10
+        {"pin",         no_argument, NULL, 0 }, //11
         {NULL, 0, NULL, 0 }
     };
 
@@ -179,6 +696,9 @@ int get_main(int argc, char **argv, struct program_meta *meta) {
                     case 10:
                         slow5_index = optarg;
                         break;
+                    case 11:
+                        user_opts.flag_pin_threads = 1;
+                        break;
                 }
                 break;
 
@@ -251,11 +771,39 @@ int get_main(int argc, char **argv, struct program_meta *meta) {
 
         EXIT_MSG(EXIT_FAILURE, argv, meta);
         return EXIT_FAILURE;
+    }
 
-    } else if (optind == argc - 1) {
+    // the first argument is always an input, the following ones are too while they are directories or slow5/blow5 files
+    int num_inputs = 1;
+    while (optind + num_inputs < argc && get_is_input(argv[optind + num_inputs])) {
+        num_inputs++;
+    }
+    if (optind + num_inputs == argc) {
         read_stdin = true;
     }
 
+    get_files_t files;
+    files.fps = NULL;
+    files.n = 0;
+    files.out_header = NULL;
+    files.id_to_file = NULL;
+    if (num_inputs == 1 && !get_is_dir(argv[optind])) {
+        files.paths.push_back(argv[optind]); // open whatever is given, as before
+    } else {
+        for (int i = optind; i < optind + num_inputs; ++i) {
+            list_all_items(argv[i], files.paths, 0, ".slow5");
+        }
+        VERBOSE("%ld files found", files.paths.size());
+        if (files.paths.size() == 0) {
+            ERROR("No slow5/blow5 files found. Exiting.%s","");
+            return EXIT_FAILURE;
+        }
+    }
+    if (slow5_index && files.paths.size() > 1) {
+        ERROR("A custom index can only be given with a single input file.%s", "");
+        return EXIT_FAILURE;
+    }
+
     FILE* read_list_in = stdin;
     if(read_list_file_in){
         read_list_in = fopen(read_list_file_in, "r");
@@ -265,133 +813,94 @@ int get_main(int argc, char **argv, struct program_meta *meta) {
         }
     }
 
-    char *f_in_name = argv[optind];
-
-    slow5_file_t *slow5file = slow5_open(f_in_name, "r");
-    if (!slow5file) {
-        ERROR("cannot open %s. \n", f_in_name);
-        return EXIT_FAILURE;
-    }
-
     slow5_press_method_t press_out = {user_opts.record_press_out,user_opts.signal_press_out};
 
-    if(benchmark == false){
-        if(slow5_hdr_fwrite(user_opts.f_out, slow5file->header, user_opts.fmt_out, press_out) == -1){
-            ERROR("Could not write the output header%s\n", "");
+    // Setup multithreading structures
+    core_t core = { 0 };
+    core.num_thread = user_opts.num_threads;
+    core.format_out = user_opts.fmt_out;
+    core.press_method = press_out;
+    core.benchmark = benchmark;
+    core.param = &files;
+    core.pool = pool_init(core.num_thread, user_opts.flag_pin_threads);
+
+    if (files.paths.size() == 1) {
+        const char *f_in_name = files.paths[0].c_str();
+        slow5_file_t *slow5file = slow5_open(f_in_name, "r");
+        if (!slow5file) {
+            ERROR("cannot open %s. \n", f_in_name);
             return EXIT_FAILURE;
         }
-    }
-
-    if(slow5_index == NULL){
-        int ret_idx = slow5_idx_load(slow5file);
-        if (ret_idx < 0) {
-            ERROR("Error loading index file for %s\n", f_in_name);
-            EXIT_MSG(EXIT_FAILURE, argv, meta);
-            return EXIT_FAILURE;
+        files.n = 1;
+        files.fps = (slow5_file_t **) malloc(sizeof *files.fps);
+        MALLOC_CHK(files.fps);
+        files.fps[0] = slow5file;
+
+        if(slow5_index == NULL){
+            int ret_idx = slow5_idx_load(slow5file);
+            if (ret_idx < 0) {
+                ERROR("Error loading index file for %s\n", f_in_name);
+                EXIT_MSG(EXIT_FAILURE, argv, meta);
+                return EXIT_FAILURE;
+            }
+        } else {
+            WARNING("%s","Loading index from custom path is an experimental feature. keep an eye.");
+            int ret_idx = slow5_idx_load_with(slow5file, slow5_index);
+            if (ret_idx < 0) {
+                ERROR("Error loading index file for %s from file path %s\n", f_in_name, slow5_index);
+                EXIT_MSG(EXIT_FAILURE, argv, meta);
+                return EXIT_FAILURE;
+            }
         }
     } else {
-        WARNING("%s","Loading index from custom path is an experimental feature. keep an eye.");
-        int ret_idx = slow5_idx_load_with(slow5file, slow5_index);
-        if (ret_idx < 0) {
-            ERROR("Error loading index file for %s from file path %s\n", f_in_name, slow5_index);
+        double realtime = slow5_realtime();
+        if (get_open_files(&files, &core) < 0 || get_merge_headers(&files) < 0) {
             EXIT_MSG(EXIT_FAILURE, argv, meta);
             return EXIT_FAILURE;
         }
+        VERBOSE("Loaded the indexes of %d files - took %.3fs", files.n, slow5_realtime() - realtime);
     }
+    core.fp = files.fps[0];
+    core_press_init(&core);
+    core_rec_init(&core);
 
-    if (read_stdin) {
-        // Time spend reading slow5
-        double read_time = 0;
-
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = user_opts.num_threads;
-        core.fp = slow5file;
-        core.format_out = user_opts.fmt_out;
-        core.press_method = press_out;
-        core.benchmark = benchmark;
-
-        db_t db = { 0 };
-        int64_t cap_ids = READ_ID_INIT_CAPACITY;
-        db.read_id = (char **) malloc(cap_ids * sizeof(char*));
-        db.read_record = (raw_record_t*) malloc(cap_ids * sizeof(raw_record_t));
-        MALLOC_CHK(db.read_id);
-        MALLOC_CHK(db.read_record);
-        bool end_of_file = false;
-        while (!end_of_file) {
-            int64_t num_ids = 0;
-            while (num_ids < user_opts.read_id_batch_capacity) {
-                char *buf = NULL;
-                size_t cap_buf = 0;
-                ssize_t nread;
-                if ((nread = getline(&buf, &cap_buf, read_list_in)) == -1) {
-                    end_of_file = true;
-                    free(buf);
-                    break;
-                }
-
-                size_t len_buf = nread;
-                if (len_buf > 0 && (buf[len_buf - 1] == '\n' || buf[len_buf - 1] == '\r')){
-                    len_buf--; // Ignore '\n' or '\r' at the end of the line
-                }
-                if (len_buf > 0 && buf[len_buf - 1] == '\r'){
-                    len_buf--; // Ignore '\r' on windows
-                }
-
-                if(len_buf == 0){
-                    free(buf);
-                    continue;
-                }
-                char *curr_id = strndup(buf, len_buf);
-                curr_id[len_buf] = '\0'; // Add string terminator '\0'
-                free(buf); // Free buffer
-                if (num_ids >= cap_ids) {
-                    // Double read id list capacity
-                    cap_ids *= 2;
-                    db.read_id = (char **) realloc(db.read_id, cap_ids * sizeof *db.read_id);
-                    db.read_record = (raw_record_t*) realloc(db.read_record, cap_ids * sizeof *db.read_record);
-                }
-                db.read_id[num_ids] = curr_id;
-                ++ num_ids;
-            }
-
-            db.n_batch = num_ids;
-
-            // Measure reading time
-            double start = slow5_realtime();
-
-            // Fetch records for read ids in the batch
-            work_db(&core, &db, work_per_single_read_get);
-
-            double end = slow5_realtime();
-            read_time += end - start;
+    if(benchmark == false){
+        if(slow5_hdr_fwrite(user_opts.f_out, get_out_header(&files), user_opts.fmt_out, press_out) == -1){
+            ERROR("Could not write the output header%s\n", "");
+            return EXIT_FAILURE;
+        }
+    }
 
-            VERBOSE("Fetched %ld reads of %ld", num_ids - db.n_err, num_ids);
+    if (read_stdin) {
+        // parse the next batch of read ids and plan its reads while the current batch is fetched and the previous one is written
+        get_arg_t ga = { 0 };
+        ga.list = read_list_in;
+        ga.files = &files;
+        ga.batch_size = user_opts.read_id_batch_capacity;
+        ga.skip_flag = skip_flag;
+        ga.benchmark = benchmark;
+        ga.out = user_opts.f_out;
+
+        pipeline_t pl = { 0 };
+        pl.read_db = get_read_batch;
+        pl.func = work_per_run_get;
+        pl.write_db = get_write_batch;
+        pl.free_db = get_batch_free;
+        pl.arg = &ga;
+        pl.depth = PIPELINE_DEPTH;
+        int ret = pipeline_db(&core, &pl);
 
-            // Print records
-            if(benchmark == false){
-                for (int64_t i = 0; i < num_ids; ++ i) {
-                    void *buffer = db.read_record[i].buffer;
-                    int len = db.read_record[i].len;
-                    if (buffer == NULL || len < 0) {
-                        if(skip_flag) continue;
-                        ERROR("Could not write the fetched read.%s","");
-                        return EXIT_FAILURE;
-                    } else {
-                        fwrite(buffer,1,len,user_opts.f_out);
-                        free(buffer);
-                    }
-                }
-            }
-        }
         // Print total time to read slow5
-        VERBOSE("read time = %.3f sec", read_time);
-        // Free everything
-        free(db.read_id);
-        free(db.read_record);
+        VERBOSE("read time = %.3f sec", pl.time_work);
+        DEBUG("time_parse_ids\t%.3fs", pl.time_read);
+        DEBUG("time_write\t%.3fs", pl.time_write);
+        free(ga.carry);
+        if (ret != 0 || ga.ret != 0) {
+            return EXIT_FAILURE;
+        }
     } else {
-        for (int i = optind + 1; i < argc; ++ i){
-            bool success = fetch_record(slow5file, argv[i], argv, meta, user_opts.fmt_out, press_out, benchmark, user_opts.f_out);
+        for (int i = optind + num_inputs; i < argc; ++ i){
+            bool success = fetch_record(&files, argv[i], argv, meta, user_opts.fmt_out, press_out, benchmark, user_opts.f_out);
             if (!success) {
                 if(skip_flag) continue;
                 ERROR("Could not fetch records.%s","");
@@ -406,7 +915,20 @@ int get_main(int argc, char **argv, struct program_meta *meta) {
             }
     }
 
-    slow5_close(slow5file);
+    // Free everything
+    core_rec_free(&core);
+    core_press_free(&core);
+    pool_free(core.pool);
+    if (files.id_to_file) {
+        kh_destroy(get_s2i32, files.id_to_file);
+    }
+    for (int32_t f = 0; f < files.n; f++) {
+        slow5_close(files.fps[f]);
+    }
+    free(files.fps);
+    if (files.out_header) {
+        slow5_hdr_free(files.out_header);
+    }
     fclose(read_list_in);
 
     EXIT_MSG(EXIT_SUCCESS, argv, meta);
@@ -11,6 +11,8 @@
 #include "error.h"
 #include "cmd.h"
 #include "misc.h"
+#include "thread.h"
+#include "slow5_idx.h"
 
 #define USAGE_MSG "Usage: %s  [SLOW5|BLOW5_FILE]\n"
 #define HELP_LARGE_MSG \
@@ -18,11 +20,153 @@
     "Create a slow5 or blow5 index file.\n" \
     "\n" \
     "OPTIONS:\n" \
+    "    -t, --threads INT\n" \
+    "        Number of threads to decode BLOW5 records with [" TO_STR(DEFAULT_NUM_THREADS) "].\n" \
+    "    -K, --batchsize INT\n" \
+    "        Number of records loaded to the memory at once [" TO_STR(DEFAULT_BATCH_SIZE) "].\n" \
     "    -h, --help\n" \
     "        Display this message and exit.\n" \
 
 extern int slow5tools_verbosity_level;
 
+typedef struct {
+    slow5_file_t *sp;
+    struct slow5_idx *index;
+    uint64_t offset;        // offset of the next record to be inserted into the index
+    int64_t batch_size;
+    int flag_end_of_file;
+    int ret;
+} index_arg_t;
+
+// reader stage: the next batch of raw (still compressed) BLOW5 records in file order
+static db_t *index_read_batch(core_t *core, db_t *db, void *arg) {
+    index_arg_t *ia = (index_arg_t *) arg;
+    if (ia->flag_end_of_file) {
+        return NULL;
+    }
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = db_batch_init(ia->batch_size);
+    }
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while (record_count < ia->batch_size) {
+        if (!(mem = (char *) slow5_get_next_mem(&bytes, ia->sp))) {
+            if (slow5_errno != SLOW5_ERR_EOF) {
+                ERROR("Reading the records failed.%s", "");
+                ia->ret = EXIT_FAILURE;
+            }
+            ia->flag_end_of_file = 1;
+            break;
+        }
+        db->mem_records[record_count] = mem;
+        db->mem_bytes[record_count] = bytes;
+        record_count++;
+    }
+    if (record_count == 0 || ia->ret != 0) {
+        for (int64_t i = 0; i < record_count; i++) {
+            free(db->mem_records[i]);
+        }
+        if (new_db) {
+            db_batch_free(new_db);
+        }
+        return NULL;
+    }
+    db->n_batch = record_count;
+    return db;
+}
+
+// the expensive part of indexing: decompress and parse a record to get its read id
+static void index_parse_rec(core_t *core, db_t *db, int32_t i) {
+    struct slow5_rec **read = core_rec(core); // reused by this thread for every record
+    size_t bytes = db->mem_bytes[i]; // mem_bytes[i] is kept for the offset of the next record
+    if (slow5_rec_depress_parse(&db->mem_records[i], &bytes, NULL, read, core->fp) != 0) {
+        ERROR("Could not decode record %d of the batch.", i);
+        exit(EXIT_FAILURE);
+    }
+    free(db->mem_records[i]);
+    db->read_record[i].buffer = strdup((*read)->read_id);
+    MALLOC_CHK(db->read_record[i].buffer);
+}
+
+// writer stage: insert the read ids in file order so that the index is the same as a sequential build
+static int index_insert_batch(core_t *core, db_t *db, void *arg) {
+    index_arg_t *ia = (index_arg_t *) arg;
+    int ret = 0;
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        uint64_t size = sizeof(slow5_rec_size_t) + db->mem_bytes[i];
+        char *read_id = (char *) db->read_record[i].buffer;
+        if (ret == 0 && slow5_idx_insert(ia->index, read_id, ia->offset, size) != 0) {
+            ERROR("Could not add read id '%s' to the index. Is it a duplicate?", read_id);
+            ret = -1;
+        }
+        if (ret != 0) {
+            free(read_id);
+        }
+        ia->offset += size;
+    }
+    db->n_batch = 0;
+    return ret;
+}
+
+// slow5_idx_create with the record decoding spread over num_threads threads (BLOW5 only)
+static int index_create_parallel(slow5_file_t *sp, const char *pathname, int32_t num_threads, int64_t batch_size) {
+    off_t start = ftello(sp->fp);
+    if (start < 0) {
+        ERROR("Could not get the position of the first record - %s.", strerror(errno));
+        return -1;
+    }
+
+    struct slow5_idx *index = (struct slow5_idx *) calloc(1, sizeof *index);
+    MALLOC_CHK(index);
+    index->hash = kh_init(slow5_s2i);
+    index->pathname = slow5_get_idx_path(pathname);
+    if (index->pathname == NULL || (index->fp = fopen(index->pathname, "wb")) == NULL) {
+        ERROR("Index file '%s' could not be opened - %s.", index->pathname ? index->pathname : pathname, strerror(errno));
+        slow5_idx_free(index);
+        return -1;
+    }
+
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = sp;
+    core.pool = pool_init(core.num_thread, 0);
+    core_rec_init(&core);
+
+    index_arg_t ia;
+    ia.sp = sp;
+    ia.index = index;
+    ia.offset = start;
+    ia.batch_size = batch_size;
+    ia.flag_end_of_file = 0;
+    ia.ret = 0;
+
+    pipeline_t pl = { 0 };
+    pl.read_db = index_read_batch;
+    pl.func = index_parse_rec;
+    pl.write_db = index_insert_batch;
+    pl.arg = &ia;
+    pl.depth = PIPELINE_DEPTH;
+    int ret = pipeline_db(&core, &pl);
+    core_rec_free(&core);
+    pool_free(core.pool);
+
+    DEBUG("time_read\t%.3fs", pl.time_read);
+    DEBUG("time_parse\t%.3fs", pl.time_work);
+    DEBUG("time_insert\t%.3fs", pl.time_write);
+
+    if (ret == 0 && ia.ret == 0 && slow5_idx_write(index, sp->header->version) != 0) {
+        ERROR("Writing the index file '%s' failed.", index->pathname);
+        ret = -1;
+    }
+    if (ret != 0 || ia.ret != 0) {
+        remove(index->pathname); // do not leave a partial index behind
+    }
+    slow5_idx_free(index);
+    return ret != 0 || ia.ret != 0 ? -1 : 0;
+}
+
 int index_main(int argc, char **argv, struct program_meta *meta) {
 
     // Debug: print arguments
@@ -37,12 +181,17 @@ int index_main(int argc, char **argv, struct program_meta *meta) {
 
     static struct option long_opts[] = {
         {"help", no_argument, NULL, 'h' },
+        {"threads", required_argument, NULL, 't' },
+        {"batchsize", required_argument, NULL, 'K' },
         {NULL, 0, NULL, 0 }
     };
 
+    opt_t user_opts;
+    init_opt(&user_opts);
+
     int opt;
     // Parse options
-    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "ht:K:", long_opts, NULL)) != -1) {
 
         DEBUG("opt='%c', optarg=\"%s\", optind=%d, opterr=%d, optopt='%c'",
                   opt, optarg, optind, opterr, optopt);
@@ -54,6 +203,12 @@ int index_main(int argc, char **argv, struct program_meta *meta) {
 
                 EXIT_MSG(EXIT_SUCCESS, argv, meta);
                 exit(EXIT_SUCCESS);
+            case 't':
+                user_opts.arg_num_threads = optarg;
+                break;
+            case 'K':
+                user_opts.arg_batch = optarg;
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -61,6 +216,15 @@ int index_main(int argc, char **argv, struct program_meta *meta) {
         }
     }
 
+    if(parse_num_threads(&user_opts,argc,argv,meta) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
+    if(parse_batch_size(&user_opts,argc,argv) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
+
     // Check for remaining files to parse
     if (optind >= argc) {
         ERROR("missing slow5 or blow5 file%s", "");
@@ -82,7 +246,13 @@ int index_main(int argc, char **argv, struct program_meta *meta) {
     slow5_file_t *file=slow5_open(f_in_name,"r");
     F_CHK(file,f_in_name);
 
-    if (slow5_idx_create(file) != 0) {
+    if (file->format == SLOW5_FORMAT_BINARY && user_opts.num_threads > 1) {
+        if (index_create_parallel(file, f_in_name, user_opts.num_threads, user_opts.read_id_batch_capacity) != 0) {
+            ERROR("Indexing %s failed.", f_in_name);
+            EXIT_MSG(EXIT_FAILURE, argv, meta);
+            return EXIT_FAILURE;
+        }
+    } else if (slow5_idx_create(file) != 0) {
         fprintf(stderr, "Error running slow5idx_build on %s\n",
                 f_in_name);
         EXIT_MSG(EXIT_FAILURE, argv, meta);
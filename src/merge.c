@@ -14,12 +14,17 @@
 #include "error.h"
 #include "cmd.h"
 #include <slow5/slow5.h>
+#include <slow5/slow5_press.h>
 #include <map>
 #include "read_fast5.h"
 #include "slow5_extra.h"
 #include "misc.h"
 #include "thread.h"
 
+#define MERGE_DEFAULT_READERS 4 //reader threads, each reading a different input file
+#define MERGE_CHUNK_RECORDS 256 //records a reader hands over at once
+#define MERGE_HEADER_WINDOW 256 //input files whose headers are opened at once before merging
+
 #define USAGE_MSG "Usage: %s [OPTIONS] [SLOW5_FILE/DIR] ...\n"
 #define HELP_LARGE_MSG \
     "Merge multiple SLOW5/BLOW5 files to a single file\n" \
@@ -31,6 +36,10 @@
     HELP_MSG_PRESS \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
+    HELP_MSG_MMAP \
+    "        --readers INT             number of input files read at once [" TO_STR(MERGE_DEFAULT_READERS) "]\n" \
+    "        --unordered               write the records in the order they are read instead of the input file order\n" \
     HELP_MSG_LOSSLESS  \
     HELP_MSG_CONTINUE_MERGE \
     HELP_MSG_HELP \
@@ -40,35 +49,473 @@ extern int slow5tools_verbosity_level;
 
 int compare_headers(slow5_hdr_t *output_header, slow5_hdr_t *input_header, int64_t output_g, int64_t input_g, const char *i_file_path, char *j_run_id);
 
+// how the records of an input file can be written to the output
+enum merge_pass {
+    MERGE_REENCODE,     // decode and encode every record
+    MERGE_PATCH,        // same encoding, only the read_group or the order of the auxiliary fields has to change (record compression redone, signal untouched)
+    MERGE_COPY          // same encoding and read groups, records are copied as they are
+};
+
+// per run state of parallel_reads_model
+typedef struct {
+    std::vector<blow5_mmap_t *> *maps;     // per input file, NULL unless --mmap
+    std::vector<int8_t> *pass;             // per input file, enum merge_pass
+    std::vector<std::vector<uint32_t>> *aux_order;   // per input file, the input field of each output auxiliary field (empty if the same order)
+} merge_core_t;
+
+// consecutive records of one input file read by a reader thread
+typedef struct {
+    char *mem_records[MERGE_CHUNK_RECORDS];
+    size_t mem_bytes[MERGE_CHUNK_RECORDS];
+    int32_t n;
+    int32_t consumed;       // records already moved to a batch
+    int32_t file_index;
+    int last;               // the last chunk of the file (may be empty)
+} merge_chunk_t;
+
+/* input files are claimed one at a time by the reader threads and read concurrently
+ * ordered: every file has its own queue and the batches take the files in input order, so the output is the same as reading the files one by one
+ * unordered: all readers share one queue and the records are written in the order they are read */
+typedef struct {
+    const std::vector<std::string> *files;
+    std::vector<blow5_mmap_t *> *maps;     // per input file, NULL unless --mmap
+    slow5_file_t **sps;                     // per input file, set by the reader thread that claimed it
+    int flag_mmap;
+    int ordered;
+    queue_t *file_q;                        // ordered: one queue per input file
+    queue_t shared_q;                       // unordered
+    volatile int32_t next_file;             // next input file to be claimed
+    volatile int32_t readers_left;
+    int32_t cur_file;                       // ordered: input file the batches are taking records from
+    merge_chunk_t *cur;                     // chunk partly moved to a batch
+    int64_t batch_size;
+    std::vector<std::vector<size_t>> *list;
+    std::vector<int32_t> finished_at_end;   // files that ran out after the last batch
+    const char *fname_out;
+    std::vector<int8_t> *pass;              // per input file, set by the reader thread that claimed it
+    std::vector<std::vector<uint32_t>> *aux_order;  // per input file, set by the reader thread that claimed it
+    slow5_hdr_t *out_header;
+    enum slow5_fmt format_out;
+    slow5_press_method_t press_out;
+    int lossy;
+} merge_reader_t;
+
+// per batch state: the input files whose last record is in this batch, closed once the batch is written
+typedef struct {
+    std::vector<int32_t> finished;
+} merge_batch_t;
+
+// the records of in can be written to the output without decoding them if they are encoded the same way
+// the auxiliary fields are matched by name, aux_order is set if they are in a different order than in the output
+static enum merge_pass merge_file_pass(slow5_file_t *in, slow5_hdr_t *out_header, enum slow5_fmt format_out, slow5_press_method_t press_out, int lossy, const std::vector<size_t> &list, std::vector<uint32_t> &aux_order) {
+    aux_order.clear();
+    if (in->format != SLOW5_FORMAT_BINARY || format_out != SLOW5_FORMAT_BINARY ||
+        in->compress->record_press->method != press_out.record_method || in->compress->signal_press->method != press_out.signal_method) {
+        return MERGE_REENCODE;
+    }
+    // the auxiliary fields of a record are stored in the order of the header, without their names
+    slow5_aux_meta_t *in_aux = in->header->aux_meta;
+    slow5_aux_meta_t *out_aux = lossy ? NULL : out_header->aux_meta;
+    if ((in_aux == NULL) != (out_aux == NULL)) {
+        return MERGE_REENCODE;
+    }
+    int reordered = 0;
+    if (in_aux) {
+        if (in_aux->num != out_aux->num) {
+            return MERGE_REENCODE;
+        }
+        for (uint32_t r = 0; r < out_aux->num; r++) {
+            uint32_t j = 0;
+            while (j < in_aux->num && strcmp(in_aux->attrs[j], out_aux->attrs[r]) != 0) {
+                j++;
+            }
+            if (j == in_aux->num || in_aux->types[j] != out_aux->types[r]) {
+                return MERGE_REENCODE;
+            }
+            if (in_aux->types[j] == SLOW5_ENUM || in_aux->types[j] == SLOW5_ENUM_ARRAY) {
+                if (in_aux->enum_num_labels[j] != out_aux->enum_num_labels[r]) {
+                    return MERGE_REENCODE;
+                }
+                for (uint8_t l = 0; l < in_aux->enum_num_labels[j]; l++) {
+                    if (strcmp(in_aux->enum_labels[j][l], out_aux->enum_labels[r][l]) != 0) {
+                        return MERGE_REENCODE;
+                    }
+                }
+            }
+            aux_order.push_back(j);
+            reordered |= j != r;
+        }
+    }
+    if (reordered) {
+        return MERGE_PATCH;
+    }
+    aux_order.clear();
+    for (size_t g = 0; g < list.size(); g++) {
+        if (list[g] != g) {
+            return MERGE_PATCH;
+        }
+    }
+    return MERGE_COPY;
+}
+
+// bytes of a value of a primitive auxiliary type, or of an element of an array type
+static size_t merge_aux_value_size(enum slow5_aux_type type) {
+    if (type >= SLOW5_INT8_T_ARRAY) { // the array types are in the same order as the primitive ones
+        type = (enum slow5_aux_type) (type - SLOW5_INT8_T_ARRAY);
+    }
+    switch (type) {
+        case SLOW5_INT8_T: case SLOW5_UINT8_T: case SLOW5_CHAR: case SLOW5_ENUM:
+            return 1;
+        case SLOW5_INT16_T: case SLOW5_UINT16_T:
+            return 2;
+        case SLOW5_INT32_T: case SLOW5_UINT32_T: case SLOW5_FLOAT:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+/* put the auxiliary fields of a decompressed record in the output order, rec is read_id_len, read_id, read_group,
+ * 4 doubles, len_raw_signal (the compressed size in bytes if the signal is compressed) and the signal, then the auxiliary fields
+ * (arrays prefixed by their uint64_t length). Returns a new record of the same size or NULL if the record is malformed */
+static char *merge_reorder_aux(const char *rec, size_t len, slow5_aux_meta_t *in_aux, const std::vector<uint32_t> &aux_order, int signal_compressed) {
+    uint16_t read_id_len;
+    uint64_t len_raw_signal;
+    size_t off = sizeof read_id_len;
+    if (len < off) {
+        return NULL;
+    }
+    memcpy(&read_id_len, rec, sizeof read_id_len);
+    off += read_id_len + sizeof(uint32_t) + 4 * sizeof(double);
+    if (len < off + sizeof len_raw_signal) {
+        return NULL;
+    }
+    memcpy(&len_raw_signal, rec + off, sizeof len_raw_signal);
+    off += sizeof len_raw_signal;
+    uint64_t signal_bytes = signal_compressed ? len_raw_signal : len_raw_signal * sizeof(int16_t);
+    if (len - off < signal_bytes) {
+        return NULL;
+    }
+    off += signal_bytes;
+    size_t aux_start = off;
+
+    std::vector<size_t> start(in_aux->num), bytes(in_aux->num);
+    for (uint32_t j = 0; j < in_aux->num; j++) {
+        start[j] = off;
+        size_t size = merge_aux_value_size(in_aux->types[j]);
+        if (in_aux->types[j] >= SLOW5_INT8_T_ARRAY) {
+            uint64_t n;
+            if (len - off < sizeof n) {
+                return NULL;
+            }
+            memcpy(&n, rec + off, sizeof n);
+            if ((len - off - sizeof n) / size < n) {
+                return NULL;
+            }
+            size = sizeof n + n * size;
+        }
+        if (len - off < size) {
+            return NULL;
+        }
+        bytes[j] = size;
+        off += size;
+    }
+    if (off != len) {
+        return NULL;
+    }
+
+    char *out = (char *) malloc(len);
+    MALLOC_CHK(out);
+    memcpy(out, rec, aux_start);
+    off = aux_start;
+    for (size_t r = 0; r < aux_order.size(); r++) {
+        memcpy(out + off, rec + start[aux_order[r]], bytes[aux_order[r]]);
+        off += bytes[aux_order[r]];
+    }
+    return out;
+}
+
+// a record of a MERGE_PATCH or MERGE_COPY input file prefixed by its size, the read_group and the sizes of the auxiliary fields are the only fields that are decoded
+static void merge_pass_rec(core_t *core, db_t *db, int32_t i, int pass) {
+    slow5_file_t *from = db->slow5_file_pointers[i];
+    merge_core_t *mc = (merge_core_t *) core->param;
+    const char *mem = db->mem_records[i];
+    size_t bytes = db->mem_bytes[i];
+    char *rec = NULL; // decompressed record if the records are compressed
+    size_t len = 0;
+
+    if (pass == MERGE_PATCH) {
+        char *patch;
+        if (from->compress->record_press->method == SLOW5_COMPRESS_NONE) {
+            patch = (char *) mem;
+            len = bytes;
+        } else {
+            rec = (char *) slow5_ptr_depress(core_press(core)->record_press, mem, bytes, &len); // the press of from is shared by the threads
+            if (rec == NULL) {
+                ERROR("Could not decompress record %d of the batch.", i);
+                exit(EXIT_FAILURE);
+            }
+            patch = rec;
+        }
+        // read_id_len, read_id, read_group, ...
+        uint16_t read_id_len;
+        uint32_t read_group;
+        if (len < sizeof read_id_len) {
+            ERROR("Record %d of the batch is truncated or malformed.", i);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&read_id_len, patch, sizeof read_id_len);
+        if (len < sizeof read_id_len + read_id_len + sizeof read_group) {
+            ERROR("Record %d of the batch is truncated or malformed.", i);
+            exit(EXIT_FAILURE);
+        }
+        size_t off = sizeof read_id_len + read_id_len;
+        memcpy(&read_group, patch + off, sizeof read_group);
+        read_group = db->list[db->slow5_file_indices[i]][read_group];
+        if (rec == NULL) {
+            rec = (char *) malloc(len);
+            MALLOC_CHK(rec);
+            memcpy(rec, mem, len);
+        }
+        memcpy(rec + off, &read_group, sizeof read_group);
+        const std::vector<uint32_t> &aux_order = (*mc->aux_order)[db->slow5_file_indices[i]];
+        if (!aux_order.empty()) {
+            char *reordered = merge_reorder_aux(rec, len, from->header->aux_meta, aux_order, from->compress->signal_press->method != SLOW5_COMPRESS_NONE);
+            if (reordered == NULL) {
+                ERROR("Record %d of the batch is truncated or malformed.", i);
+                exit(EXIT_FAILURE);
+            }
+            free(rec);
+            rec = reordered;
+        }
+        if (from->compress->record_press->method != SLOW5_COMPRESS_NONE) {
+            char *pressed = (char *) slow5_ptr_compress(core_press(core)->record_press, rec, len, &len);
+            if (pressed == NULL) {
+                ERROR("Could not compress record %d of the batch.", i);
+                exit(EXIT_FAILURE);
+            }
+            free(rec);
+            rec = pressed;
+        }
+        mem = rec;
+        bytes = len;
+    }
+
+    slow5_rec_size_t size = bytes;
+    char *buffer = (char *) malloc(sizeof size + bytes);
+    MALLOC_CHK(buffer);
+    memcpy(buffer, &size, sizeof size);
+    memcpy(buffer + sizeof size, mem, bytes);
+    free(rec);
+    db->read_record[i].buffer = buffer;
+    db->read_record[i].len = sizeof size + bytes;
+}
+
 void parallel_reads_model(core_t *core, db_t *db, int32_t i) {
     //
     struct slow5_rec *read = NULL;
+    merge_core_t *mc = (merge_core_t *) core->param;
+    int32_t file_index = db->slow5_file_indices[i];
+    int mapped = (*mc->maps)[file_index] != NULL; //--mmap
+    int pass = (*mc->pass)[file_index];
+    if (pass != MERGE_REENCODE) {
+        merge_pass_rec(core, db, i, pass);
+        if (!mapped) {
+            free(db->mem_records[i]);
+        }
+        return;
+    }
+    if (mapped) {
+        db_mem_record_own(db, i);
+    }
     if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, &read, db->slow5_file_pointers[i]) != 0) {
         exit(EXIT_FAILURE);
     } else {
         free(db->mem_records[i]);
     }
-    read->read_group = db->list[db->slow5_file_indices[i]][read->read_group]; //write records of the ith slow5file with the updated read_group value
-    struct slow5_press *press_ptr = slow5_press_init(core->press_method);
-    if(!press_ptr){
-        ERROR("Could not initialize the slow5 compression method%s","");
-        exit(EXIT_FAILURE);
-    }
+    read->read_group = db->list[file_index][read->read_group]; //write records of the ith slow5file with the updated read_group value
+    struct slow5_press *press_ptr = core_press(core);
     size_t len;
     slow5_aux_meta_t *aux_meta = core->aux_meta;
     if(core->lossy){
         aux_meta = NULL;
     }
     if ((db->read_record[i].buffer = slow5_rec_to_mem(read, aux_meta, core->format_out, press_ptr, &len)) == NULL) {
-        slow5_press_free(press_ptr);
         slow5_rec_free(read);
         exit(EXIT_FAILURE);
     }
-    slow5_press_free(press_ptr);
     db->read_record[i].len = len;
     slow5_rec_free(read);
 }
 
+// open the ith file of the window so that its header is parsed, NULL if it cannot be opened
+static void merge_open_header(core_t *core, db_t *db, int32_t i) {
+    db->slow5_file_pointers[i] = slow5_open(db->slow5_files[i].c_str(), "r");
+}
+
+static void *merge_reader_thread(void *arg) {
+    merge_reader_t *mr = (merge_reader_t *) arg;
+    int32_t n_files = mr->files->size();
+    int32_t i;
+    while ((i = __sync_fetch_and_add(&mr->next_file, 1)) < n_files) {
+        const char *path = (*mr->files)[i].c_str();
+        slow5_file_t *from = slow5_open(path, "r");
+        if (from == NULL) {
+            ERROR("File '%s' could not be opened - %s.", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        mr->sps[i] = from;
+        (*mr->pass)[i] = merge_file_pass(from, mr->out_header, mr->format_out, mr->press_out, mr->lossy, (*mr->list)[i], (*mr->aux_order)[i]);
+        blow5_mmap_t *map = mr->flag_mmap ? blow5_mmap_init(from) : NULL;
+        (*mr->maps)[i] = map;
+        queue_t *q = mr->ordered ? &mr->file_q[i] : &mr->shared_q;
+
+        int last = 0;
+        while (!last) {
+            merge_chunk_t *chunk = (merge_chunk_t *) malloc(sizeof *chunk);
+            MALLOC_CHK(chunk);
+            chunk->n = chunk->consumed = 0;
+            chunk->file_index = i;
+            chunk->last = 0;
+            size_t bytes;
+            char *mem;
+            while (chunk->n < MERGE_CHUNK_RECORDS) {
+                mem = map ? blow5_mmap_next(map, &bytes) : (char *) slow5_get_next_mem(&bytes, from);
+                if (!mem) {
+                    if (slow5_errno != SLOW5_ERR_EOF) {
+                        ERROR("Could not read the records of '%s'.", path);
+                        exit(EXIT_FAILURE);
+                    }
+                    chunk->last = last = 1;
+                    break;
+                }
+                chunk->mem_records[chunk->n] = mem;
+                chunk->mem_bytes[chunk->n] = bytes;
+                chunk->n++;
+            }
+            queue_push(q, chunk);
+        }
+    }
+    if (__sync_sub_and_fetch(&mr->readers_left, 1) == 0 && !mr->ordered) {
+        queue_close(&mr->shared_q);
+    }
+    pthread_exit(0);
+}
+
+static merge_chunk_t *merge_next_chunk(merge_reader_t *mr) {
+    if (!mr->ordered) {
+        return (merge_chunk_t *) queue_pop(&mr->shared_q);
+    }
+    if (mr->cur_file == (int32_t) mr->files->size()) {
+        return NULL;
+    }
+    merge_chunk_t *chunk = (merge_chunk_t *) queue_pop(&mr->file_q[mr->cur_file]);
+    if (chunk->last) {
+        mr->cur_file++;
+    }
+    return chunk;
+}
+
+static db_t *merge_batch_init(merge_reader_t *mr) {
+    db_t *db = new db_t();
+    db->capacity = mr->batch_size;
+    db->mem_records = (char **) malloc(mr->batch_size * sizeof(char*));
+    db->mem_bytes = (size_t *) malloc(mr->batch_size * sizeof(size_t));
+    db->slow5_file_pointers = (slow5_file_t **) malloc(mr->batch_size * sizeof(slow5_file_t*));
+    db->read_record = (raw_record_t*) malloc(mr->batch_size * sizeof *db->read_record);
+    MALLOC_CHK(db->mem_records);
+    MALLOC_CHK(db->mem_bytes);
+    MALLOC_CHK(db->slow5_file_pointers);
+    MALLOC_CHK(db->read_record);
+    db->list = *mr->list;
+    db->slow5_file_indices.resize(mr->batch_size);
+    db->param = new merge_batch_t();
+    return db;
+}
+
+static void merge_batch_free(db_t *db) {
+    free(db->mem_bytes);
+    free(db->mem_records);
+    free(db->read_record);
+    free(db->slow5_file_pointers);
+    delete (merge_batch_t *) db->param;
+    delete db;
+}
+
+// reader stage of the pipeline: moves the records from the readers' chunks to a batch
+static db_t *merge_read_batch(core_t *core, db_t *db, void *arg) {
+    merge_reader_t *mr = (merge_reader_t *) arg;
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = merge_batch_init(mr);
+    }
+    merge_batch_t *mb = (merge_batch_t *) db->param;
+    mb->finished.clear();
+    int64_t record_count = 0;
+    while (record_count < mr->batch_size) {
+        if (mr->cur == NULL && (mr->cur = merge_next_chunk(mr)) == NULL) {
+            break;
+        }
+        merge_chunk_t *chunk = mr->cur;
+        while (chunk->consumed < chunk->n && record_count < mr->batch_size) {
+            db->mem_records[record_count] = chunk->mem_records[chunk->consumed];
+            db->mem_bytes[record_count] = chunk->mem_bytes[chunk->consumed];
+            db->slow5_file_pointers[record_count] = mr->sps[chunk->file_index];
+            db->slow5_file_indices[record_count] = chunk->file_index;
+            chunk->consumed++;
+            record_count++;
+        }
+        if (chunk->consumed == chunk->n) {
+            if (chunk->last) {
+                mb->finished.push_back(chunk->file_index);
+            }
+            free(chunk);
+            mr->cur = NULL;
+        }
+    }
+    if (record_count == 0) {
+        //nothing left, the files that ended without records in this batch are closed at the end
+        mr->finished_at_end.insert(mr->finished_at_end.end(), mb->finished.begin(), mb->finished.end());
+        if (new_db) {
+            merge_batch_free(new_db);
+        }
+        return NULL;
+    }
+    db->n_batch = record_count;
+    return db;
+}
+
+static int merge_close_file(merge_reader_t *mr, int32_t j) {
+    blow5_mmap_free((*mr->maps)[j]);
+    (*mr->maps)[j] = NULL;
+    if (slow5_close(mr->sps[j]) == EOF) { //close file
+        ERROR("File '%s' failed on closing - %s.", (*mr->files)[j].c_str(), strerror(errno));
+        return -1;
+    }
+    mr->sps[j] = NULL;
+    return 0;
+}
+
+static int merge_write_batch(core_t *core, db_t *db, void *arg) {
+    merge_reader_t *mr = (merge_reader_t *) arg;
+    if (raw_records_fwrite(core->fp->fp, db->read_record, db->n_batch) != 0) {
+        ERROR("Writing the merged records to '%s' failed - %s.", mr->fname_out ? mr->fname_out : "stdout", strerror(errno));
+        return -1;
+    }
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        free(db->read_record[i].buffer);
+    }
+    db->n_batch = 0;
+    //the records of these files are all written
+    merge_batch_t *mb = (merge_batch_t *) db->param;
+    for (int32_t j : mb->finished) {
+        if (merge_close_file(mr, j) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int merge_main(int argc, char **argv, struct program_meta *meta){
 
     // Debug: print arguments
@@ -91,11 +538,17 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
             {"allow", no_argument, NULL, 'a'},               //6
             {"output", required_argument, NULL, 'o'},        //7
             {"batchsize", required_argument, NULL, 'K'},     //8
+            {"pin", no_argument, NULL, 0},                   //9
+            {"mmap", no_argument, NULL, 0},                  //10
+            {"readers", required_argument, NULL, 0},         //11
+            {"unordered", no_argument, NULL, 0},             //12
             {NULL, 0, NULL, 0 }
     };
 
     opt_t user_opts;
     init_opt(&user_opts);
+    int32_t num_readers = MERGE_DEFAULT_READERS;
+    int flag_unordered = 0;
 
     int opt;
     int longindex = 0;
@@ -137,6 +590,23 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
                     case 5:
                         user_opts.arg_lossless = optarg;
                         break;
+                    case 9:
+                        user_opts.flag_pin_threads = 1;
+                        break;
+                    case 10:
+                        user_opts.flag_mmap = 1;
+                        break;
+                    case 11:
+                        num_readers = atoi(optarg);
+                        if (num_readers < 1) {
+                            ERROR("Number of reader threads should be larger than 0. You entered %s", optarg);
+                            EXIT_MSG(EXIT_FAILURE, argv, meta);
+                            return EXIT_FAILURE;
+                        }
+                        break;
+                    case 12:
+                        flag_unordered = 1;
+                        break;
                 }
                 break;
             default: // case '?'
@@ -194,6 +664,7 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
     //determine new read group numbers
     //measure read_group number allocation time
     realtime0 = slow5_realtime();
+    double time_open_headers = 0;
 
     // Parse output argument
     if (user_opts.arg_fname_out != NULL) {
@@ -230,10 +701,25 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
 
     int flag_warnings_occured = 0;
 
+    // the headers are opened and parsed in parallel a window of files at a time, then merged into the output header in the input order
+    core_t hdr_core = { 0 };
+    hdr_core.num_thread = user_opts.num_threads;
+    db_t hdr_db = { 0 };
+    hdr_db.slow5_file_pointers = (slow5_file_t **) malloc(MERGE_HEADER_WINDOW * sizeof(slow5_file_t*));
+    MALLOC_CHK(hdr_db.slow5_file_pointers);
+
     for(size_t i=0; i<num_files; i++) { //iterate over slow5files
+        if(i % MERGE_HEADER_WINDOW == 0){
+            double realtime = slow5_realtime();
+            size_t end = i + MERGE_HEADER_WINDOW < num_files ? i + MERGE_HEADER_WINDOW : num_files;
+            hdr_db.slow5_files.assign(files.begin() + i, files.begin() + end);
+            hdr_db.n_batch = end - i;
+            work_db(&hdr_core, &hdr_db, merge_open_header);
+            time_open_headers += slow5_realtime() - realtime;
+        }
         DEBUG("input file\t%s", files[i].c_str());
 
-        slow5_file_t* slow5File_i = slow5_open(files[i].c_str(), "r");
+        slow5_file_t* slow5File_i = hdr_db.slow5_file_pointers[i % MERGE_HEADER_WINDOW];
         if(!slow5File_i){
             ERROR("[Skip file]: cannot open %s. skipping.\n",files[i].c_str());
             continue;
@@ -335,6 +821,7 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
         slow5_files.push_back(files[i]);
 
     }
+    free(hdr_db.slow5_file_pointers);
 
     if(flag_warnings_occured == 1 && user_opts.flag_continue_merge == DEFAULT_CONTINUE_MERGE){
         ERROR("Attributes are different for the same run_id(s). Set -a of you still want to merge files%s", ".");
@@ -354,7 +841,8 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
         ERROR("No slow5/blow5 files found for conversion. Exiting.%s","");
         return EXIT_FAILURE;
     }
-    VERBOSE("Allocating new read group numbers - took %.3fs\n",slow5_realtime() - realtime0);
+    VERBOSE("Opening and parsing the headers of %zu files with %d threads - took %.3fs", num_files, hdr_core.num_thread, time_open_headers);
+    VERBOSE("Allocating new read group numbers - took %.3fs",slow5_realtime() - realtime0 - time_open_headers);
 
     //now write the header to the slow5File. Use Binary non compress method for fast writing
     slow5_press_method_t method = {user_opts.record_press_out, user_opts.signal_press_out};
@@ -363,111 +851,112 @@ int merge_main(int argc, char **argv, struct program_meta *meta){
         return EXIT_FAILURE;
     }
 
-    double time_get_to_mem = 0;
-    double time_thread_execution = 0;
-    int flag_end_of_records = 0;
-    double time_write = 0;
+    int32_t n_files = slow5_files.size();
+    if (num_readers > n_files) {
+        num_readers = n_files;
+    }
+    std::vector<blow5_mmap_t *> maps(n_files, NULL);
+    std::vector<int8_t> pass(n_files, MERGE_REENCODE);
+    std::vector<std::vector<uint32_t>> aux_order(n_files);
+
+    merge_reader_t mr;
+    mr.files = &slow5_files;
+    mr.maps = &maps;
+    mr.sps = (slow5_file_t **) calloc(n_files, sizeof *mr.sps);
+    MALLOC_CHK(mr.sps);
+    mr.flag_mmap = user_opts.flag_mmap;
+    mr.ordered = !flag_unordered;
+    mr.file_q = NULL;
+    if (mr.ordered) {
+        mr.file_q = (queue_t *) malloc(n_files * sizeof *mr.file_q);
+        MALLOC_CHK(mr.file_q);
+        for (int32_t i = 0; i < n_files; i++) {
+            queue_init(&mr.file_q[i], PIPELINE_DEPTH);
+        }
+    } else {
+        queue_init(&mr.shared_q, PIPELINE_DEPTH * num_readers);
+    }
+    mr.next_file = 0;
+    mr.readers_left = num_readers;
+    mr.cur_file = 0;
+    mr.cur = NULL;
+    mr.batch_size = user_opts.read_id_batch_capacity;
+    mr.list = &list;
+    mr.fname_out = user_opts.arg_fname_out;
+    mr.pass = &pass;
+    mr.aux_order = &aux_order;
+    mr.out_header = slow5File->header;
+    mr.format_out = user_opts.fmt_out;
+    mr.press_out = method;
+    mr.lossy = user_opts.flag_lossy;
+    VERBOSE("%d input files will be read at once%s", num_readers, mr.ordered ? "" : ", records are written in the order they are read");
+
+    // Setup multithreading structures
+    core_t core = { 0 };
+    core.num_thread = user_opts.num_threads;
+    core.fp = slow5File;
+    core.aux_meta = slow5File->header->aux_meta;
+    core.format_out = user_opts.fmt_out;
+    core.press_method = method;
+    core.lossy = user_opts.flag_lossy;
+    merge_core_t mc = { &maps, &pass, &aux_order };
+    core.param = &mc;
+    core.pool = pool_init(core.num_thread, user_opts.flag_pin_threads);
+    core_press_init(&core);
 
-    int64_t batch_size = user_opts.read_id_batch_capacity;
-    size_t slow5_file_index = 0;
-    std::queue<struct slow5_file*> open_files_pointers;
-    std::vector<int> slow5_file_indices(batch_size);
+    pthread_t *readers = (pthread_t *) malloc(num_readers * sizeof *readers);
+    MALLOC_CHK(readers);
+    for (int32_t t = 0; t < num_readers; t++) {
+        int ret = pthread_create(&readers[t], NULL, merge_reader_thread, (void *) &mr);
+        NEG_CHK(ret);
+    }
 
-    struct slow5_file *from = slow5_open(slow5_files[slow5_file_index].c_str(), "r");
-    if (from == NULL) {
-        ERROR("File '%s' could not be opened - %s.", slow5_files[slow5_file_index].c_str(), strerror(errno));
+    // batches are decoded and recompressed while the next batch is taken from the readers and the previous one is written
+    pipeline_t pl = { 0 };
+    pl.read_db = merge_read_batch;
+    pl.func = parallel_reads_model;
+    pl.write_db = merge_write_batch;
+    pl.free_db = merge_batch_free;
+    pl.arg = &mr;
+    pl.depth = PIPELINE_DEPTH;
+    if (pipeline_db(&core, &pl) != 0) {
         return EXIT_FAILURE;
     }
-    open_files_pointers.push(from);
-    size_t open_file_from = slow5_file_index;
-    while(1) {
-        db_t db = { 0 };
-        db.mem_records = (char **) malloc(batch_size * sizeof(char*));
-        db.mem_bytes = (size_t *) malloc(batch_size * sizeof(size_t));
-        db.slow5_file_pointers = (slow5_file_t **) malloc(batch_size * sizeof(slow5_file_t*));
-
-        MALLOC_CHK(db.mem_records);
-        MALLOC_CHK(db.mem_bytes);
-        MALLOC_CHK(db.slow5_file_pointers);
-
-        int64_t record_count = 0;
-        size_t bytes;
-        char *mem;
-        double realtime = slow5_realtime();
-        while (record_count < batch_size) {
-            if (!(mem = (char *) slow5_get_next_mem(&bytes, from))) {
-                if (slow5_errno != SLOW5_ERR_EOF) {
-                    return EXIT_FAILURE;
-                } else { //EOF file reached
-                    slow5_file_index++;
-                    if(slow5_file_index == slow5_files.size()){
-                        flag_end_of_records = 1;
-                        break;
-                    }else{
-                        from = slow5_open(slow5_files[slow5_file_index].c_str(), "r");
-                        if (from == NULL) {
-                            ERROR("File '%s' could not be opened - %s.", slow5_files[slow5_file_index].c_str(), strerror(errno));
-                            return EXIT_FAILURE;
-                        }
-                        open_files_pointers.push(from);
-                    }
-                    continue;
-                }
-            } else {
-                db.mem_records[record_count] = mem;
-                db.mem_bytes[record_count] = bytes;
-                db.slow5_file_pointers[record_count] = from;
-                slow5_file_indices[record_count] = slow5_file_index;
-                record_count++;
-            }
+
+    for (int32_t t = 0; t < num_readers; t++) {
+        int ret = pthread_join(readers[t], NULL);
+        NEG_CHK(ret);
+    }
+    for (int32_t j : mr.finished_at_end) {
+        if (merge_close_file(&mr, j) < 0) {
+            return EXIT_FAILURE;
         }
+    }
 
-        time_get_to_mem += slow5_realtime() - realtime;
-        realtime = slow5_realtime();
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = user_opts.num_threads;
-        core.aux_meta = slow5File->header->aux_meta;
-        core.format_out = user_opts.fmt_out;
-        core.press_method = method;
-        core.lossy = user_opts.flag_lossy;
-
-        db.n_batch = record_count;
-        db.read_record = (raw_record_t*) malloc(record_count * sizeof *db.read_record);
-        MALLOC_CHK(db.read_record);
-        db.list = list;
-        db.slow5_file_indices = slow5_file_indices;
-        work_db(&core,&db,parallel_reads_model);
-        time_thread_execution += slow5_realtime() - realtime;
-
-        realtime = slow5_realtime();
-        for (int64_t i = 0; i < record_count; i++) {
-            fwrite(db.read_record[i].buffer,1,db.read_record[i].len,slow5File->fp);
-            free(db.read_record[i].buffer);
-        }
-        time_write += slow5_realtime() - realtime;
-
-        // Free everything
-        free(db.mem_bytes);
-        free(db.mem_records);
-        free(db.read_record);
-        free(db.slow5_file_pointers);
-
-        for(size_t j=open_file_from; j<slow5_file_index; j++){
-            if (slow5_close(open_files_pointers.front()) == EOF) { //close file
-                ERROR("File '%s' failed on closing - %s.", slow5_files[j].c_str(), strerror(errno));
-                return EXIT_FAILURE;
-            }
-            open_files_pointers.pop();
+    // Free everything
+    if (mr.ordered) {
+        for (int32_t i = 0; i < n_files; i++) {
+            queue_free(&mr.file_q[i]);
         }
-        open_file_from = slow5_file_index;
-        if(flag_end_of_records){
-            break;
+        free(mr.file_q);
+    } else {
+        queue_free(&mr.shared_q);
+    }
+    free(mr.sps);
+    free(readers);
+    if (slow5tools_verbosity_level >= LOG_VERBOSE) {
+        int32_t n_copy = 0, n_patch = 0;
+        for (int8_t p : pass) {
+            n_copy += p == MERGE_COPY;
+            n_patch += p == MERGE_PATCH;
         }
+        VERBOSE("Records of %d input files copied as they are, of %d input files copied with a new read_group or auxiliary field order, of %d input files re-encoded", n_copy, n_patch, n_files - n_copy - n_patch);
     }
-    DEBUG("time_get_to_mem\t%.3fs", time_get_to_mem);
-    DEBUG("time_thread_execution\t%.3fs", time_thread_execution);
-    DEBUG("time_write\t%.3fs", time_write);
+    core_press_free(&core);
+    pool_free(core.pool);
+    DEBUG("time_get_to_mem\t%.3fs", pl.time_read);
+    DEBUG("time_thread_execution\t%.3fs", pl.time_work);
+    DEBUG("time_write\t%.3fs", pl.time_write);
 
 
     if (user_opts.fmt_out == SLOW5_FORMAT_BINARY) {
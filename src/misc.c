@@ -6,6 +6,9 @@
  */
 #include "misc.h"
 #include "cmd.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
 
 extern int slow5tools_verbosity_level;
 
@@ -56,11 +59,14 @@ void init_opt(opt_t *opt){
     opt->num_threads = DEFAULT_NUM_THREADS;
     opt->num_processes = DEFAULT_NUM_PROCESSES;
     opt->read_id_batch_capacity = DEFAULT_BATCH_SIZE;
+    opt->reads_per_file = 0;
     opt->flag_lossy = DEFAULT_AUXILIARY_FIELDS_NOT_OUT;
     opt->flag_allow_run_id_mismatch = DEFAULT_ALLOW_RUN_ID_MISMATCH;
     opt->flag_retain_dir_structure = DEFAULT_RETAIN_DIR_STRUCTURE;
     opt->flag_dump_all = DEFAULT_DUMP_ALL;
     opt->flag_continue_merge = DEFAULT_CONTINUE_MERGE;
+    opt->flag_pin_threads = DEFAULT_PIN_THREADS;
+    opt->flag_mmap = DEFAULT_MMAP;
 }
 
 int parse_num_threads(opt_t *opt, int argc, char **argv, struct program_meta *meta){
@@ -312,3 +318,163 @@ int check_aux_fields_in_header(slow5_hdr *slow5_header, const char *attr, int ve
     }
     return 0;
 }
+
+#define BLOW5_MMAP_READAHEAD (64*1024*1024) //bytes advised with MADV_WILLNEED ahead of the reader
+
+// map the records of a BLOW5 file opened with slow5_open, starting at the current position of sp->fp (the first record)
+// returns NULL (with a warning) if the file is not BLOW5 or cannot be mapped, the caller then reads through slow5lib as usual
+blow5_mmap_t *blow5_mmap_init(slow5_file_t *sp){
+    if(sp->format != SLOW5_FORMAT_BINARY){
+        WARNING("--mmap only applies to BLOW5 input. Reading the file the usual way.%s", "");
+        return NULL;
+    }
+    off_t start = ftello(sp->fp);
+    struct stat st;
+    if(start < 0 || fstat(fileno(sp->fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= start){
+        WARNING("--mmap needs a regular file. Reading the file the usual way.%s", "");
+        return NULL;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(sp->fp), 0);
+    if(addr == MAP_FAILED){
+        WARNING("Could not memory map the file - %s. Reading it the usual way.", strerror(errno));
+        return NULL;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    blow5_mmap_t *m = (blow5_mmap_t *) malloc(sizeof(blow5_mmap_t));
+    MALLOC_CHK(m);
+    m->addr = (char *) addr;
+    m->size = st.st_size;
+    m->offset = start;
+    m->advised = start;
+    return m;
+}
+
+// like slow5_get_next_mem, but returns a pointer into the mapping that must not be freed
+// NULL with slow5_errno set to SLOW5_ERR_EOF at the end of the file or SLOW5_ERR_IO if the file is truncated
+char *blow5_mmap_next(blow5_mmap_t *m, size_t *bytes){
+    const char eof[] = SLOW5_BINARY_EOF;
+    size_t left = m->size - m->offset;
+    if(left == sizeof eof && memcmp(m->addr + m->offset, eof, sizeof eof) == 0){
+        slow5_errno = SLOW5_ERR_EOF;
+        return NULL;
+    }
+    slow5_rec_size_t size;
+    if(left < sizeof size){
+        slow5_errno = SLOW5_ERR_IO;
+        return NULL;
+    }
+    memcpy(&size, m->addr + m->offset, sizeof size);
+    if(size > left - sizeof size){
+        slow5_errno = SLOW5_ERR_IO;
+        return NULL;
+    }
+    char *mem = m->addr + m->offset + sizeof size;
+    m->offset += sizeof size + size;
+    *bytes = size;
+
+    // keep the kernel reading ahead of the reader
+    if(m->advised < m->size && m->offset + BLOW5_MMAP_READAHEAD / 2 > m->advised){
+        size_t from = m->offset > m->advised ? m->offset : m->advised;
+        from -= from % sysconf(_SC_PAGESIZE);
+        size_t len = m->size - from < BLOW5_MMAP_READAHEAD ? m->size - from : BLOW5_MMAP_READAHEAD;
+        madvise(m->addr + from, len, MADV_WILLNEED);
+        m->advised = from + len;
+    }
+    return mem;
+}
+
+void blow5_mmap_free(blow5_mmap_t *m){
+    if(m){
+        munmap(m->addr, m->size);
+        free(m);
+    }
+}
+
+size_t fmt_int16_array(char *buf, const int16_t *a, uint64_t n, char sep){
+    char *p = buf;
+    for(uint64_t i=0; i<n; i++){
+        int32_t v = a[i];
+        *p = '-';
+        p += v < 0;
+        uint32_t u = v < 0 ? -v : v; // at most 5 digits
+        if(u >= 10000){
+            *p++ = (char) ('0' + u / 10000);
+            u %= 10000;
+            memcpy(p, FMT_DIGIT_PAIRS + 2 * (u / 100), 2);
+            memcpy(p + 2, FMT_DIGIT_PAIRS + 2 * (u % 100), 2);
+            p += 4;
+        } else if(u >= 1000){
+            memcpy(p, FMT_DIGIT_PAIRS + 2 * (u / 100), 2);
+            memcpy(p + 2, FMT_DIGIT_PAIRS + 2 * (u % 100), 2);
+            p += 4;
+        } else if(u >= 100){
+            *p++ = (char) ('0' + u / 100);
+            memcpy(p, FMT_DIGIT_PAIRS + 2 * (u % 100), 2);
+            p += 2;
+        } else if(u >= 10){
+            memcpy(p, FMT_DIGIT_PAIRS + 2 * u, 2);
+            p += 2;
+        } else {
+            *p++ = (char) ('0' + u);
+        }
+        *p++ = sep;
+    }
+    return n ? (size_t) (p - buf) - 1 : 0;
+}
+
+// the signal of the record is swapped for a single sample while slow5lib formats the rest of the line,
+// the len_raw_signal and raw_signal columns are then replaced with the real ones
+char *rec_to_ascii_mem(slow5_rec_t *read, slow5_aux_meta_t *aux_meta, struct slow5_press *press, size_t *len){
+    uint64_t len_raw_signal = read->len_raw_signal;
+    if(len_raw_signal == 0){
+        return (char *) slow5_rec_to_mem(read, aux_meta, SLOW5_FORMAT_ASCII, press, len);
+    }
+    int16_t *raw_signal = read->raw_signal;
+    int16_t one_sample = 0;
+    read->raw_signal = &one_sample;
+    read->len_raw_signal = 1;
+    size_t bytes = 0;
+    char *mem = (char *) slow5_rec_to_mem(read, aux_meta, SLOW5_FORMAT_ASCII, press, &bytes);
+    read->raw_signal = raw_signal;
+    read->len_raw_signal = len_raw_signal;
+    if(mem == NULL){
+        return NULL;
+    }
+
+    // len_raw_signal is the 7th column and raw_signal the 8th
+    size_t start = 0;
+    size_t end = 0;
+    int cols = 0;
+    for(size_t k=0; k<bytes; k++){
+        if(mem[k] == '\t' || mem[k] == '\n'){
+            cols++;
+            if(cols == 6){
+                start = k + 1;
+            } else if(cols == 8){
+                end = k;
+                break;
+            }
+        }
+    }
+    if(cols != 8){
+        ERROR("Unexpected SLOW5 record layout for read '%s'.", read->read_id);
+        free(mem);
+        return NULL;
+    }
+
+    size_t cap = start + 21 + 1 + 7 * len_raw_signal + (bytes - end) + 1;
+    char *out = (char *) malloc(cap);
+    MALLOC_CHK(out);
+    memcpy(out, mem, start);
+    size_t n = start;
+    n += fmt_u64(out + n, len_raw_signal);
+    out[n++] = '\t';
+    n += fmt_int16_array(out + n, raw_signal, len_raw_signal, ',');
+    memcpy(out + n, mem + end, bytes - end);
+    n += bytes - end;
+    out[n] = '\0';
+    free(mem);
+    *len = n;
+    return out;
+}
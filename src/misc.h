@@ -12,6 +12,7 @@
 #include <sys/resource.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -49,11 +50,14 @@ typedef struct {
     size_t num_threads;
     size_t num_processes;
     int64_t read_id_batch_capacity;
+    int64_t reads_per_file;
     int flag_lossy;
     int flag_allow_run_id_mismatch;
     int flag_retain_dir_structure;
     int flag_dump_all;
     int flag_continue_merge;
+    int flag_pin_threads;
+    int flag_mmap;
 
     // Input arguments
     char *arg_fname_in;
@@ -72,6 +76,18 @@ typedef struct {
 } opt_t;
 
 
+// Memory mapped BLOW5 input
+typedef struct {
+    char *addr;         // start of the read-only mapping of the whole file
+    size_t size;        // size of the file
+    size_t offset;      // offset of the next record (its size prefix)
+    size_t advised;     // end of the region already advised with MADV_WILLNEED
+} blow5_mmap_t;
+
+blow5_mmap_t *blow5_mmap_init(slow5_file_t *sp);
+char *blow5_mmap_next(blow5_mmap_t *m, size_t *bytes);
+void blow5_mmap_free(blow5_mmap_t *m);
+
 enum slow5_fmt parse_name_to_fmt(const char *fmt_str);
 enum slow5_fmt parse_path_to_fmt(const char *fname);
 int check_aux_fields_in_header(slow5_hdr *slow5_header, const char *attr, int verbose,  uint32_t* i);
@@ -124,6 +140,61 @@ static inline long slow5_peakrss_child(void) {
 
 void print_args(int argc, char **argv);
 
+// Number formatting
+// Replacements for printf("%d")-style formatting on hot output paths, writing the digits two at a time from a table
+static const char FMT_DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// write x in decimal to buf (at least 20 bytes, not null terminated), returns the number of characters written
+static inline int fmt_u64(char *buf, uint64_t x) {
+    char tmp[20];
+    char *p = tmp + sizeof tmp;
+    while (x >= 100) {
+        p -= 2;
+        memcpy(p, FMT_DIGIT_PAIRS + 2 * (x % 100), 2);
+        x /= 100;
+    }
+    if (x >= 10) {
+        p -= 2;
+        memcpy(p, FMT_DIGIT_PAIRS + 2 * x, 2);
+    } else {
+        *--p = (char) ('0' + x);
+    }
+    int len = (int) (tmp + sizeof tmp - p);
+    memcpy(buf, p, len);
+    return len;
+}
+
+// same as fmt_u64 for signed values (buf of at least 21 bytes)
+static inline int fmt_i64(char *buf, int64_t x) {
+    if (x < 0) {
+        *buf = '-';
+        return 1 + fmt_u64(buf + 1, 0 - (uint64_t) x);
+    }
+    return fmt_u64(buf, (uint64_t) x);
+}
+
+#define FMT_DOUBLE_INT_MAX 1e6 // integral values below this are printed identically by slow5_double_to_str and fmt_i64
+
+// fast path of slow5_double_to_str/slow5_float_to_str for integral values (digitisation, sampling_rate, most offsets)
+// writes x to buf (at least 21 bytes) and returns the number of characters, or -1 if x is not such a value and slow5lib has to format it
+static inline int fmt_double_int(char *buf, double x) {
+    if (x > -FMT_DOUBLE_INT_MAX && x < FMT_DOUBLE_INT_MAX && x == (double) (int64_t) x && !(x == 0 && signbit(x))) {
+        return fmt_i64(buf, (int64_t) x);
+    }
+    return -1;
+}
+
+/* write n int16 values separated by sep to buf (at least 7*n bytes), without a trailing separator
+ * returns the number of characters written */
+size_t fmt_int16_array(char *buf, const int16_t *a, uint64_t n, char sep);
+
+/* slow5_rec_to_mem(read, aux_meta, SLOW5_FORMAT_ASCII, ...) with the raw signal, which is most of the line, formatted by fmt_int16_array
+ * the output is identical to slow5_rec_to_mem, returns NULL on error */
+char *rec_to_ascii_mem(slow5_rec_t *read, slow5_aux_meta_t *aux_meta, struct slow5_press *press, size_t *len);
+
 void init_opt(opt_t *opt);
 int parse_num_threads(opt_t *opt, int argc, char **argv, struct program_meta *meta);
 int parse_num_processes(opt_t *opt, int argc, char **argv, struct program_meta *meta);
@@ -6,23 +6,199 @@
  */
 
 #include <getopt.h>
+#include <string>
+#include <vector>
 #include "error.h"
 #include "cmd.h"
 #include "misc.h"
+#include "thread.h"
+#include "read_fast5.h"
 #include "slow5_extra.h"
 
 
-#define USAGE_MSG "Usage: %s  [SLOW5_FILE]\n"
+#define USAGE_MSG "Usage: %s [OPTIONS] [SLOW5_FILE/DIR] ...\n"
 #define HELP_LARGE_MSG \
     "Performs a quick check if a SLOW5/BLOW5 file is intact. That is, quickcheck checks if the file begins with a valid header (SLOW5 or BLOW5), attempt to decode the first SLOW5 record and then seeks to the end of the file and checks if proper EOF exists (BLOW5 only)." \
     "If the file is intact, the commands exists with 0. Otherwise exists with a non-zero error code.\n" \
+    "Many files and directories can be given, they are checked concurrently and a pass/fail line is printed for each file.\n" \
     USAGE_MSG \
     "\n" \
     "OPTIONS:\n" \
+    "    --full             decompress and parse every record instead of the first one only\n" \
+    HELP_MSG_THREADS \
+    HELP_MSG_BATCH \
     "    -h, --help         display this message and exit\n" \
 
 extern int slow5tools_verbosity_level;
 
+typedef struct {
+    std::vector<std::string> paths;
+    std::vector<std::string> reasons;   // empty if the file passed
+    std::vector<int64_t> n_records;     // records decoded with --full
+    int full;
+    int64_t batch_size;
+} quickcheck_arg_t;
+
+typedef struct {
+    slow5_file_t *sp;
+    int64_t batch_size;
+    int flag_end_of_file;
+    int read_failed;
+    int64_t n_records;
+    int64_t n_bad;
+} quickcheck_full_arg_t;
+
+// reader stage of --full: the next batch of raw records
+static db_t *quickcheck_read_batch(core_t *core, db_t *db, void *arg) {
+    quickcheck_full_arg_t *qa = (quickcheck_full_arg_t *) arg;
+    if (qa->flag_end_of_file) {
+        return NULL;
+    }
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = db_batch_init(qa->batch_size);
+    }
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while (record_count < qa->batch_size) {
+        if (!(mem = (char *) slow5_get_next_mem(&bytes, qa->sp))) {
+            qa->read_failed = slow5_errno != SLOW5_ERR_EOF;
+            qa->flag_end_of_file = 1;
+            break;
+        }
+        db->mem_records[record_count] = mem;
+        db->mem_bytes[record_count] = bytes;
+        record_count++;
+    }
+    if (record_count == 0) {
+        if (new_db) {
+            db_batch_free(new_db);
+        }
+        return NULL;
+    }
+    db->n_batch = record_count;
+    return db;
+}
+
+// a record that fails to decode is marked with len -1 instead of exiting
+// mem_records[i] is ours either way, the original record or the decompressed one that failed to parse
+static void quickcheck_decode_rec(core_t *core, db_t *db, int32_t i) {
+    struct slow5_rec **read = core_rec(core);
+    int ret = slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, read, core->fp);
+    free(db->mem_records[i]);
+    db->read_record[i].len = ret != 0 ? -1 : 0;
+}
+
+static int quickcheck_count_batch(core_t *core, db_t *db, void *arg) {
+    quickcheck_full_arg_t *qa = (quickcheck_full_arg_t *) arg;
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        if (db->read_record[i].len < 0) {
+            qa->n_bad++;
+        }
+    }
+    qa->n_records += db->n_batch;
+    db->n_batch = 0;
+    return 0;
+}
+
+// single threaded --full for a file checked inside a worker of the many files path
+// core_rec() slots are indexed by the calling worker's thread index, so a local record is used instead
+static void quickcheck_full_serial(quickcheck_full_arg_t *qa) {
+    slow5_rec_t *read = NULL;
+    size_t bytes;
+    char *mem;
+    while ((mem = (char *) slow5_get_next_mem(&bytes, qa->sp))) {
+        if (slow5_rec_depress_parse(&mem, &bytes, NULL, &read, qa->sp) != 0) {
+            qa->n_bad++;
+        }
+        free(mem);
+        qa->n_records++;
+    }
+    qa->read_failed = slow5_errno != SLOW5_ERR_EOF;
+    slow5_rec_free(read);
+}
+
+// decode every record of sp with num_threads threads, returns NULL if all decoded or the reason
+static const char *quickcheck_full(slow5_file_t *sp, int32_t num_threads, int64_t batch_size, int64_t *n_records, std::string &reason) {
+    quickcheck_full_arg_t qa;
+    qa.sp = sp;
+    qa.batch_size = batch_size;
+    qa.flag_end_of_file = 0;
+    qa.read_failed = 0;
+    qa.n_records = 0;
+    qa.n_bad = 0;
+
+    int ret = 0;
+    if (num_threads <= 1) {
+        quickcheck_full_serial(&qa);
+    } else {
+        core_t core = { 0 };
+        core.num_thread = num_threads;
+        core.fp = sp;
+        core.pool = pool_init(core.num_thread, 0);
+        core_rec_init(&core);
+
+        pipeline_t pl = { 0 };
+        pl.read_db = quickcheck_read_batch;
+        pl.func = quickcheck_decode_rec;
+        pl.write_db = quickcheck_count_batch;
+        pl.arg = &qa;
+        pl.depth = PIPELINE_DEPTH;
+        ret = pipeline_db(&core, &pl);
+        core_rec_free(&core);
+        pool_free(core.pool);
+    }
+
+    *n_records = qa.n_records;
+    if (ret != 0) {
+        reason = "checking the records failed";
+    } else if (qa.read_failed) {
+        reason = "a record could not be read after " + std::to_string(qa.n_records) + " records";
+    } else if (qa.n_bad) {
+        reason = std::to_string(qa.n_bad) + " of " + std::to_string(qa.n_records) + " records could not be decoded";
+    } else {
+        return NULL;
+    }
+    return reason.c_str();
+}
+
+// check a file, returns the reason it is not intact or an empty string
+static std::string quickcheck_file(const char *path, int full, int32_t num_threads, int64_t batch_size, int64_t *n_records) {
+    std::string reason;
+    slow5_file_t* slow5File = slow5_open(path, "r");
+    if(!slow5File){
+        return "could not be opened or does not have a valid header";
+    }
+
+    if(full){
+        quickcheck_full(slow5File, num_threads, batch_size, n_records, reason);
+    } else {
+        slow5_rec_t *rec = NULL;
+        if(slow5_get_next(&rec,slow5File) < 0){
+            reason = "does not have a proper slow5 record/format";
+        }
+        slow5_rec_free(rec);
+    }
+
+    if(reason.empty() && slow5File->format==SLOW5_FORMAT_BINARY){
+        const char eof[] = SLOW5_BINARY_EOF;
+        if(fseek(slow5File->fp , 0, SEEK_END) !=0 ){
+            reason = "fseek to the end of the BLOW5 file failed";
+        } else if(slow5_is_eof(slow5File->fp, eof, sizeof eof)!=1){
+            reason = "no valid slow5 eof marker at the end of the BLOW5 file";
+        }
+    }
+    slow5_close(slow5File);
+    return reason;
+}
+
+// one file per worker thread, each file checked single threaded
+static void quickcheck_one(core_t *core, db_t *db, int32_t i) {
+    quickcheck_arg_t *qa = (quickcheck_arg_t *) core->param;
+    qa->reasons[i] = quickcheck_file(qa->paths[i].c_str(), qa->full, 1, qa->batch_size, &qa->n_records[i]);
+}
+
 int quickcheck_main(int argc, char **argv, struct program_meta *meta){
 
     // Debug: print arguments
@@ -30,15 +206,22 @@ int quickcheck_main(int argc, char **argv, struct program_meta *meta){
 
     static struct option long_opts[] = {
             {"help", no_argument, NULL, 'h' }, //0
+            {"full", no_argument, NULL, 0 }, //1
+            {"threads", required_argument, NULL, 't' }, //2
+            {"batchsize", required_argument, NULL, 'K' }, //3
             {NULL, 0, NULL, 0 }
     };
 
+    opt_t user_opts;
+    init_opt(&user_opts);
+
     // Input arguments
     int longindex = 0;
     int opt;
+    int full = 0;
 
     // Parse options
-    while ((opt = getopt_long(argc, argv, "h", long_opts, &longindex)) != -1) {
+    while ((opt = getopt_long(argc, argv, "ht:K:", long_opts, &longindex)) != -1) {
         DEBUG("opt='%c', optarg=\"%s\", optind=%d, opterr=%d, optopt='%c'",
                   opt, optarg, optind, opterr, optopt);
         switch (opt) {
@@ -49,6 +232,17 @@ int quickcheck_main(int argc, char **argv, struct program_meta *meta){
 
                 EXIT_MSG(EXIT_SUCCESS, argv, meta);
                 exit(EXIT_SUCCESS);
+            case 't':
+                user_opts.arg_num_threads = optarg;
+                break;
+            case 'K':
+                user_opts.arg_batch = optarg;
+                break;
+            case 0:
+                if (longindex == 1) {
+                    full = 1;
+                }
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -56,47 +250,76 @@ int quickcheck_main(int argc, char **argv, struct program_meta *meta){
         }
     }
 
-    if (argc - optind < 1){
-        ERROR("%s", "Not enough arguments");
-        fprintf(stderr, HELP_SMALL_MSG, argv[0]);
+    if(parse_num_threads(&user_opts,argc,argv,meta) < 0){
         EXIT_MSG(EXIT_FAILURE, argv, meta);
-        exit(EXIT_FAILURE);
+        return EXIT_FAILURE;
+    }
+    if(parse_batch_size(&user_opts,argc,argv) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
     }
 
-    if (argc - optind > 1){
-        ERROR("%s", "Too many arguments");
+    if (argc - optind < 1){
+        ERROR("%s", "Not enough arguments");
         fprintf(stderr, HELP_SMALL_MSG, argv[0]);
         EXIT_MSG(EXIT_FAILURE, argv, meta);
         exit(EXIT_FAILURE);
     }
 
-
-    slow5_file_t* slow5File = slow5_open(argv[optind], "r");
-    if(!slow5File){
-        ERROR("Opening %s failed\n", argv[optind]);
-        exit(EXIT_FAILURE);
+    quickcheck_arg_t qa;
+    qa.full = full;
+    qa.batch_size = user_opts.read_id_batch_capacity;
+    struct stat st;
+    if (argc - optind == 1 && !(stat(argv[optind], &st) == 0 && S_ISDIR(st.st_mode))) {
+        qa.paths.push_back(argv[optind]); // check whatever is given, as before
+    } else {
+        for (int i = optind; i < argc; i++) {
+            list_all_items(argv[i], qa.paths, 0, ".slow5");
+        }
+        VERBOSE("%ld files found", qa.paths.size());
+        if (qa.paths.empty()) {
+            ERROR("No slow5/blow5 files found. Exiting.%s","");
+            return EXIT_FAILURE;
+        }
     }
+    size_t n_files = qa.paths.size();
+    qa.reasons.resize(n_files);
+    qa.n_records.assign(n_files, -1);
 
-    int ret_get_next = 0;
-    slow5_rec_t *rec = NULL;
-    if((ret_get_next=slow5_get_next(&rec,slow5File)) < 0){
-        ERROR("%s does not have a proper slow5 record/format", argv[optind]);
-        exit(EXIT_FAILURE);
+    int32_t num_threads = user_opts.num_threads;
+    if (n_files == 1 || (full && n_files < (size_t) num_threads)) {
+        // few files: one after the other, --full spreads the records of a file over the threads
+        for (size_t i = 0; i < n_files; i++) {
+            qa.reasons[i] = quickcheck_file(qa.paths[i].c_str(), full, num_threads, qa.batch_size, &qa.n_records[i]);
+        }
+    } else {
+        core_t core = { 0 };
+        core.num_thread = num_threads;
+        core.param = &qa;
+        db_t db = { 0 };
+        db.n_batch = n_files;
+        work_db(&core, &db, quickcheck_one);
     }
-    slow5_rec_free(rec);
 
-    if(slow5File->format==SLOW5_FORMAT_BINARY){
-        if(fseek(slow5File->fp , 0, SEEK_END) !=0 ){
-            ERROR("%s","Fseek to the end of the BLOW file failed.");
-            exit(EXIT_FAILURE);
+    int n_failed = 0;
+    for (size_t i = 0; i < n_files; i++) {
+        if (!qa.reasons[i].empty()) {
+            ERROR("%s %s", qa.paths[i].c_str(), qa.reasons[i].c_str());
+            n_failed++;
         }
-        const char eof[] = SLOW5_BINARY_EOF;
-        if(slow5_is_eof(slow5File->fp, eof, sizeof eof)!=1){
-            ERROR("%s","No valid slow5 eof marker at the end of the BLOW5 file.");
-            exit(EXIT_FAILURE);
+    }
+    if (n_files > 1 || full) { // per file summary
+        for (size_t i = 0; i < n_files; i++) {
+            fprintf(stdout, "%s\t%s", qa.paths[i].c_str(), qa.reasons[i].empty() ? "PASS" : "FAIL");
+            if (full) {
+                fprintf(stdout, "\t%" PRId64, qa.n_records[i]);
+            }
+            fprintf(stdout, "\n");
+        }
+        if (n_files > 1) {
+            INFO("%zu of %zu files passed", n_files - n_failed, n_files);
         }
     }
-    slow5_close(slow5File);
 
-    return EXIT_SUCCESS;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -7,10 +7,16 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <slow5/slow5.h>
 #include "error.h"
 #include "slow5_extra.h"
+#include "read_fast5.h"
+
+extern int slow5tools_verbosity_level;
 
 int slow5_hdr_initialize(slow5_hdr *header, int lossy){
     if (slow5_hdr_add_rg(header) < 0){
@@ -122,13 +128,59 @@ void list_all_items(const std::string& path, std::vector<std::string>& files, in
     }
 }
 
+int proc_queue_init(proc_arg_t *args, int32_t n_proc, const std::vector<std::string>& files, std::vector<int32_t>& order){
+    int32_t n = files.size();
+    std::vector<off_t> sizes(n);
+    struct stat st;
+    for(int32_t i = 0; i < n; i++){
+        sizes[i] = stat(files[i].c_str(), &st) == 0 ? st.st_size : 0;
+    }
+    order.resize(n);
+    for(int32_t i = 0; i < n; i++){
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](int32_t a, int32_t b){ return sizes[a] > sizes[b]; });
+
+    int32_t *next = (int32_t *) mmap(NULL, sizeof *next, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(next == MAP_FAILED){
+        ERROR("Could not map the shared file queue. %s.", strerror(errno));
+        return -1;
+    }
+    *next = n_proc;
+    for(int32_t t = 0; t < n_proc; t++){
+        args[t].starti = t; //the first file of each process is fixed so that every process gets one
+        args[t].endi = n;
+        args[t].order = order.data();
+        args[t].next = next;
+    }
+    return 0;
+}
+
+int32_t proc_next_file(proc_arg_t *args){
+    if(args->next == NULL){
+        return args->starti < args->endi ? args->starti++ : -1;
+    }
+    int32_t i = args->starti;
+    if(i >= 0){
+        args->starti = -1;
+    }else{
+        i = __sync_fetch_and_add(args->next, 1);
+    }
+    return i < args->endi ? args->order[i] : -1;
+}
+
+void proc_queue_free(proc_arg_t *args){
+    if(args->next){
+        munmap((void *) args->next, sizeof *args->next);
+    }
+}
+
 #ifndef DISABLE_HDF5
 
 #include <set>
 #include "cmd.h"
 #include "slow5_misc.h"
 #include "misc.h"
-#include "read_fast5.h"
 
 #define WARNING_LIMIT 1
 #define PRIMARY_FIELD_COUNT 7 //without read_group number
@@ -138,12 +190,12 @@ void list_all_items(const std::string& path, std::vector<std::string>& files, in
 
 #define REPORT_MESG " Please report this with an example FAST5 file at 'https://github.com/hasindu2008/slow5tools/issues' for us to investigate."
 
-extern int slow5tools_verbosity_level;
 
 // Operator function to be called by H5Aiterate.
 herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *info, void *op_data);
 // Operator function to be called by H5Literate.
 herr_t fast5_group_itr (hid_t loc_id, const char *name, const H5L_info_t *info, void *operator_data);
+static void fast5_schema_free(fast5_schema_t *schema);
 
 // from nanopolish_fast5_io.cpp
 static inline  std::string fast5_get_string_attribute(fast5_file_t fh, const std::string& group_name, const std::string& attribute_name);
@@ -174,6 +226,15 @@ int print_slow5_header(operator_obj* operator_data) {
 }
 
 int print_record(operator_obj* operator_data) {
+    if(operator_data->sink){
+        slow5_rec_t *rec = operator_data->slow5_record;
+        operator_data->slow5_record = NULL;
+        if(operator_data->sink->push(rec, operator_data->sink->arg) < 0){
+            ERROR("Could not queue the SLOW5 record for writing to %s.", operator_data->slow5File->meta.pathname);
+            return -1;
+        }
+        return 0;
+    }
     if(slow5_rec_fwrite(operator_data->slow5File->fp, operator_data->slow5_record, operator_data->slow5File->header->aux_meta, operator_data->format_out, operator_data->press_ptr) == -1){
         ERROR("Could not write the SLOW5 record for read id '%s' to %s.", operator_data->slow5_record->read_id, operator_data->slow5File->meta.pathname);
         return -1;
@@ -212,7 +273,8 @@ int read_fast5(opt_t *user_opts,
                fast5_file_t *fast5_file,
                slow5_file_t *slow5File,
                int write_header_flag,
-               std::unordered_map<std::string, uint32_t>* warning_map) {
+               std::unordered_map<std::string, uint32_t>* warning_map,
+               rec_sink_t *sink) {
 
     slow5_fmt format_out = user_opts->fmt_out;
     slow5_press_method_t press_out = {user_opts->record_press_out, user_opts->signal_press_out};
@@ -269,6 +331,9 @@ int read_fast5(opt_t *user_opts,
     tracker.primary_fields_count = &primary_fields_count;
 
     tracker.warning_map = warning_map;
+    tracker.sink = sink;
+    fast5_schema_t schema;
+    tracker.schema = &schema;
 
     herr_t iterator_ret;
 
@@ -329,10 +394,29 @@ int read_fast5(opt_t *user_opts,
         }
         slow5_rec_free(tracker.slow5_record);
     }
+    fast5_schema_free(&schema);
     slow5_press_free(tracker.press_ptr);
     return 1;
 }
 
+static std::string fast5_schema_key(struct operator_obj *operator_data, const char *name){
+    const char *group_name = operator_data->group_name;
+    //every read group (read_<read_id> in multi-fast5, Read_<n> in single-fast5) has the same layout
+    if(strncmp(group_name, "read_", 5) == 0 || strncmp(group_name, "Read_", 5) == 0){
+        group_name = "read";
+    }
+    return std::string(group_name) + "/" + name;
+}
+
+static void fast5_schema_free(fast5_schema_t *schema){
+    for(auto &it : schema->attr_types){
+        H5Tclose(it.second.native_type);
+        H5Tclose(it.second.attribute_type);
+    }
+    schema->attr_types.clear();
+    schema->num_attrs.clear();
+}
+
 herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *info, void *op_data){
     hid_t attribute, attribute_type, native_type;
     herr_t return_val = 0;
@@ -340,11 +424,18 @@ herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *i
     htri_t ret = 0;
 
     struct operator_obj *operator_data = (struct operator_obj *) op_data;
-    // Ensure attribute exists
-    ret = H5Aexists(loc_id, name);
-    if(ret <= 0) {
-        ERROR("Bad fast5: In fast5 file %s, the attribute '%s/%s' does not exist on the HDF5 object.\n", operator_data->fast5_path, operator_data->group_name, name);
-        return -1;
+    //the datatype is resolved once per file, later reads only check that it has not changed
+    std::string schema_key = fast5_schema_key(operator_data, name);
+    auto schema_type = operator_data->schema->attr_types.find(schema_key);
+    int schema_hit = 0;
+
+    if(schema_type == operator_data->schema->attr_types.end()){
+        // Ensure attribute exists
+        ret = H5Aexists(loc_id, name);
+        if(ret <= 0) {
+            ERROR("Bad fast5: In fast5 file %s, the attribute '%s/%s' does not exist on the HDF5 object.\n", operator_data->fast5_path, operator_data->group_name, name);
+            return -1;
+        }
     }
     attribute = H5Aopen(loc_id, name, H5P_DEFAULT);
     if(attribute < 0){
@@ -356,17 +447,36 @@ herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *i
         ERROR("Bad fast5: In fast5 file %s, failed to get the datatype of the attribute '%s/%s'.", operator_data->fast5_path, operator_data->group_name, name);
         return -1;
     }
-    native_type = H5Tget_native_type(attribute_type, H5T_DIR_ASCEND);
-    if(native_type < 0){
-        ERROR("Bad fast5: In fast5 file %s, failed to get the native datatype of the attribute '%s/%s'.", operator_data->fast5_path, operator_data->group_name, name);
-        return -1;
-    }
 
     std::string h5t_class_string = "H5T_STRING";
-    H5T_class_t H5Tclass = H5Tget_class(attribute_type);
-    if(H5Tclass == -1){
-        ERROR("Bad fast5: In fast5 file %s, failed to get the datatype class identifier of the attribute '%s/%s'.", operator_data->fast5_path, operator_data->group_name, name);
-        return -1;
+    H5T_class_t H5Tclass;
+    int is_variable_str;
+
+    if(schema_type != operator_data->schema->attr_types.end() && H5Tequal(attribute_type, schema_type->second.attribute_type) > 0){
+        schema_hit = 1;
+        native_type = schema_type->second.native_type;
+        H5Tclass = schema_type->second.h5t_class;
+        is_variable_str = schema_type->second.is_variable_str;
+    } else {
+        native_type = H5Tget_native_type(attribute_type, H5T_DIR_ASCEND);
+        if(native_type < 0){
+            ERROR("Bad fast5: In fast5 file %s, failed to get the native datatype of the attribute '%s/%s'.", operator_data->fast5_path, operator_data->group_name, name);
+            return -1;
+        }
+        H5Tclass = H5Tget_class(attribute_type);
+        if(H5Tclass == -1){
+            ERROR("Bad fast5: In fast5 file %s, failed to get the datatype class identifier of the attribute '%s/%s'.", operator_data->fast5_path, operator_data->group_name, name);
+            return -1;
+        }
+        is_variable_str = H5Tclass == H5T_STRING && H5Tis_variable_str(attribute_type) > 0;
+
+        //remember the datatype (replacing it if the layout changed in this read)
+        if(schema_type != operator_data->schema->attr_types.end()){
+            H5Tclose(schema_type->second.native_type);
+            H5Tclose(schema_type->second.attribute_type);
+        }
+        fast5_attr_type_t attr_type = {H5Tcopy(attribute_type), H5Tcopy(native_type), H5Tclass, is_variable_str};
+        operator_data->schema->attr_types[schema_key] = attr_type;
     }
 
     union attribute_data value;
@@ -380,7 +490,7 @@ herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *i
             slow5_class = SLOW5_STRING;
             slow5_class_string = "SLOW5_STRING";
             flag_value_string = 1;
-            if(H5Tis_variable_str(attribute_type) > 0) {
+            if(is_variable_str) {
                 // variable length string
                 ret_H5Aread = H5Aread(attribute, native_type, &value.attr_string);
                 if(ret_H5Aread < 0){
@@ -917,7 +1027,9 @@ herr_t fast5_attribute_itr (hid_t loc_id, const char *name, const H5A_info_t  *i
     }
 
     //close attributes
-    H5Tclose(native_type);
+    if(!schema_hit){
+        H5Tclose(native_type);
+    }
     H5Tclose(attribute_type);
     H5Aclose(attribute);
 
@@ -1229,21 +1341,37 @@ herr_t fast5_group_itr (hid_t loc_id, const char *name, const H5L_info_t *info,
                 next_op.group_name = name;
 
                 //traverse the attributes belonging to the group
-                //tracking_id and context_tags groups should be traversed only for the first read
+                //tracking_id and context_tags only go to the header, so once it is written they are traversed
+                //again only if their layout differs from the first read. Otherwise just run_id is read by name.
 
                 if (operator_data->fast5_file->is_multi_fast5) {
+                    int known_layout = 0;
+                    if (*(operator_data->flag_header_is_written) && (strcmp(name, "tracking_id") == 0 || strcmp(name, "context_tags") == 0)) {
+                        auto num_attrs = operator_data->schema->num_attrs.find(name);
+                        known_layout = num_attrs != operator_data->schema->num_attrs.end() && num_attrs->second == infobuf.num_attrs;
+                    }
                     if (strcmp(name, "tracking_id") == 0) {
                         // Ensure attribute exists
                         herr_t ret_run_id = H5Aexists(group, "run_id");
                         *(operator_data->flag_run_id_tracking_id) = ret_run_id;
                     }
-                    if (strcmp(name, "tracking_id") == 0){// && *(operator_data->flag_tracking_id) == 0) {
-                        return_val = H5Aiterate2(group, H5_INDEX_NAME, H5_ITER_NATIVE, 0, fast5_attribute_itr, (void *) &next_op);
+                    if (strcmp(name, "tracking_id") == 0){
+                        if (known_layout) {
+                            if (*(operator_data->flag_run_id_tracking_id) > 0) {
+                                return_val = fast5_attribute_itr(group, "run_id", NULL, (void *) &next_op);
+                            }
+                        } else {
+                            return_val = H5Aiterate2(group, H5_INDEX_NAME, H5_ITER_NATIVE, 0, fast5_attribute_itr, (void *) &next_op);
+                            operator_data->schema->num_attrs[name] = infobuf.num_attrs;
+                        }
                         *(operator_data->flag_tracking_id) = 1;
-                    } else if (strcmp(name, "context_tags") == 0){// && *(operator_data->flag_context_tags) == 0) {
-                        return_val = H5Aiterate2(group, H5_INDEX_NAME, H5_ITER_NATIVE, 0, fast5_attribute_itr, (void *) &next_op);
+                    } else if (strcmp(name, "context_tags") == 0){
+                        if (!known_layout) {
+                            return_val = H5Aiterate2(group, H5_INDEX_NAME, H5_ITER_NATIVE, 0, fast5_attribute_itr, (void *) &next_op);
+                            operator_data->schema->num_attrs[name] = infobuf.num_attrs;
+                        }
                         *(operator_data->flag_context_tags) = 1;
-                    } else if (strcmp(name, "tracking_id") != 0 && strcmp(name, "context_tags") != 0) {
+                    } else {
                         return_val = H5Aiterate2(group, H5_INDEX_NAME, H5_ITER_NATIVE, 0, fast5_attribute_itr, (void *) &next_op);
                     }
                 }else{
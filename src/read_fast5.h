@@ -14,8 +14,17 @@ typedef struct {
     int32_t starti;
     int32_t endi;
     int32_t proc_index;
+    const int32_t *order;       // file indices largest first when files are handed out on demand, see proc_queue_init
+    volatile int32_t *next;     // position in order, shared by all the processes (NULL to go through starti..endi)
 }proc_arg_t;
 
+/* sort the files largest first and share a cursor among the processes forked afterwards, so that a process takes the next file once it is done with its current one
+ * the first n_proc files go one to each process, order must outlive the processes, returns 0 on success and -1 on error */
+int proc_queue_init(proc_arg_t *args, int32_t n_proc, const std::vector<std::string>& files, std::vector<int32_t>& order);
+/* index of the next file to be converted by this process, -1 when there is none left */
+int32_t proc_next_file(proc_arg_t *args);
+void proc_queue_free(proc_arg_t *args);
+
 #ifndef DISABLE_HDF5
 
 #ifndef HAVE_CONFIG_H
@@ -58,6 +67,26 @@ typedef struct{
 
 enum group_flags{ROOT, READ, RAW, CHANNEL_ID, CONTEXT_TAGS, TRACKING_ID};
 
+/* takes the records read by read_fast5 instead of them being written straight to the slow5 file */
+typedef struct {
+    int (*push)(slow5_rec_t *rec, void *arg);   // owns rec from now on, returns -1 on error
+    void *arg;
+} rec_sink_t;
+
+/* datatype of an attribute as resolved the first time it is seen in a fast5 file */
+typedef struct {
+    hid_t attribute_type;
+    hid_t native_type;
+    H5T_class_t h5t_class;
+    int is_variable_str;
+} fast5_attr_type_t;
+
+/* attribute layout of a fast5 file, resolved on the first read and reused for the rest */
+typedef struct {
+    std::unordered_map<std::string, fast5_attr_type_t> attr_types;  // key is group/attribute, the read groups share the group "read"
+    std::unordered_map<std::string, hsize_t> num_attrs;             // number of attributes in tracking_id and context_tags of the first read
+} fast5_schema_t;
+
 struct operator_obj {
     //attributes to track hdf5 hierarchy
     unsigned        group_level;         /* Recursion level.  0=root */
@@ -86,6 +115,8 @@ struct operator_obj {
     slow5_file_t* slow5File;
     std::unordered_map<std::string, uint32_t>* warning_map;
     int *primary_fields_count;
+    rec_sink_t *sink;
+    fast5_schema_t *schema;
 };
 
 //implemented in read_fast5.c
@@ -93,7 +124,8 @@ int read_fast5(opt_t *user_opts,
                fast5_file_t *fast5_file,
                slow5_file_t *slow5File,
                int write_header_flag,
-               std::unordered_map<std::string, uint32_t>* warning_map);
+               std::unordered_map<std::string, uint32_t>* warning_map,
+               rec_sink_t *sink);
 fast5_file_t fast5_open(const char* filename);
 
 
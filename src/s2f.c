@@ -18,10 +18,16 @@
 #include <slow5/slow5.h>
 #include "read_fast5.h"
 #include "misc.h"
+#include "thread.h"
 
 #define ESSENTIAL_AUX_ATTR_COUNT (5)
 #define ESSENTIAL_AUX_ATTRS ((char const*[]){ "start_time", "read_number", "start_mux" , "median_before", "channel_number"})
 
+#define S2F_DEFLATE_LEVEL 1 //zlib level of the Signal datasets
+#if H5_VERSION_GE(1,10,3) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define S2F_DIRECT_CHUNK 1 //the signal is compressed by the decoding threads and written with H5Dwrite_chunk (the chunk bytes must already be H5T_STD_I16LE)
+#endif
+
 #define USAGE_MSG "Usage: %s [OPTIONS] -d [OUT_DIR] [SLOW5_FILE/DIR] ...\n"
 #define HELP_LARGE_MSG \
     "Convert SLOW5/BLOW5 files to FAST5 format.\n" \
@@ -31,6 +37,9 @@
     HELP_MSG_OUTPUT_DIRECTORY \
     HELP_MSG_OUTPUT_FILE \
     HELP_MSG_PROCESSES \
+    "    -t, --threads INT             number of decoding threads per I/O process [" TO_STR(DEFAULT_NUM_THREADS) " divided by -p, at least 1]\n" \
+    HELP_MSG_BATCH \
+    "    --reads-per-file INT          write at most INT reads to each FAST5 file (needs -d) [one FAST5 per input]\n" \
     HELP_MSG_HELP \
 
 extern int slow5tools_verbosity_level;
@@ -319,28 +328,132 @@ int initialize_end_reason(slow5_hdr_t* header, hid_t* end_reason_enum_id) {
     return 0;
 }
 
-void write_fast5(slow5_file_t *slow5File, const char *fast5_file_path, const char *slow5_filename) {
-    hid_t   file_id;
-    hid_t group_read, group_raw, group_channel_id, group_tracking_id, group_context_tags;
-    herr_t  status;
-    hid_t end_reason_enum_id = -1;
-    struct slow5_rec *slow5_record = NULL;
-
-    int ret = slow5_get_next(&slow5_record, slow5File);
-    if(ret < 0){
-        if(ret == SLOW5_ERR_EOF){
-            WARNING("No record found. Conversion skipped.%s", "");
-            return;
-        }else{
-            ERROR("Could not read the slow5 records. exiting... %s", "");
-            exit(EXIT_FAILURE);
+// a decoded record and its signal already compressed the way the deflate filter of the Signal dataset would do it
+typedef struct {
+    slow5_rec_t *rec;
+    unsigned char *chunk;
+    size_t chunk_cap;
+    size_t chunk_len;       // 0 if the signal is left to H5Dwrite
+} s2f_rec_t;
+
+/* records are read and decoded (and their signal compressed) on a thread pool ahead of the writer
+ * every HDF5 call for the output file is made by the writer stage of the pipeline, one at a time */
+typedef struct {
+    slow5_file_t *sp;
+    std::string fast5_path;         // current output file
+    std::string fast5_prefix;       // rolling outputs are <fast5_prefix>_<file_index>.fast5
+    const char *slow5_filename;
+    int64_t batch_size;
+    int64_t reads_per_file;         // 0 to write all the reads to fast5_path
+    int flag_end_of_file;
+    size_t n_reads;                 // reads written to the current output file so far
+    uint32_t file_index;            // rolling outputs written so far
+    hid_t file_id;
+    hid_t group_read_first;
+    hid_t end_reason_enum_id;
+    hid_t dcpl;                     // Signal dataset creation properties, only the chunk size changes between reads
+    hid_t dapl;                     // Signal dataset access properties
+} s2f_writer_t;
+
+static db_t *s2f_batch_init(int64_t cap) {
+    db_t *db = db_batch_init(cap);
+    db->param = calloc(cap, sizeof(s2f_rec_t));
+    MALLOC_CHK(db->param);
+    return db;
+}
+
+static void s2f_batch_free(db_t *db) {
+    s2f_rec_t *recs = (s2f_rec_t *) db->param;
+    for (int64_t i = 0; i < db->capacity; i++) {
+        slow5_rec_free(recs[i].rec);
+        free(recs[i].chunk);
+    }
+    free(db->param);
+    db_batch_free(db);
+}
+
+static db_t *s2f_read_batch(core_t *core, db_t *db, void *arg) {
+    s2f_writer_t *w = (s2f_writer_t *) arg;
+    if (w->flag_end_of_file) {
+        return NULL;
+    }
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = s2f_batch_init(w->batch_size);
+    }
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while (record_count < w->batch_size) {
+        if (!(mem = (char *) slow5_get_next_mem(&bytes, w->sp))) {
+            if (slow5_errno != SLOW5_ERR_EOF) {
+                ERROR("Could not read the slow5 records. exiting... %s", "");
+                exit(EXIT_FAILURE);
+            }
+            w->flag_end_of_file = 1;
+            break;
         }
+        db->mem_records[record_count] = mem;
+        db->mem_bytes[record_count] = bytes;
+        record_count++;
+    }
+    if (record_count == 0) {
+        if (new_db) {
+            s2f_batch_free(new_db);
+        }
+        return NULL;
+    }
+    db->n_batch = record_count;
+    return db;
+}
+
+static void s2f_decode_rec(core_t *core, db_t *db, int32_t i) {
+    s2f_rec_t *r = &((s2f_rec_t *) db->param)[i];
+    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, &r->rec, core->fp) != 0) {
+        ERROR("Could not parse the slow5 record at index %d of the batch.", i);
+        exit(EXIT_FAILURE);
+    }
+    free(db->mem_records[i]);
+    r->chunk_len = 0;
+#ifdef S2F_DIRECT_CHUNK
+    uLong src_len = r->rec->len_raw_signal * sizeof *r->rec->raw_signal;
+    if (src_len == 0) {
+        return;
+    }
+    uLongf dst_len = compressBound(src_len);
+    if (dst_len > r->chunk_cap) {
+        free(r->chunk);
+        r->chunk = (unsigned char *) malloc(dst_len);
+        MALLOC_CHK(r->chunk);
+        r->chunk_cap = dst_len;
+    }
+    if (compress2(r->chunk, &dst_len, (const Bytef *) r->rec->raw_signal, src_len, S2F_DEFLATE_LEVEL) != Z_OK) {
+        ERROR("Could not compress the signal of read id '%s'.", r->rec->read_id);
+        exit(EXIT_FAILURE);
     }
+    r->chunk_len = dst_len;
+#endif
+}
+
+// create the fast5 file with the groups shared by all the reads, slow5_record is the first record
+static void s2f_open_fast5(s2f_writer_t *w, slow5_rec_t *slow5_record) {
+    slow5_file_t *slow5File = w->sp;
+    if (w->reads_per_file > 0) {
+        w->fast5_path = w->fast5_prefix + "_" + std::to_string(w->file_index) + ".fast5";
+        w->file_index++;
+    }
+    const char *fast5_file_path = w->fast5_path.c_str();
+    hid_t group_context_tags, group_tracking_id;
+    herr_t status;
+
+    // HDF5 keeps this per thread in thread-safe builds
+    H5Eset_auto(0, NULL, NULL);
+
     uint32_t num_essential_aux_attrs = ESSENTIAL_AUX_ATTR_COUNT;
     for(uint32_t i=0; i<num_essential_aux_attrs; i++){
         uint32_t attribute_index;
         if(slow5File->header->aux_meta &&  check_aux_fields_in_header(slow5File->header, ESSENTIAL_AUX_ATTRS[i], 1, &attribute_index)){
-            ERROR("%s is missing an essential auxiliary field. s2f only creates fast5 that can be basecalled using guppy.",slow5_filename);
+            ERROR("%s is missing an essential auxiliary field. s2f only creates fast5 that can be basecalled using guppy.",w->slow5_filename);
             exit(EXIT_FAILURE);
         }
     }
@@ -349,7 +462,7 @@ void write_fast5(slow5_file_t *slow5File, const char *fast5_file_path, const cha
     if(slow5File->header->aux_meta &&  check_aux_fields_in_header(slow5File->header, "end_reason", 0, &end_reason_index) == 0){
         enum slow5_aux_type end_reason_datatype = slow5File->header->aux_meta->types[end_reason_index];
         if (end_reason_datatype == SLOW5_ENUM) {
-            int ret_initialize_end_reason = initialize_end_reason(slow5File->header, &end_reason_enum_id);
+            int ret_initialize_end_reason = initialize_end_reason(slow5File->header, &w->end_reason_enum_id);
             if(ret_initialize_end_reason<0){
                 exit(EXIT_FAILURE);
             }
@@ -357,31 +470,43 @@ void write_fast5(slow5_file_t *slow5File, const char *fast5_file_path, const cha
     }
 
     /* Create a new file using default properties. */
-    file_id = H5Fcreate(fast5_file_path, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if(file_id < 0){
+    w->file_id = H5Fcreate(fast5_file_path, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if(w->file_id < 0){
         ERROR("Failed to create the fast5 file '%s'.", fast5_file_path);
         exit(EXIT_FAILURE);
     }
-    set_hdf5_attributes(file_id, ROOT, slow5File->header, slow5_record, &end_reason_enum_id);
+    set_hdf5_attributes(w->file_id, ROOT, slow5File->header, slow5_record, &w->end_reason_enum_id);
+
+    //the zlib compression filter is set once, the chunk (one per read) is set for each read
+    w->dcpl = H5Pcreate (H5P_DATASET_CREATE);
+    if(w->dcpl < 0){
+        ERROR("Could not create the dataset creation property list in fast5 file '%s'.", fast5_file_path);
+        exit(EXIT_FAILURE);
+    }
+    status = H5Pset_deflate (w->dcpl, S2F_DEFLATE_LEVEL);
+    //each chunk is written once in full, so it is not worth keeping in the chunk cache
+    w->dapl = H5Pcreate (H5P_DATASET_ACCESS);
+    if(w->dapl < 0){
+        ERROR("Could not create the dataset access property list in fast5 file '%s'.", fast5_file_path);
+        exit(EXIT_FAILURE);
+    }
+    status = H5Pset_chunk_cache (w->dapl, 0, 0, H5D_CHUNK_CACHE_W0_DEFAULT);
 
     // create first read group
-    const char* read_tag = "read_";
-    char read_name[strlen(read_tag)+strlen(slow5_record->read_id)];
-    strcpy(read_name,read_tag);
-    group_read = H5Gcreate (file_id, strcat(read_name,slow5_record->read_id), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    if(group_read < 0){
+    std::string read_name = std::string("read_") + slow5_record->read_id;
+    w->group_read_first = H5Gcreate (w->file_id, read_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(w->group_read_first < 0){
         ERROR("Could not create read group in fast5 file '%s'.", fast5_file_path);
         exit(EXIT_FAILURE);
     }
-    hid_t group_read_first = group_read;
 
     // create context_tags group
-    group_context_tags = H5Gcreate (group_read, "context_tags", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    group_context_tags = H5Gcreate (w->group_read_first, "context_tags", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
     if(group_context_tags < 0){
         ERROR("Could not create context_tags group in fast5 file '%s'.", fast5_file_path);
         exit(EXIT_FAILURE);
     }
-    set_hdf5_attributes(group_context_tags, CONTEXT_TAGS, slow5File->header, slow5_record, &end_reason_enum_id);
+    set_hdf5_attributes(group_context_tags, CONTEXT_TAGS, slow5File->header, slow5_record, &w->end_reason_enum_id);
     status = H5Gclose (group_context_tags);
     if(status<0){
         ERROR("Could not close the context_tags group in fast5 file '%s'.", fast5_file_path);
@@ -389,129 +514,191 @@ void write_fast5(slow5_file_t *slow5File, const char *fast5_file_path, const cha
     }
 
     // creat tracking_id group
-    group_tracking_id = H5Gcreate (group_read, "tracking_id", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    if(group_context_tags < 0){
+    group_tracking_id = H5Gcreate (w->group_read_first, "tracking_id", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(group_tracking_id < 0){
         ERROR("Could not create tracking_id group in fast5 file '%s'.", fast5_file_path);
         exit(EXIT_FAILURE);
     }
-    set_hdf5_attributes(group_tracking_id, TRACKING_ID, slow5File->header, slow5_record, &end_reason_enum_id);
+    set_hdf5_attributes(group_tracking_id, TRACKING_ID, slow5File->header, slow5_record, &w->end_reason_enum_id);
     status = H5Gclose (group_tracking_id);
     if(status<0){
         ERROR("Could not close the tracking_id group in fast5 file '%s'.", fast5_file_path);
         exit(EXIT_FAILURE);
     }
+}
 
-    size_t i = 0;
-    while(1){
-        if(i){
-            ret = slow5_get_next(&slow5_record, slow5File);
-            if(ret < 0){
-                if(ret == SLOW5_ERR_EOF){
-                    break;
-                }else{
-                    ERROR("Could not read the slow5 records. exiting... %s", "");
-                    exit(EXIT_FAILURE);
-                }
-            }
+static void s2f_close_fast5(s2f_writer_t *w) {
+    if (w->end_reason_enum_id >= 0){
+        H5Tclose(w->end_reason_enum_id);
+        w->end_reason_enum_id = -1;
+    }
+    H5Pclose(w->dcpl);
+    H5Pclose(w->dapl);
+    H5Gclose (w->group_read_first);
+    if (H5Fclose(w->file_id) < 0) {
+        ERROR("Could not close the fast5 file '%s'.", w->fast5_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    w->n_reads = 0;
+}
 
-            // create read group
-            char read_name[strlen(read_tag)+strlen(slow5_record->read_id)];
-            strcpy(read_name,read_tag);
-            group_read = H5Gcreate (file_id, strcat(read_name,slow5_record->read_id), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-            if(group_read < 0){
-                ERROR("Could not create read group in fast5 file '%s'.", fast5_file_path);
-                exit(EXIT_FAILURE);
-            }
-//            if(group_read<1){
-//                WARNING("A read group with read_id %s already exists, hence skipping.. \n",slow5_record->read_id);
-//                continue;
-//            }
-        }
+static void s2f_write_read(s2f_writer_t *w, s2f_rec_t *r) {
+    slow5_file_t *slow5File = w->sp;
+    slow5_rec_t *slow5_record = r->rec;
+    hid_t group_read, group_raw, group_channel_id;
+    herr_t status;
 
-        set_hdf5_attributes(group_read, READ, slow5File->header, slow5_record, &end_reason_enum_id);
-        // creat Raw group
-        group_raw = H5Gcreate (group_read, "Raw", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-        if(group_raw < 0){
-            ERROR("Could not create Raw group in fast5 file '%s'.", fast5_file_path);
+    //roll over to the next output file
+    if(w->reads_per_file > 0 && w->n_reads == (size_t) w->reads_per_file){
+        s2f_close_fast5(w);
+    }
+    const char *fast5_file_path;
+    if(w->n_reads == 0){
+        s2f_open_fast5(w, slow5_record);
+        fast5_file_path = w->fast5_path.c_str();
+        group_read = w->group_read_first;
+    } else {
+        fast5_file_path = w->fast5_path.c_str();
+        // create read group
+        std::string read_name = std::string("read_") + slow5_record->read_id;
+        group_read = H5Gcreate (w->file_id, read_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if(group_read < 0){
+            ERROR("Could not create read group in fast5 file '%s'.", fast5_file_path);
             exit(EXIT_FAILURE);
         }
-        if(i>0){
-            // creat context_tags group link
-            status = H5Lcreate_hard(group_read_first, "context_tags", group_read, "context_tags", H5P_DEFAULT, H5P_DEFAULT);
-            if(status < 0){
-                ERROR("Could not create link to the context_tags group in fast5 file '%s'.", fast5_file_path);
-                exit(EXIT_FAILURE);
-            }
-            // creat tracking_id group link
-            status = H5Lcreate_hard(group_read_first, "tracking_id", group_read, "tracking_id", H5P_DEFAULT, H5P_DEFAULT);
-            if(status < 0){
-                ERROR("Could not create link to the tracking_id group in fast5 file '%s'.", fast5_file_path);
-                exit(EXIT_FAILURE);
-            }
-        }
+    }
 
-        // signal
-        // Create the data space for the dataset
-        hsize_t nsample = slow5_record->len_raw_signal;
-        hsize_t dims[] = {nsample};
-        hsize_t maxdims[] = {H5S_UNLIMITED};
-        hid_t dataspace_id = H5Screate_simple(1, dims, maxdims);
-        if(dataspace_id < 0){
-            ERROR("Could not create single dataspace in fast5 file '%s'.", fast5_file_path);
+    set_hdf5_attributes(group_read, READ, slow5File->header, slow5_record, &w->end_reason_enum_id);
+    // creat Raw group
+    group_raw = H5Gcreate (group_read, "Raw", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(group_raw < 0){
+        ERROR("Could not create Raw group in fast5 file '%s'.", fast5_file_path);
+        exit(EXIT_FAILURE);
+    }
+    if(w->n_reads>0){
+        // creat context_tags group link
+        status = H5Lcreate_hard(w->group_read_first, "context_tags", group_read, "context_tags", H5P_DEFAULT, H5P_DEFAULT);
+        if(status < 0){
+            ERROR("Could not create link to the context_tags group in fast5 file '%s'.", fast5_file_path);
             exit(EXIT_FAILURE);
         }
-
-        //Create the dataset creation property list, add the zlib compression filter and set the chunk size.
-        hsize_t chunk[] = {nsample};
-        hid_t dcpl = H5Pcreate (H5P_DATASET_CREATE);
-        if(dcpl < 0){
-            ERROR("Could not create the dataset creation property list in fast5 file '%s'.", fast5_file_path);
+        // creat tracking_id group link
+        status = H5Lcreate_hard(w->group_read_first, "tracking_id", group_read, "tracking_id", H5P_DEFAULT, H5P_DEFAULT);
+        if(status < 0){
+            ERROR("Could not create link to the tracking_id group in fast5 file '%s'.", fast5_file_path);
             exit(EXIT_FAILURE);
         }
-        status = H5Pset_chunk (dcpl, 1, chunk);
-        status = H5Pset_deflate (dcpl, 1);
-
-        // Create the dataset.
-        hid_t dataset_id = H5Dcreate2(group_raw, "Signal", H5T_STD_I16LE, dataspace_id, H5P_DEFAULT, dcpl, H5P_DEFAULT);
-        // Write the data to the dataset.
-        status = H5Dwrite(dataset_id, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, slow5_record->raw_signal);
-        // Close and release resources.
-        status = H5Pclose (dcpl);
-        status = H5Dclose(dataset_id);
-        status = H5Sclose(dataspace_id);
-
-        set_hdf5_attributes(group_raw, RAW, slow5File->header, slow5_record, &end_reason_enum_id);
-        status = H5Gclose (group_raw);
-
-        // creat channel_id group
-        group_channel_id = H5Gcreate (group_read, "channel_id", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-        set_hdf5_attributes(group_channel_id, CHANNEL_ID, slow5File->header, slow5_record, &end_reason_enum_id);
-        status = H5Gclose (group_channel_id);
-
-        if(i>0){
-            status = H5Gclose (group_read);
-        }
-        i++;
-        //to check if peak RAM increase over time
-        //fprintf(stderr, "peak RAM = %.3f GB\n", slow5_peakrss() / 1024.0 / 1024.0 / 1024.0);
     }
-    uint32_t attribute_index;
-    if (slow5File->header->aux_meta &&  check_aux_fields_in_header(slow5File->header, "end_reason", 0, &attribute_index) == 0){
-        H5Tclose(end_reason_enum_id);
+
+    // signal
+    // Create the data space for the dataset
+    hsize_t nsample = slow5_record->len_raw_signal;
+    hsize_t dims[] = {nsample};
+    hsize_t maxdims[] = {H5S_UNLIMITED};
+    hid_t dataspace_id = H5Screate_simple(1, dims, maxdims);
+    if(dataspace_id < 0){
+        ERROR("Could not create single dataspace in fast5 file '%s'.", fast5_file_path);
+        exit(EXIT_FAILURE);
+    }
+
+    // the whole signal is a single chunk
+    hsize_t chunk[] = {nsample};
+    status = H5Pset_chunk (w->dcpl, 1, chunk);
+
+    // Create the dataset.
+    hid_t dataset_id = H5Dcreate2(group_raw, "Signal", H5T_STD_I16LE, dataspace_id, H5P_DEFAULT, w->dcpl, w->dapl);
+    // Write the data to the dataset.
+#ifdef S2F_DIRECT_CHUNK
+    if(r->chunk_len > 0){
+        hsize_t offset[] = {0};
+        status = H5Dwrite_chunk(dataset_id, H5P_DEFAULT, 0, offset, r->chunk_len, r->chunk);
+    } else
+#endif
+    status = H5Dwrite(dataset_id, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, slow5_record->raw_signal);
+    // Close and release resources.
+    status = H5Dclose(dataset_id);
+    status = H5Sclose(dataspace_id);
+
+    set_hdf5_attributes(group_raw, RAW, slow5File->header, slow5_record, &w->end_reason_enum_id);
+    status = H5Gclose (group_raw);
+
+    // creat channel_id group
+    group_channel_id = H5Gcreate (group_read, "channel_id", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    set_hdf5_attributes(group_channel_id, CHANNEL_ID, slow5File->header, slow5_record, &w->end_reason_enum_id);
+    status = H5Gclose (group_channel_id);
+
+    if(w->n_reads>0){
+        status = H5Gclose (group_read);
     }
+    w->n_reads++;
+}
 
-    status = H5Gclose (group_read_first);
-    slow5_rec_free(slow5_record);
-    status = H5Fclose(file_id);
+static int s2f_write_batch(core_t *core, db_t *db, void *arg) {
+    s2f_writer_t *w = (s2f_writer_t *) arg;
+    s2f_rec_t *recs = (s2f_rec_t *) db->param;
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        s2f_write_read(w, &recs[i]);
+    }
+    //to check if peak RAM increase over time
+    //fprintf(stderr, "peak RAM = %.3f GB\n", slow5_peakrss() / 1024.0 / 1024.0 / 1024.0);
+    db->n_batch = 0;
+    return 0;
+}
+
+void write_fast5(slow5_file_t *slow5File, const char *fast5_file_path, const char *slow5_filename, int32_t num_threads, int64_t batch_size, int64_t reads_per_file) {
+    s2f_writer_t w;
+    w.sp = slow5File;
+    w.fast5_path = fast5_file_path;
+    if (reads_per_file > 0) {
+        w.fast5_prefix = w.fast5_path.substr(0, w.fast5_path.length() - strlen(".fast5"));
+    }
+    w.slow5_filename = slow5_filename;
+    w.batch_size = batch_size;
+    w.reads_per_file = reads_per_file;
+    w.flag_end_of_file = 0;
+    w.n_reads = 0;
+    w.file_index = 0;
+    w.file_id = w.group_read_first = w.end_reason_enum_id = w.dcpl = w.dapl = -1;
+
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = slow5File;
+    core.pool = pool_init(core.num_thread, 0);
+
+    pipeline_t pl = { 0 };
+    pl.read_db = s2f_read_batch;
+    pl.func = s2f_decode_rec;
+    pl.write_db = s2f_write_batch;
+    pl.free_db = s2f_batch_free;
+    pl.arg = &w;
+    pl.depth = PIPELINE_DEPTH;
+    int ret = pipeline_db(&core, &pl);
+    pool_free(core.pool);
+    if(ret != 0){
+        ERROR("Could not convert %s.", slow5_filename);
+        exit(EXIT_FAILURE);
+    }
+    DEBUG("read %.3fs, decode %.3fs, write %.3fs", pl.time_read, pl.time_work, pl.time_write);
+
+    if(w.n_reads == 0){
+        WARNING("No record found. Conversion skipped.%s", "");
+        return;
+    }
+    s2f_close_fast5(&w);
+    if (reads_per_file > 0) {
+        VERBOSE("%s was written to %" PRIu32 " fast5 files", slow5_filename, w.file_index);
+    }
 }
 
 void s2f_child_worker(proc_arg_t args,
                       std::vector<std::string> &slow5_files,
                       char *output_dir,
                       char* arg_fname_out,
+                      opt_t *user_opts,
                       program_meta *meta,
                       reads_count *readsCount) {
-    for (int i = args.starti; i < args.endi; i++) {
+    int i;
+    while ((i = proc_next_file(&args)) >= 0) {
         DEBUG("Converting %s to fast5", slow5_files[i].c_str());
         slow5_file_t* slow5File_i = slow5_open(slow5_files[i].c_str(), "r");
         if(!slow5File_i){
@@ -537,7 +724,7 @@ void s2f_child_worker(proc_arg_t args,
         if(arg_fname_out){
             fast5_path = std::string(arg_fname_out);
         }
-        write_fast5(slow5File_i, fast5_path.c_str(), slow5_files[i].c_str());
+        write_fast5(slow5File_i, fast5_path.c_str(), slow5_files[i].c_str(), user_opts->num_threads, user_opts->read_id_batch_capacity, user_opts->reads_per_file);
         //  Close the slow5 file.
         slow5_close(slow5File_i);
     }
@@ -547,6 +734,7 @@ void s2f_iop(int iop,
              std::vector<std::string> &slow5_files,
              char *output_dir,
              char* arg_fname_out,
+             opt_t *user_opts,
              program_meta *meta,
              reads_count *readsCount) {
 
@@ -555,6 +743,10 @@ void s2f_iop(int iop,
         iop = num_slow5_files;
     }
     VERBOSE("%d proceses will be used",iop);
+    if (user_opts->arg_num_threads == NULL) { // share the default number of threads among the processes
+        user_opts->num_threads = DEFAULT_NUM_THREADS / iop > 0 ? DEFAULT_NUM_THREADS / iop : 1;
+    }
+    VERBOSE("%zu decoding threads per process will be used.", user_opts->num_threads);
     //create processes
     pid_t* pids = (pid_t*) malloc(iop*sizeof(pid_t));
     proc_arg_t* proc_args = (proc_arg_t*)malloc(iop*sizeof(proc_arg_t));
@@ -577,10 +769,18 @@ void s2f_iop(int iop,
             proc_args[t].endi = i;
         }
         proc_args[t].proc_index = t;
+        proc_args[t].order = NULL;
+        proc_args[t].next = NULL;
+    }
+
+    //hand out the files on demand, largest first, so that a few large files do not keep one process busy long after the others are done
+    std::vector<int32_t> file_order;
+    if(iop>1 && proc_queue_init(proc_args, iop, slow5_files, file_order) < 0){
+        exit(EXIT_FAILURE);
     }
 
     if(iop==1){
-        s2f_child_worker(proc_args[0], slow5_files, output_dir, arg_fname_out, meta, readsCount);
+        s2f_child_worker(proc_args[0], slow5_files, output_dir, arg_fname_out, user_opts, meta, readsCount);
         free(proc_args);
         free(pids);
         return;
@@ -597,7 +797,7 @@ void s2f_iop(int iop,
             exit(EXIT_FAILURE);
         }
         if(pids[t]==0){ //child
-            s2f_child_worker(proc_args[t],slow5_files,output_dir, arg_fname_out, meta, readsCount);
+            s2f_child_worker(proc_args[t],slow5_files,output_dir, arg_fname_out, user_opts, meta, readsCount);
             exit(EXIT_SUCCESS);
         }
         if(pids[t]>0){ //parent
@@ -637,6 +837,7 @@ void s2f_iop(int iop,
             exit(EXIT_FAILURE);
         }
     }
+    proc_queue_free(&proc_args[0]);
     free(proc_args);
     free(pids);
 }
@@ -663,6 +864,9 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
             {"output",  required_argument, NULL, 'o'},   //1
             {"out-dir", required_argument, NULL, 'd' },  //2
             { "iop",    required_argument, NULL, 'p'},   //3
+            {"threads", required_argument, NULL, 't'},   //4
+            {"batchsize", required_argument, NULL, 'K'}, //5
+            {"reads-per-file", required_argument, NULL, 0}, //6
             {NULL, 0, NULL, 0 }
     };
 
@@ -674,7 +878,7 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
     int longindex = 0;
     int opt;
     // Parse options
-    while ((opt = getopt_long(argc, argv, "ho:d:p:", long_opts, &longindex)) != -1) {
+    while ((opt = getopt_long(argc, argv, "ho:d:p:t:K:", long_opts, &longindex)) != -1) {
         DEBUG("opt='%c', optarg=\"%s\", optind=%d, opterr=%d, optopt='%c'",
                   opt, optarg, optind, opterr, optopt);
         switch (opt) {
@@ -693,6 +897,23 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
             case 'p':
                 user_opts.arg_num_processes = optarg;
                 break;
+            case 't':
+                user_opts.arg_num_threads = optarg;
+                break;
+            case 'K':
+                user_opts.arg_batch = optarg;
+                break;
+            case 0  :
+                switch (longindex) {
+                    case 6:
+                        user_opts.reads_per_file = atol(optarg);
+                        if (user_opts.reads_per_file <= 0) {
+                            ERROR("Number of reads per file should be larger than 0. You entered %s", optarg);
+                            return EXIT_FAILURE;
+                        }
+                        break;
+                }
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -703,6 +924,14 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
         EXIT_MSG(EXIT_FAILURE, argv, meta);
         return EXIT_FAILURE;
     }
+    if(parse_num_threads(&user_opts,argc,argv,meta) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
+    if(parse_batch_size(&user_opts,argc,argv) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
     if(user_opts.arg_fname_out && user_opts.arg_dir_out){
         ERROR("output file name and output directory both cannot be set%s","");
         return EXIT_FAILURE;
@@ -711,6 +940,10 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
         ERROR("Please set output file name or output directory%s","");
         return EXIT_FAILURE;
     }
+    if(user_opts.reads_per_file > 0 && !user_opts.arg_dir_out){
+        ERROR("Option --reads-per-file needs an output directory (-d)%s","");
+        return EXIT_FAILURE;
+    }
     //measure file listing time
     std::vector<std::string> slow5_files;
     double realtime0 = slow5_realtime();
@@ -759,7 +992,7 @@ int s2f_main(int argc, char **argv, struct program_meta *meta) {
     reads_count readsCount;
     //measure s2f conversion time
     init_realtime = slow5_realtime();
-    s2f_iop(user_opts.num_processes, slow5_files, user_opts.arg_dir_out, user_opts.arg_fname_out, meta, &readsCount);
+    s2f_iop(user_opts.num_processes, slow5_files, user_opts.arg_dir_out, user_opts.arg_fname_out, &user_opts, meta, &readsCount);
     VERBOSE("Converting %ld s/blow5 files took %.3fs", slow5_files.size(), slow5_realtime() - init_realtime);
     VERBOSE("Children processes: CPU time = %.3f sec | peak RAM = %.3f GB", slow5_cputime_child(), slow5_peakrss_child() / 1024.0 / 1024.0 / 1024.0);
 
@@ -10,7 +10,9 @@
 #include "cmd.h"
 #include "misc.h"
 #include "thread.h"
+#include "arrow.h"
 #include <slow5/slow5.h>
+#include <slow5/slow5_press.h>
 #include "slow5_misc.h"
 
 #define USAGE_MSG "Usage: %s [OPTIONS] [SLOW5_FILE]\n"
@@ -22,8 +24,13 @@
     "OPTIONS:\n" \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
+    HELP_MSG_MMAP \
     "    --hdr              		  print the header only\n" \
     "    --rid              		  print the list of read ids only\n" \
+    "    --fields STR       		  print only these comma separated columns, without decoding the signal or other columns\n" \
+    "    --arrow FILE       		  write the records to FILE in the Arrow IPC file format instead of printing them\n" \
+    "    --signal           		  include the raw signal as a list column with --arrow\n" \
     HELP_MSG_HELP \
 
 extern int slow5tools_verbosity_level;
@@ -79,6 +86,38 @@ static inline void cpy_str(struct aux_print_param *p, uint64_t len,const char *s
     memcpy(p->buff+p->n,str,len);
     p->n += len;
 }
+static inline void cpy_u64(struct aux_print_param *p, uint64_t x){
+    char str[20];
+    cpy_str(p,fmt_u64(str,x),str);
+}
+static inline void cpy_i64(struct aux_print_param *p, int64_t x){
+    char str[21];
+    cpy_str(p,fmt_i64(str,x),str);
+}
+static inline void cpy_double(struct aux_print_param *p, double x){
+    char buf[21];
+    int len = fmt_double_int(buf,x);
+    if(len >= 0){
+        cpy_str(p,len,buf);
+    } else {
+        size_t slen;
+        char *str = slow5_double_to_str(x, &slen);
+        cpy_str(p,slen,str);
+        free(str);
+    }
+}
+static inline void cpy_float(struct aux_print_param *p, float x){
+    char buf[21];
+    int len = fmt_double_int(buf,x);
+    if(len >= 0){
+        cpy_str(p,len,buf);
+    } else {
+        size_t slen;
+        char *str = slow5_float_to_str(x, &slen);
+        cpy_str(p,slen,str);
+        free(str);
+    }
+}
 static void channel_number_print(struct aux_print_param *p){ //char*
     int ret=0;
     uint64_t len;
@@ -103,10 +142,7 @@ static void median_before_print(struct aux_print_param *p){ //double
         exit(EXIT_FAILURE);
     }
     if(!isnan(t)){  //SLOW5_DOUBLE_NULL is the generic NaN value returned by nan("""") and thus t != SLOW5_DOUBLE_NULL is not correct
-        size_t len;
-        char *str = slow5_double_to_str(t, &len);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_double(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -120,10 +156,7 @@ static void read_number_print(struct aux_print_param *p){ //int32_t
         exit(EXIT_FAILURE);
     }
     if(t != SLOW5_INT32_T_NULL){
-        char *str = NULL;
-        int len = slow5_asprintf(&str,"%" PRId32 ,t);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_i64(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -137,10 +170,7 @@ static void start_mux_print(struct aux_print_param *p){ //uint8_t
         exit(EXIT_FAILURE);
     }
     if(t != SLOW5_UINT8_T_NULL){
-        char *str = NULL;
-        int len = slow5_asprintf(&str,"%" PRIu8 ,t);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_u64(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -154,10 +184,7 @@ static void start_time_num_minknow_events_print(struct aux_print_param *p){ //ui
         exit(EXIT_FAILURE);
     }
     if(t != SLOW5_UINT64_T_NULL){
-        char *str = NULL;
-        int len = slow5_asprintf(&str,"%" PRIu64 ,t);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_u64(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -192,10 +219,7 @@ static void float_print(struct aux_print_param *p){ //float
         exit(EXIT_FAILURE);
     }
     if(!isnan(t)){  //SLOW5_FLOAT_NULL is the generic NaN value returned by nan("""") and thus t != SLOW5_FLOAT_NULL is not correct
-        size_t len;
-        char *str = slow5_float_to_str(t, &len);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_float(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -210,10 +234,7 @@ static void num_reads_since_mux_change_print(struct aux_print_param *p){ //uint3
         exit(EXIT_FAILURE);
     }
     if(t != SLOW5_UINT32_T_NULL){
-        char *str = NULL;
-        int len = slow5_asprintf(&str,"%" PRIu32 ,t);
-        cpy_str(p,len,str);
-        free(str);
+        cpy_u64(p,t);
     } else {
         cpy_str(p,1,".");
     }
@@ -267,43 +288,33 @@ typedef struct {
 } skim_param_t;
 
 static char* process_read2(slow5_rec_t *rec, struct aux_print_param p, char **aux, uint64_t num_aux, void (**aux_func)(struct aux_print_param *)){
-    char *mem = NULL;
-    char *digitisation_str = slow5_double_to_str(rec->digitisation, NULL);
-    char *offset_str = slow5_double_to_str(rec->offset, NULL);
-    char *range_str = slow5_double_to_str(rec->range, NULL);
-    char *sampling_rate_str = slow5_double_to_str(rec->sampling_rate, NULL);
-
-    int curr_len_tmp = slow5_asprintf(&mem,"%s\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%" PRIu64 "\t.",
-            rec->read_id, rec->read_group, digitisation_str, offset_str, range_str, sampling_rate_str, rec->len_raw_signal);
-
-    free(digitisation_str);
-    free(offset_str);
-    free(range_str);
-    free(sampling_rate_str);
-    if (curr_len_tmp <= 0) {
-        fprintf(stderr, "Error in printing read record\n");
-        exit(EXIT_FAILURE);
-    }
-    size_t c = curr_len_tmp+1024;
+    size_t n = strlen(rec->read_id);
+    size_t c = n + 1024;
     char *buff = (char *) malloc(c* sizeof(char));
     MALLOC_CHK(buff);
-    size_t n=curr_len_tmp;
-    strcpy(buff,mem);
-    free(mem);
+    memcpy(buff,rec->read_id,n);
+
+    p.rec = rec;
+    p.buff = buff;
+    p.c = c;
+    p.n = n;
+    cpy_u64(&p,rec->read_group);
+    cpy_double(&p,rec->digitisation);
+    cpy_double(&p,rec->offset);
+    cpy_double(&p,rec->range);
+    cpy_double(&p,rec->sampling_rate);
+    cpy_u64(&p,rec->len_raw_signal);
+    cpy_str(&p,1,".");
 
     if(aux != NULL){
-        p.rec = rec;
-        p.buff = buff;
-        p.c = c;
-        p.n = n;
-
         for(uint64_t i=0; i<num_aux; i++) {
             p.field = aux[i];
             if(aux_func[i] !=NULL) aux_func[i](&p);
         }
-        n=p.n;
-        c=p.c;
     }
+    buff=p.buff;
+    n=p.n;
+    c=p.c;
     assert(c-2>=n);
     buff[n] = '\n';
     buff[n+1] = '\0';
@@ -315,13 +326,17 @@ static char* process_read2(slow5_rec_t *rec, struct aux_print_param p, char **au
 
 void process_read(core_t *core, db_t *db, int32_t i) {
     //
-    struct slow5_rec *read = NULL;
+    struct slow5_rec **read_ptr = core_rec(core); // reused by this thread for every record
+    if (db->mapped) {
+        db_mem_record_own(db, i);
+    }
     char *record = db->mem_records[i];
-    if (slow5_decode(&record, &db->mem_bytes[i], &read, core->fp) < 0 ) {
+    if (slow5_decode(&record, &db->mem_bytes[i], read_ptr, core->fp) < 0 ) {
         exit(EXIT_FAILURE);
     } else {
         free(record);
     }
+    struct slow5_rec *read = *read_ptr;
 
     skim_param_t *param = (skim_param_t *) core->param;
 
@@ -331,10 +346,631 @@ void process_read(core_t *core, db_t *db, int32_t i) {
     void (**aux_func)(struct aux_print_param *) = param->aux_func;
 
     db->read_record[i].buffer = process_read2(read,p,aux,num_aux,aux_func);
-    slow5_rec_free(read);
 }
 
-static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int64_t batch_size){
+/* --fields: projection of the requested columns straight out of the raw records
+   BLOW5 records are only record-decompressed, the signal is stepped over using its length and never decoded
+   SLOW5 records are already text, the requested columns are picked out of the line */
+
+enum { SKIM_READ_ID, SKIM_READ_GROUP, SKIM_DIGITISATION, SKIM_OFFSET, SKIM_RANGE, SKIM_SAMPLING_RATE, SKIM_LEN_RAW_SIGNAL, SKIM_NUM_PRIMARY };
+static const char *skim_primary_names[SKIM_NUM_PRIMARY] = {"read_id", "read_group", "digitisation", "offset", "range", "sampling_rate", "len_raw_signal"};
+#define SKIM_ASCII_RAW_SIGNAL_COL SKIM_NUM_PRIMARY // the raw_signal column of a SLOW5 line, auxiliary fields follow it
+
+typedef struct {
+    int32_t primary;    // SKIM_* or -1 for an auxiliary field
+    uint32_t aux;       // position of the auxiliary field in the header
+} skim_col_t;
+
+typedef struct {
+    slow5_file_t *sp;
+    std::vector<skim_col_t> cols;
+    uint32_t num_aux_needed;    // auxiliary fields to walk (one past the last requested one)
+} skim_proj_t;
+
+typedef struct {
+    const char *ptr;    // start of the value in the record
+    uint64_t len;       // number of elements for arrays and strings, else 1
+} skim_val_t;
+
+static void skim_proj_init(skim_proj_t *proj, slow5_file_t *sp, const char *fields) {
+    proj->sp = sp;
+    proj->num_aux_needed = 0;
+    std::string list(fields);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string name = list.substr(start, end - start);
+        start = end + 1;
+        skim_col_t col = { -1, 0 };
+        for (int32_t j = 0; j < SKIM_NUM_PRIMARY; j++) {
+            if (name == skim_primary_names[j]) {
+                col.primary = j;
+            }
+        }
+        if (col.primary < 0) {
+            if (name == "raw_signal") {
+                ERROR("%s", "raw_signal cannot be projected with --fields. Use slow5tools view instead.");
+                exit(EXIT_FAILURE);
+            }
+            if (sp->header->aux_meta == NULL || check_aux_fields_in_header(sp->header, name.c_str(), 0, &col.aux) != 0) {
+                ERROR("Field '%s' given to --fields is not present in the input file.", name.c_str());
+                exit(EXIT_FAILURE);
+            }
+            if (col.aux + 1 > proj->num_aux_needed) {
+                proj->num_aux_needed = col.aux + 1;
+            }
+        }
+        proj->cols.push_back(col);
+    }
+}
+
+static inline void skim_append(char **buff, size_t *n, size_t *c, const char *str, size_t len) {
+    if (*n + len + 3 > *c) { // 3 is for '\t', '\n' and '\0'
+        *c = (*n + len + 3) * 2;
+        *buff = (char *) realloc(*buff, *c);
+        MALLOC_CHK(*buff);
+    }
+    if (*n > 0) {
+        (*buff)[(*n)++] = '\t';
+    }
+    memcpy(*buff + *n, str, len);
+    *n += len;
+}
+
+// integral values are formatted directly, others through slow5lib so that the output does not change
+static inline void skim_append_double(char **buff, size_t *n, size_t *c, double x, int is_float) {
+    char str[21];
+    int len = fmt_double_int(str, x);
+    if (len >= 0) {
+        skim_append(buff, n, c, str, len);
+        return;
+    }
+    size_t slen;
+    char *dstr = is_float ? slow5_float_to_str((float) x, &slen) : slow5_double_to_str(x, &slen);
+    skim_append(buff, n, c, dstr, slen);
+    free(dstr);
+}
+
+#define SKIM_APPEND_INT(T, NULL_VAL, FMT_FN) { \
+    T t; \
+    memcpy(&t, v.ptr, sizeof t); \
+    if (t == NULL_VAL) { \
+        skim_append(buff, n, c, ".", 1); \
+    } else { \
+        char str[21]; \
+        skim_append(buff, n, c, str, FMT_FN(str, t)); \
+    } \
+    break; \
+}
+
+// append an auxiliary value in the same notation as the full skim output ('.' for missing values)
+static void skim_append_aux(char **buff, size_t *n, size_t *c, const slow5_hdr_t *header, uint32_t aux, skim_val_t v) {
+    enum slow5_aux_type type = header->aux_meta->types[aux];
+    switch (type) {
+        case SLOW5_INT8_T: SKIM_APPEND_INT(int8_t, SLOW5_INT8_T_NULL, fmt_i64)
+        case SLOW5_INT16_T: SKIM_APPEND_INT(int16_t, SLOW5_INT16_T_NULL, fmt_i64)
+        case SLOW5_INT32_T: SKIM_APPEND_INT(int32_t, SLOW5_INT32_T_NULL, fmt_i64)
+        case SLOW5_INT64_T: SKIM_APPEND_INT(int64_t, SLOW5_INT64_T_NULL, fmt_i64)
+        case SLOW5_UINT8_T: SKIM_APPEND_INT(uint8_t, SLOW5_UINT8_T_NULL, fmt_u64)
+        case SLOW5_UINT16_T: SKIM_APPEND_INT(uint16_t, SLOW5_UINT16_T_NULL, fmt_u64)
+        case SLOW5_UINT32_T: SKIM_APPEND_INT(uint32_t, SLOW5_UINT32_T_NULL, fmt_u64)
+        case SLOW5_UINT64_T: SKIM_APPEND_INT(uint64_t, SLOW5_UINT64_T_NULL, fmt_u64)
+        case SLOW5_FLOAT: {
+            float t;
+            memcpy(&t, v.ptr, sizeof t);
+            if (isnan(t)) {
+                skim_append(buff, n, c, ".", 1);
+            } else {
+                skim_append_double(buff, n, c, t, 1);
+            }
+            break;
+        }
+        case SLOW5_DOUBLE: {
+            double t;
+            memcpy(&t, v.ptr, sizeof t);
+            if (isnan(t)) {
+                skim_append(buff, n, c, ".", 1);
+            } else {
+                skim_append_double(buff, n, c, t, 0);
+            }
+            break;
+        }
+        case SLOW5_CHAR:
+            skim_append(buff, n, c, *v.ptr ? v.ptr : ".", 1);
+            break;
+        case SLOW5_ENUM: {
+            uint8_t t = (uint8_t) *v.ptr;
+            if (t == SLOW5_ENUM_NULL || t >= header->aux_meta->enum_num_labels[aux]) {
+                skim_append(buff, n, c, ".", 1);
+            } else {
+                const char *label = header->aux_meta->enum_labels[aux][t];
+                skim_append(buff, n, c, label, strlen(label));
+            }
+            break;
+        }
+        case SLOW5_STRING:
+            if (v.len == 0) {
+                skim_append(buff, n, c, ".", 1);
+            } else {
+                skim_append(buff, n, c, v.ptr, v.len);
+            }
+            break;
+        default: { // arrays
+            if (v.len == 0) {
+                skim_append(buff, n, c, ".", 1);
+            } else {
+                size_t len;
+                char *str = slow5_data_to_str((uint8_t *) v.ptr, type, v.len, &len);
+                MALLOC_CHK(str);
+                skim_append(buff, n, c, str, len);
+                free(str);
+            }
+            break;
+        }
+    }
+}
+
+#define SKIM_NEED(size) \
+    if (off + (size) > bytes) { \
+        ERROR("Record %d of the batch is truncated or malformed.", i); \
+        exit(EXIT_FAILURE); \
+    }
+
+// decode only what --fields asks for out of a BLOW5 record: record decompression, no signal decompression
+static char *skim_proj_blow5(const skim_proj_t *proj, const char *rec, size_t bytes, int32_t i) {
+    const slow5_hdr_t *header = proj->sp->header;
+    size_t off = 0;
+    skim_val_t primary[SKIM_NUM_PRIMARY];
+
+    uint16_t read_id_len;
+    SKIM_NEED(sizeof read_id_len);
+    memcpy(&read_id_len, rec + off, sizeof read_id_len);
+    off += sizeof read_id_len;
+    SKIM_NEED(read_id_len);
+    primary[SKIM_READ_ID] = { rec + off, read_id_len };
+    off += read_id_len;
+    primary[SKIM_READ_GROUP] = { rec + off, 1 };
+    off += sizeof(uint32_t);
+    primary[SKIM_DIGITISATION] = { rec + off, 1 };
+    off += sizeof(double);
+    primary[SKIM_OFFSET] = { rec + off, 1 };
+    off += sizeof(double);
+    primary[SKIM_RANGE] = { rec + off, 1 };
+    off += sizeof(double);
+    primary[SKIM_SAMPLING_RATE] = { rec + off, 1 };
+    off += sizeof(double);
+    primary[SKIM_LEN_RAW_SIGNAL] = { rec + off, 1 };
+    off += sizeof(uint64_t);
+    SKIM_NEED(0);
+
+    std::vector<skim_val_t> aux(proj->num_aux_needed);
+    if (proj->num_aux_needed > 0) { // step over the signal
+        uint64_t len_raw_signal;
+        memcpy(&len_raw_signal, primary[SKIM_LEN_RAW_SIGNAL].ptr, sizeof len_raw_signal);
+        uint64_t signal_bytes = len_raw_signal * sizeof(int16_t);
+        if (proj->sp->compress->signal_press->method != SLOW5_COMPRESS_NONE) { // compressed signal is prefixed by its size
+            SKIM_NEED(sizeof signal_bytes);
+            memcpy(&signal_bytes, rec + off, sizeof signal_bytes);
+            off += sizeof signal_bytes;
+        }
+        SKIM_NEED(signal_bytes);
+        off += signal_bytes;
+
+        for (uint32_t j = 0; j < proj->num_aux_needed; j++) {
+            enum slow5_aux_type type = header->aux_meta->types[j];
+            uint64_t len = 1;
+            if (type >= SLOW5_INT8_T_ARRAY) { // arrays and strings are prefixed by their length
+                SKIM_NEED(sizeof len);
+                memcpy(&len, rec + off, sizeof len);
+                off += sizeof len;
+            }
+            SKIM_NEED(len * header->aux_meta->sizes[j]);
+            aux[j] = { rec + off, len };
+            off += len * header->aux_meta->sizes[j];
+        }
+    }
+
+    size_t c = 256;
+    size_t n = 0;
+    char *buff = (char *) malloc(c);
+    MALLOC_CHK(buff);
+    for (const skim_col_t &col : proj->cols) {
+        if (col.primary < 0) {
+            skim_append_aux(&buff, &n, &c, header, col.aux, aux[col.aux]);
+            continue;
+        }
+        skim_val_t v = primary[col.primary];
+        char str[32];
+        int len;
+        switch (col.primary) {
+            case SKIM_READ_ID:
+                skim_append(&buff, &n, &c, v.ptr, v.len);
+                break;
+            case SKIM_READ_GROUP: {
+                uint32_t t;
+                memcpy(&t, v.ptr, sizeof t);
+                len = fmt_u64(str, t);
+                skim_append(&buff, &n, &c, str, len);
+                break;
+            }
+            case SKIM_LEN_RAW_SIGNAL: {
+                uint64_t t;
+                memcpy(&t, v.ptr, sizeof t);
+                len = fmt_u64(str, t);
+                skim_append(&buff, &n, &c, str, len);
+                break;
+            }
+            default: { // doubles
+                double t;
+                memcpy(&t, v.ptr, sizeof t);
+                skim_append_double(&buff, &n, &c, t, 0);
+                break;
+            }
+        }
+    }
+    buff[n] = '\n';
+    buff[n + 1] = '\0';
+    return buff;
+}
+
+// pick the requested columns out of a SLOW5 line, nothing is parsed
+static char *skim_proj_slow5(const skim_proj_t *proj, const char *rec, size_t bytes) {
+    std::vector<std::pair<const char *, size_t>> cols;
+    size_t start = 0;
+    for (size_t k = 0; k <= bytes; k++) {
+        if (k == bytes || rec[k] == '\t' || rec[k] == '\n' || rec[k] == '\0') {
+            cols.push_back(std::make_pair(rec + start, k - start));
+            if (k == bytes || rec[k] != '\t') {
+                break;
+            }
+            start = k + 1;
+        }
+    }
+    size_t c = 256;
+    size_t n = 0;
+    char *buff = (char *) malloc(c);
+    MALLOC_CHK(buff);
+    for (const skim_col_t &col : proj->cols) {
+        size_t k = col.primary >= 0 ? (size_t) col.primary : SKIM_ASCII_RAW_SIGNAL_COL + 1 + col.aux;
+        if (k >= cols.size()) {
+            ERROR("A record has fewer columns than the header declares (%zu).", cols.size());
+            exit(EXIT_FAILURE);
+        }
+        skim_append(&buff, &n, &c, cols[k].first, cols[k].second);
+    }
+    buff[n] = '\n';
+    buff[n + 1] = '\0';
+    return buff;
+}
+
+void process_read_proj(core_t *core, db_t *db, int32_t i) {
+    const skim_proj_t *proj = (const skim_proj_t *) core->param;
+    slow5_file_t *sp = proj->sp;
+    char *mem = db->mem_records[i];
+    size_t bytes = db->mem_bytes[i];
+
+    if (sp->format == SLOW5_FORMAT_ASCII) {
+        db->read_record[i].buffer = skim_proj_slow5(proj, mem, bytes);
+    } else if (sp->compress->record_press->method == SLOW5_COMPRESS_NONE) {
+        db->read_record[i].buffer = skim_proj_blow5(proj, mem, bytes, i);
+    } else {
+        size_t n = 0;
+        char *rec = (char *) slow5_ptr_depress(core_press(core)->record_press, mem, bytes, &n); // the press of sp is shared by the threads
+        if (rec == NULL) {
+            ERROR("Could not decompress record %d of the batch.", i);
+            exit(EXIT_FAILURE);
+        }
+        db->read_record[i].buffer = skim_proj_blow5(proj, rec, n, i);
+        free(rec);
+    }
+    if (!db->mapped) { // a mapped record is only read, never copied
+        free(mem);
+    }
+}
+
+/* --arrow: the records of a batch are decoded in parallel, each thread filling row i of the preallocated columns,
+   then the main thread writes the batch as one Arrow record batch */
+
+typedef struct {
+    int32_t primary;        // SKIM_* (or SKIM_RAW_SIGNAL), -1 for an auxiliary field
+    const char *aux;        // name of the auxiliary field
+    enum slow5_aux_type aux_type;
+    enum arrow_type type;
+    uint8_t *values;        // batch_size fixed width values
+    uint8_t *nulls;         // batch_size flags, set by the workers
+    char **var;             // ARROW_UTF8 and ARROW_LARGE_LIST_INT16: a malloc'd copy of each value
+    uint64_t *var_len;      // bytes (ARROW_UTF8) or samples (ARROW_LARGE_LIST_INT16) of each value
+    uint8_t *validity;      // bitmap built from nulls
+    void *offsets;          // built from var_len
+    char *data;             // concatenated var values
+    size_t data_cap;
+} skim_arrow_col_t;
+
+#define SKIM_RAW_SIGNAL SKIM_NUM_PRIMARY
+
+typedef struct {
+    slow5_file_t *sp;
+    std::vector<skim_arrow_col_t> cols;
+    std::vector<arrow_field_t> fields;
+    arrow_writer_t *writer;
+    FILE *fp;
+} skim_arrow_t;
+
+// the Arrow type an auxiliary field is written as, -1 if it is not supported (arrays other than strings)
+static int aux_arrow_type(enum slow5_aux_type type) {
+    switch (type) {
+        case SLOW5_INT8_T: return ARROW_INT8;
+        case SLOW5_INT16_T: return ARROW_INT16;
+        case SLOW5_INT32_T: return ARROW_INT32;
+        case SLOW5_INT64_T: return ARROW_INT64;
+        case SLOW5_UINT8_T: return ARROW_UINT8;
+        case SLOW5_UINT16_T: return ARROW_UINT16;
+        case SLOW5_UINT32_T: return ARROW_UINT32;
+        case SLOW5_UINT64_T: return ARROW_UINT64;
+        case SLOW5_FLOAT: return ARROW_FLOAT;
+        case SLOW5_DOUBLE: return ARROW_DOUBLE;
+        case SLOW5_CHAR:
+        case SLOW5_ENUM: // the label
+        case SLOW5_STRING:
+            return ARROW_UTF8;
+        default:
+            return -1;
+    }
+}
+
+static void skim_arrow_add_col(skim_arrow_t *arrow, const char *name, int32_t primary, const char *aux, enum slow5_aux_type aux_type, enum arrow_type type, int64_t batch_size) {
+    skim_arrow_col_t col;
+    memset(&col, 0, sizeof col);
+    col.primary = primary;
+    col.aux = aux;
+    col.aux_type = aux_type;
+    col.type = type;
+    col.nulls = (uint8_t *) calloc(batch_size, 1);
+    MALLOC_CHK(col.nulls);
+    col.validity = (uint8_t *) malloc((batch_size + 7) / 8);
+    MALLOC_CHK(col.validity);
+    if (arrow_type_width(type)) {
+        col.values = (uint8_t *) malloc(arrow_type_width(type) * batch_size);
+        MALLOC_CHK(col.values);
+    } else {
+        col.var = (char **) calloc(batch_size, sizeof *col.var);
+        MALLOC_CHK(col.var);
+        col.var_len = (uint64_t *) calloc(batch_size, sizeof *col.var_len);
+        MALLOC_CHK(col.var_len);
+        col.offsets = malloc(sizeof(int64_t) * (batch_size + 1));
+        MALLOC_CHK(col.offsets);
+    }
+    arrow->cols.push_back(col);
+    arrow_field_t field = { name, type };
+    arrow->fields.push_back(field);
+}
+
+static void skim_arrow_init(skim_arrow_t *arrow, slow5_file_t *sp, const char *path, int signal, int64_t batch_size) {
+    arrow->sp = sp;
+    const enum arrow_type primary_types[SKIM_NUM_PRIMARY] = {ARROW_UTF8, ARROW_UINT32, ARROW_DOUBLE, ARROW_DOUBLE, ARROW_DOUBLE, ARROW_DOUBLE, ARROW_UINT64};
+    for (int32_t j = 0; j < SKIM_NUM_PRIMARY; j++) {
+        skim_arrow_add_col(arrow, skim_primary_names[j], j, NULL, SLOW5_INT8_T, primary_types[j], batch_size);
+    }
+    if (signal) {
+        skim_arrow_add_col(arrow, "raw_signal", SKIM_RAW_SIGNAL, NULL, SLOW5_INT8_T, ARROW_LARGE_LIST_INT16, batch_size);
+    }
+    slow5_aux_meta_t *aux_meta = sp->header->aux_meta;
+    for (uint32_t j = 0; aux_meta && j < aux_meta->num; j++) {
+        int type = aux_arrow_type(aux_meta->types[j]);
+        if (type < 0) {
+            WARNING("Auxiliary field '%s' is an array, which is not written to the Arrow file.", aux_meta->attrs[j]);
+            continue;
+        }
+        skim_arrow_add_col(arrow, aux_meta->attrs[j], -1, aux_meta->attrs[j], aux_meta->types[j], (enum arrow_type) type, batch_size);
+    }
+
+    arrow->fp = fopen(path, "wb");
+    if (arrow->fp == NULL) {
+        ERROR("Could not open '%s' for writing - %s.", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    arrow->writer = arrow_open(arrow->fp, arrow->fields.data(), (int32_t) arrow->fields.size());
+    if (arrow->writer == NULL) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void skim_arrow_set_var(skim_arrow_col_t *col, int32_t i, const void *src, uint64_t len, size_t elem_size) {
+    col->var[i] = (char *) malloc(len * elem_size + 1);
+    MALLOC_CHK(col->var[i]);
+    memcpy(col->var[i], src, len * elem_size);
+    col->var_len[i] = len;
+}
+
+// row i of an auxiliary column, straight from the record's auxiliary map
+static void skim_arrow_set_aux(const slow5_hdr_t *header, skim_arrow_col_t *col, const slow5_rec_t *rec, int32_t i) {
+    int width = arrow_type_width(col->type);
+    if (width) {
+        memset(col->values + (size_t) width * i, 0, width); // null slots are written as zeros so that the output is deterministic
+    }
+    khint_t pos = rec->aux_map ? kh_get(slow5_s2a, rec->aux_map, col->aux) : 0;
+    if (rec->aux_map == NULL || pos == kh_end(rec->aux_map) || kh_val(rec->aux_map, pos).data == NULL) {
+        col->nulls[i] = 1;
+        return;
+    }
+    const struct slow5_rec_aux_data *d = &kh_val(rec->aux_map, pos);
+    int null = 0;
+    switch (col->aux_type) {
+        case SLOW5_INT8_T: { int8_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_INT8_T_NULL; break; }
+        case SLOW5_INT16_T: { int16_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_INT16_T_NULL; break; }
+        case SLOW5_INT32_T: { int32_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_INT32_T_NULL; break; }
+        case SLOW5_INT64_T: { int64_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_INT64_T_NULL; break; }
+        case SLOW5_UINT8_T: { uint8_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_UINT8_T_NULL; break; }
+        case SLOW5_UINT16_T: { uint16_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_UINT16_T_NULL; break; }
+        case SLOW5_UINT32_T: { uint32_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_UINT32_T_NULL; break; }
+        case SLOW5_UINT64_T: { uint64_t t; memcpy(&t, d->data, sizeof t); null = t == SLOW5_UINT64_T_NULL; break; }
+        case SLOW5_FLOAT: { float t; memcpy(&t, d->data, sizeof t); null = isnan(t); break; }
+        case SLOW5_DOUBLE: { double t; memcpy(&t, d->data, sizeof t); null = isnan(t); break; }
+        case SLOW5_CHAR:
+            null = d->data[0] == '\0';
+            if (!null) {
+                skim_arrow_set_var(col, i, d->data, 1, 1);
+            }
+            break;
+        case SLOW5_ENUM: {
+            uint8_t t = d->data[0];
+            null = t == SLOW5_ENUM_NULL;
+            if (!null) {
+                uint8_t num_label = 0;
+                char **labels = slow5_get_aux_enum_labels(header, col->aux, &num_label);
+                if (labels == NULL || t >= num_label) {
+                    ERROR("Invalid enum value %u of '%s' in read '%s'.", t, col->aux, rec->read_id);
+                    exit(EXIT_FAILURE);
+                }
+                skim_arrow_set_var(col, i, labels[t], strlen(labels[t]), 1);
+            }
+            break;
+        }
+        default: // SLOW5_STRING
+            null = d->len == 0;
+            if (!null) {
+                skim_arrow_set_var(col, i, d->data, d->len, 1);
+            }
+            break;
+    }
+    col->nulls[i] = null;
+    if (!null && width) {
+        memcpy(col->values + (size_t) width * i, d->data, width);
+    }
+}
+
+void process_read_arrow(core_t *core, db_t *db, int32_t i) {
+    struct slow5_rec **read_ptr = core_rec(core); // reused by this thread for every record
+    if (db->mapped) {
+        db_mem_record_own(db, i);
+    }
+    char *record = db->mem_records[i];
+    if (slow5_decode(&record, &db->mem_bytes[i], read_ptr, core->fp) < 0 ) {
+        exit(EXIT_FAILURE);
+    } else {
+        free(record);
+    }
+    const slow5_rec_t *rec = *read_ptr;
+    skim_arrow_t *arrow = (skim_arrow_t *) core->param;
+
+    for (skim_arrow_col_t &col : arrow->cols) {
+        col.nulls[i] = 0;
+        switch (col.primary) {
+            case -1:
+                skim_arrow_set_aux(arrow->sp->header, &col, rec, i);
+                break;
+            case SKIM_READ_ID:
+                skim_arrow_set_var(&col, i, rec->read_id, strlen(rec->read_id), 1);
+                break;
+            case SKIM_READ_GROUP:
+                memcpy(col.values + sizeof(uint32_t) * i, &rec->read_group, sizeof(uint32_t));
+                break;
+            case SKIM_DIGITISATION:
+                memcpy(col.values + sizeof(double) * i, &rec->digitisation, sizeof(double));
+                break;
+            case SKIM_OFFSET:
+                memcpy(col.values + sizeof(double) * i, &rec->offset, sizeof(double));
+                break;
+            case SKIM_RANGE:
+                memcpy(col.values + sizeof(double) * i, &rec->range, sizeof(double));
+                break;
+            case SKIM_SAMPLING_RATE:
+                memcpy(col.values + sizeof(double) * i, &rec->sampling_rate, sizeof(double));
+                break;
+            case SKIM_LEN_RAW_SIGNAL:
+                memcpy(col.values + sizeof(uint64_t) * i, &rec->len_raw_signal, sizeof(uint64_t));
+                break;
+            case SKIM_RAW_SIGNAL:
+                skim_arrow_set_var(&col, i, rec->raw_signal, rec->len_raw_signal, sizeof(int16_t));
+                break;
+        }
+    }
+}
+
+// write the first n rows of the columns as a record batch
+static void skim_arrow_write_batch(skim_arrow_t *arrow, int64_t n) {
+    std::vector<arrow_column_t> out(arrow->cols.size());
+    for (size_t k = 0; k < arrow->cols.size(); k++) {
+        skim_arrow_col_t &col = arrow->cols[k];
+        arrow_column_t &c = out[k];
+        c.null_count = 0;
+        memset(col.validity, 0, (n + 7) / 8);
+        for (int64_t i = 0; i < n; i++) {
+            if (col.nulls[i]) {
+                c.null_count++;
+            } else {
+                col.validity[i / 8] |= (uint8_t) (1 << (i % 8));
+            }
+        }
+        c.validity = col.validity;
+        if (col.var == NULL) {
+            c.values = col.values;
+            c.offsets = NULL;
+            continue;
+        }
+
+        size_t elem_size = col.type == ARROW_UTF8 ? 1 : sizeof(int16_t);
+        uint64_t total = 0;
+        for (int64_t i = 0; i < n; i++) {
+            total += col.var_len[i];
+        }
+        if (col.type == ARROW_UTF8 && total > INT32_MAX) {
+            ERROR("Column '%s' of a batch exceeds 2GB. Use a smaller batch size.", arrow->fields[k].name);
+            exit(EXIT_FAILURE);
+        }
+        if (total * elem_size > col.data_cap) {
+            col.data_cap = total * elem_size;
+            col.data = (char *) realloc(col.data, col.data_cap);
+            MALLOC_CHK(col.data);
+        }
+        uint64_t off = 0;
+        for (int64_t i = 0; i < n; i++) {
+            if (col.type == ARROW_UTF8) {
+                ((int32_t *) col.offsets)[i] = (int32_t) off;
+            } else {
+                ((int64_t *) col.offsets)[i] = (int64_t) off;
+            }
+            if (col.var[i]) {
+                memcpy(col.data + off * elem_size, col.var[i], col.var_len[i] * elem_size);
+                off += col.var_len[i];
+                free(col.var[i]);
+                col.var[i] = NULL;
+                col.var_len[i] = 0;
+            }
+        }
+        if (col.type == ARROW_UTF8) {
+            ((int32_t *) col.offsets)[n] = (int32_t) off;
+        } else {
+            ((int64_t *) col.offsets)[n] = (int64_t) off;
+        }
+        c.values = col.data;
+        c.offsets = col.offsets;
+    }
+    if (arrow_write_batch(arrow->writer, out.data(), n) < 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void skim_arrow_close(skim_arrow_t *arrow) {
+    if (arrow_close(arrow->writer) < 0 || fclose(arrow->fp) != 0) {
+        ERROR("%s", "Writing the Arrow file failed.");
+        exit(EXIT_FAILURE);
+    }
+    for (skim_arrow_col_t &col : arrow->cols) {
+        free(col.values);
+        free(col.nulls);
+        free(col.var);
+        free(col.var_len);
+        free(col.validity);
+        free(col.offsets);
+        free(col.data);
+    }
+}
+
+static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int pin_threads, int use_mmap, int64_t batch_size, const char *fields, const char *arrow_path, int arrow_signal){
     int ret = 0;
     slow5_rec_t *rec = NULL;
 
@@ -344,7 +980,7 @@ static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int64_t batc
     struct aux_print_param p;
     p.sp = sp;
 
-    if(aux!=NULL){
+    if(aux!=NULL && !fields && !arrow_path){ //only the default output uses the print functions
         aux_func = (void ((**)(struct aux_print_param *)))malloc(sizeof(void (*)(struct aux_print_param *))*num_aux);
         MALLOC_CHK(aux_func);
 
@@ -353,11 +989,24 @@ static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int64_t batc
         }
     }
 
-    printf("#read_id\tread_group\tdigitisation\toffset\trange\tsampling_rate\tlen_raw_signal\traw_signal");
-    for(uint64_t i=0; i<num_aux; i++) {
-        printf("\t%s",aux[i]);
+    skim_proj_t proj;
+    skim_arrow_t arrow;
+    if (arrow_path) {
+        skim_arrow_init(&arrow, sp, arrow_path, arrow_signal, batch_size);
+    } else if (fields) {
+        skim_proj_init(&proj, sp, fields);
+        for (size_t i = 0; i < proj.cols.size(); i++) {
+            const skim_col_t &col = proj.cols[i];
+            printf("%s%s", i ? "\t" : "#", col.primary >= 0 ? skim_primary_names[col.primary] : aux[col.aux]);
+        }
+        printf("\n");
+    } else {
+        printf("#read_id\tread_group\tdigitisation\toffset\trange\tsampling_rate\tlen_raw_signal\traw_signal");
+        for(uint64_t i=0; i<num_aux; i++) {
+            printf("\t%s",aux[i]);
+        }
+        printf("\n");
     }
-    printf("\n");
 
     double time_get_to_mem = 0;
     double time_thread_execution = 0;
@@ -370,19 +1019,37 @@ static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int64_t batc
     param.num_aux = num_aux;
     param.aux_func = aux_func;
 
+    // Setup multithreading structures
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = sp;
+    core.param = arrow_path ? (void *) &arrow : fields ? (void *) &proj : (void *) &param;
+    void (*func)(core_t*,db_t*,int) = arrow_path ? process_read_arrow : fields ? process_read_proj : process_read;
+    core.pool = pool_init(core.num_thread, pin_threads);
+    core_rec_init(&core);
+    if (fields && sp->format == SLOW5_FORMAT_BINARY) { // --fields decompresses the records itself
+        core.press_method = {sp->compress->record_press->method, sp->compress->signal_press->method};
+        core_press_init(&core);
+    }
+
+    // the same batch arrays are reused for every batch
+    db_t *db = db_batch_init(batch_size);
+    blow5_mmap_t *map = use_mmap ? blow5_mmap_init(sp) : NULL;
+    db->mapped = map != NULL;
     while(1) {
 
-        db_t db = { 0 };
-        db.mem_records = (char **) malloc(batch_size * sizeof(char*));
-        db.mem_bytes = (size_t *) malloc(batch_size * sizeof(size_t));
-        MALLOC_CHK(db.mem_records);
-        MALLOC_CHK(db.mem_bytes);
         int64_t record_count = 0;
         size_t bytes;
         char *mem = NULL;
         double realtime = slow5_realtime();
         while (record_count < batch_size) {
-            if ((ret = slow5_get_next_bytes(&mem,&bytes,sp)) <0) {
+            if (map) {
+                mem = blow5_mmap_next(map, &bytes);
+                ret = mem ? 0 : slow5_errno;
+            } else {
+                ret = slow5_get_next_bytes(&mem,&bytes,sp);
+            }
+            if (ret <0) {
                 if (slow5_errno != SLOW5_ERR_EOF) {
                     exit(EXIT_FAILURE);
                 } else {
@@ -390,44 +1057,45 @@ static void skim_data_parallel(slow5_file_t* sp,size_t num_threads, int64_t batc
                     break;
                 }
             } else {
-                db.mem_records[record_count] = (char *)mem;
-                db.mem_bytes[record_count] = bytes;
+                db->mem_records[record_count] = (char *)mem;
+                db->mem_bytes[record_count] = bytes;
                 record_count++;
             }
         }
         time_get_to_mem += slow5_realtime() - realtime;
 
         realtime = slow5_realtime();
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = num_threads;
-        core.fp = sp;
-        core.param = &param;
-
-        db.n_batch = record_count;
-        db.read_record = (raw_record_t*) malloc(record_count * sizeof *db.read_record);
-        MALLOC_CHK(db.read_record);
-        work_db(&core,&db,process_read);
+        db->n_batch = record_count;
+        work_db(&core,db,func);
         time_thread_execution += slow5_realtime() - realtime;
 
         realtime = slow5_realtime();
-        for (int64_t i = 0; i < record_count; i++) {
-            char *buff = (char *)db.read_record[i].buffer;
-            printf("%s", buff);
-            free(buff);
+        if (arrow_path) {
+            if (record_count > 0) {
+                skim_arrow_write_batch(&arrow, record_count);
+            }
+        } else {
+            for (int64_t i = 0; i < record_count; i++) {
+                char *buff = (char *)db->read_record[i].buffer;
+                printf("%s", buff);
+                free(buff);
+            }
         }
         time_write += slow5_realtime() - realtime;
 
-        // Free everything
-        free(db.mem_bytes);
-        free(db.mem_records);
-        free(db.read_record);
-
         if(flag_end_of_file == 1){
             break;
         }
 
     }
+    if (arrow_path) {
+        skim_arrow_close(&arrow);
+    }
+    blow5_mmap_free(map);
+    db_batch_free(db);
+    core_rec_free(&core);
+    core_press_free(&core);
+    pool_free(core.pool);
 
     DEBUG("time_get_to_mem\t%.3fs", time_get_to_mem);
     DEBUG("time_skim\t%.3fs", time_thread_execution);
@@ -455,6 +1123,11 @@ int skim_main(int argc, char **argv, struct program_meta *meta){
             {"hdr", no_argument, NULL, 0 }, //2
             {"threads",required_argument,  NULL, 't' }, //3
             {"batchsize",required_argument, NULL, 'K'}, //4
+            {"pin", no_argument, NULL, 0 }, //5
+            {"mmap", no_argument, NULL, 0 }, //6
+            {"fields", required_argument, NULL, 0 }, //7
+            {"arrow", required_argument, NULL, 0 }, //8
+            {"signal", no_argument, NULL, 0 }, //9
             {NULL, 0, NULL, 0 }
     };
 
@@ -466,6 +1139,9 @@ int skim_main(int argc, char **argv, struct program_meta *meta){
     int opt;
     int rid=0;
     int hdr=0;
+    char *fields = NULL;
+    char *arrow_path = NULL;
+    int arrow_signal = 0;
 
     // Parse options
     while ((opt = getopt_long(argc, argv, "ht:K:", long_opts, &longindex)) != -1) {
@@ -493,6 +1169,21 @@ int skim_main(int argc, char **argv, struct program_meta *meta){
                     case 2:
                         hdr = 2;
                         break;
+                    case 5:
+                        user_opts.flag_pin_threads = 1;
+                        break;
+                    case 6:
+                        user_opts.flag_mmap = 1;
+                        break;
+                    case 7:
+                        fields = optarg;
+                        break;
+                    case 8:
+                        arrow_path = optarg;
+                        break;
+                    case 9:
+                        arrow_signal = 1;
+                        break;
                     default:
                         fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                         EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -534,6 +1225,18 @@ int skim_main(int argc, char **argv, struct program_meta *meta){
         ERROR("%s", "Incompatible options: --rid and --hdr cannot be specified together");
         exit(EXIT_FAILURE);
     }
+    if(fields && (rid || hdr)){
+        ERROR("%s", "Incompatible options: --fields cannot be specified with --rid or --hdr");
+        exit(EXIT_FAILURE);
+    }
+    if(arrow_path && (rid || hdr || fields)){
+        ERROR("%s", "Incompatible options: --arrow cannot be specified with --rid, --hdr or --fields");
+        exit(EXIT_FAILURE);
+    }
+    if(arrow_signal && !arrow_path){
+        ERROR("%s", "--signal is only valid with --arrow");
+        exit(EXIT_FAILURE);
+    }
 
     slow5_file_t* slow5File = slow5_open(argv[optind], "r");
     if(!slow5File){
@@ -548,7 +1251,7 @@ int skim_main(int argc, char **argv, struct program_meta *meta){
         print_hdr(slow5File);
     }
     else {
-        skim_data_parallel(slow5File, user_opts.num_threads, user_opts.read_id_batch_capacity);
+        skim_data_parallel(slow5File, user_opts.num_threads, user_opts.flag_pin_threads, user_opts.flag_mmap, user_opts.read_id_batch_capacity, fields, arrow_path, arrow_signal);
     }
 
     slow5_close(slow5File);
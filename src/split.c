@@ -37,12 +37,14 @@
     "    -u, --demux-uniq [STR]        multi-category reads to category named STR\n" \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
     HELP_MSG_LOSSLESS \
     HELP_MSG_HELP \
     HELP_FORMATS_METHODS
 
 extern int slow5tools_verbosity_level;
 static double init_realtime = 0;
+static core_t *split_core = NULL; //worker threads and compression contexts shared by all the batches of all the input files
 
 enum SplitMethod {
     READS_SPLIT,
@@ -80,33 +82,26 @@ int create_output_slow5(slow5_file_t *input_slow5_file_i, slow5_file_t *&slow5_f
 
 void split_thread_func(core_t *core, db_t *db, int32_t i) {
     //
-    struct slow5_rec *read = NULL;
-    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, &read, core->fp) != 0) {
+    struct slow5_rec **read_ptr = core_rec(core); // reused by this thread for every record
+    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, read_ptr, core->fp) != 0) {
         ERROR("Could not decompress the slow5 record%s","");
         exit(EXIT_FAILURE);
     } else {
         free(db->mem_records[i]);
     }
+    struct slow5_rec *read = *read_ptr;
     db->read_group_vector[i] = read->read_group;
     read->read_group = 0;
-    struct slow5_press *press_ptr = slow5_press_init(core->press_method);
-    if(!press_ptr){
-        ERROR("Could not initialize the slow5 compression method%s","");
-        exit(EXIT_FAILURE);
-    }
+    struct slow5_press *press_ptr = core_press(core);
     size_t len;
     slow5_aux_meta_t *aux_meta = core->aux_meta;
     if(core->lossy){
         aux_meta = NULL;
     }
     if ((db->read_record[i].buffer = slow5_rec_to_mem(read, aux_meta, core->format_out, press_ptr, &len)) == NULL) {
-        slow5_press_free(press_ptr);
-        slow5_rec_free(read);
         exit(EXIT_FAILURE);
     }
-    slow5_press_free(press_ptr);
     db->read_record[i].len = len;
-    slow5_rec_free(read);
 }
 
 int split_main(int argc, char **argv, struct program_meta *meta){
@@ -141,6 +136,7 @@ int split_main(int argc, char **argv, struct program_meta *meta){
             {"demux-rid",     required_argument, NULL, 0}, //14
             {"demux-uniq",    required_argument, NULL, 'u'}, //15
             {"demux-missing", required_argument, NULL, 'm'}, //16
+            {"pin",           no_argument, NULL, 0}, //17
             {NULL, 0, NULL, 0 }
     };
 
@@ -223,6 +219,9 @@ int split_main(int argc, char **argv, struct program_meta *meta){
                 } else if (!strcmp(lopt, "demux-rid")) {
                     meta_split_method_object.bs_meta.rid_hdr = optarg;
                     break;
+                } else if (!strcmp(lopt, "pin")) {
+                    user_opts.flag_pin_threads = 1;
+                    break;
                 }
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
@@ -303,6 +302,13 @@ int split_main(int argc, char **argv, struct program_meta *meta){
     }
 
     int ret_split_func = split_func(slow5_files_input, user_opts, meta_split_method_object);
+    if (split_core) {
+        core_rec_free(split_core);
+        core_press_free(split_core);
+        pool_free(split_core->pool);
+        free(split_core);
+        split_core = NULL;
+    }
     if(ret_split_func){
         ERROR("Failed to split%s", "");
         return EXIT_FAILURE;
@@ -462,13 +468,31 @@ int multi_threaded_split_execution(std::basic_string<char> &input_slow5_path, op
 
     int64_t record_count = *record_count_ptr;
     int flag_EOF = *flag_EOF_ptr;
+
+    // Setup multithreading structures
+    if (!split_core) {
+        split_core = (core_t *) calloc(1, sizeof *split_core);
+        MALLOC_CHK(split_core);
+        split_core->num_thread = user_opts.num_threads;
+        split_core->format_out = user_opts.fmt_out;
+        split_core->press_method = press_out;
+        split_core->lossy = user_opts.flag_lossy;
+        split_core->pool = pool_init(split_core->num_thread, user_opts.flag_pin_threads);
+        core_press_init(split_core);
+    }
+    // parsed records are only reused within this call, records of another input file may have different auxiliary fields
+    core_rec_free(split_core);
+    core_rec_init(split_core);
+    split_core->fp = input_slow5_file_i;
+    split_core->aux_meta = output_slow5_files[0]->header->aux_meta;
+
+    // the same batch arrays are reused for every batch
+    int64_t batch_size = (user_opts.read_id_batch_capacity<read_limit)?user_opts.read_id_batch_capacity:read_limit;
+    db_t *db = db_batch_init(batch_size);
+    db->read_group_vector = (uint32_t *) malloc(batch_size * sizeof(uint32_t));
+    MALLOC_CHK(db->read_group_vector);
+
     while(record_count<read_limit){
-        int64_t batch_size = (user_opts.read_id_batch_capacity<read_limit)?user_opts.read_id_batch_capacity:read_limit;
-        db_t db = {0};
-        db.mem_records = (char **) malloc(batch_size * sizeof(char *));
-        db.mem_bytes = (size_t *) malloc(batch_size * sizeof(size_t));
-        MALLOC_CHK(db.mem_records);
-        MALLOC_CHK(db.mem_bytes);
         int64_t record_count_local = 0;
         size_t bytes;
         char *mem;
@@ -482,43 +506,38 @@ int multi_threaded_split_execution(std::basic_string<char> &input_slow5_path, op
                     break;
                 }
             } else {
-                db.mem_records[record_count_local] = mem;
-                db.mem_bytes[record_count_local] = bytes;
+                db->mem_records[record_count_local] = mem;
+                db->mem_bytes[record_count_local] = bytes;
                 record_count_local++;
                 record_count++;
             }
         }
 
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = user_opts.num_threads;
-        core.fp = input_slow5_file_i;
-        core.aux_meta = output_slow5_files[0]->header->aux_meta;
-        core.format_out = user_opts.fmt_out;
-        core.press_method = press_out;
-        core.lossy = user_opts.flag_lossy;
-
-        db.read_group_vector = (uint32_t *) malloc(record_count_local * sizeof(uint32_t));
-        MALLOC_CHK(db.read_group_vector);
-        db.n_batch = record_count_local;
-        db.read_record = (raw_record_t *) malloc(record_count_local * sizeof *db.read_record);
-        MALLOC_CHK(db.read_record);
-        work_db(&core, &db, split_thread_func);
+        db->n_batch = record_count_local;
+        work_db(split_core, db, split_thread_func);
 
+        // consecutive records going to the same output file are written together
+        int64_t start = 0;
+        for (int64_t i = 1; i <= record_count_local; i++) {
+            if (i == record_count_local || db->read_group_vector[i] != db->read_group_vector[start]) {
+                if (raw_records_fwrite(output_slow5_files[db->read_group_vector[start]]->fp, db->read_record + start, i - start) != 0) {
+                    ERROR("Could not write to the output file - %s", strerror(errno));
+                    return -1;
+                }
+                start = i;
+            }
+        }
         for (int64_t i = 0; i < record_count_local; i++) {
-            fwrite(db.read_record[i].buffer, 1, db.read_record[i].len, output_slow5_files[db.read_group_vector[i]]->fp);
-            free(db.read_record[i].buffer);
+            free(db->read_record[i].buffer);
         }
-        // Free everything
-        free(db.mem_bytes);
-        free(db.mem_records);
-        free(db.read_record);
-        free(db.read_group_vector);
 
         if(flag_EOF){
             break;
         }
     }
+    // Free everything
+    free(db->read_group_vector);
+    db_batch_free(db);
     *flag_EOF_ptr = flag_EOF;
     *record_count_ptr = record_count;
 
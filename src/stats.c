@@ -7,13 +7,19 @@
 
 #include <getopt.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include "error.h"
 #include "cmd.h"
 #include "slow5_extra.h"
 #include "read_fast5.h"
 #include "misc.h"
 #include <slow5/slow5_press.h>
+#include "slow5_idx.h"
+#include "thread.h"
 
 
 #define USAGE_MSG "Usage: %s [SLOW5_FILE]\n"
@@ -23,10 +29,299 @@
     "\n" \
     "OPTIONS:\n" \
     "    -h, --help         display this message and exit\n" \
+    "    --mmap             memory map the BLOW5 file to count the records\n" \
+    "    --deep             decode every record and print signal length, N50, per read group, channel and end_reason counts\n" \
+    "    -t, --threads INT  number of threads for --deep [" TO_STR(DEFAULT_NUM_THREADS) "]\n" \
+    "    -K, --batchsize INT number of records loaded to the memory at once for --deep [" TO_STR(DEFAULT_BATCH_SIZE) "]\n" \
 
 
 extern int slow5tools_verbosity_level;
 
+// number of records from the index of the file, -1 if there is no index or it is older than the file
+static int64_t count_records_idx(slow5_file_t *sp, const char *pathname) {
+    char *idx_pathname = slow5_get_idx_path(pathname);
+    struct stat st_file, st_idx;
+    int usable = idx_pathname && stat(idx_pathname, &st_idx) == 0 && stat(pathname, &st_file) == 0 && st_idx.st_mtime >= st_file.st_mtime;
+    free(idx_pathname);
+    if (!usable || slow5_idx_load(sp) < 0) {
+        return -1;
+    }
+    return sp->index->num_ids;
+}
+
+// count BLOW5 records by seeking over them using their size prefixes, nothing is read or decompressed but the prefixes
+static int64_t count_records_blow5(slow5_file_t *sp) {
+    const char eof[] = SLOW5_BINARY_EOF;
+    int64_t record_count = 0;
+    while (1) {
+        char buf[sizeof(slow5_rec_size_t)];
+        size_t n = fread(buf, 1, sizeof buf, sp->fp);
+        if (n == sizeof eof && memcmp(buf, eof, sizeof eof) == 0) {
+            return record_count;
+        }
+        slow5_rec_size_t size;
+        if (n != sizeof size) {
+            return -1;
+        }
+        memcpy(&size, buf, sizeof size);
+        if (fseeko(sp->fp, size, SEEK_CUR) != 0) {
+            return -1;
+        }
+        record_count++;
+    }
+}
+
+static int64_t count_records_mmap(blow5_mmap_t *map) {
+    int64_t record_count = 0;
+    size_t bytes;
+    while (blow5_mmap_next(map, &bytes)) {
+        record_count++;
+    }
+    return slow5_errno == SLOW5_ERR_EOF ? record_count : -1;
+}
+
+static int64_t count_records_slow5(slow5_file_t *sp) {
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while ((mem = (char *) slow5_get_next_mem(&bytes, sp))) {
+        free(mem);
+        record_count++;
+    }
+    return slow5_errno == SLOW5_ERR_EOF ? record_count : -1;
+}
+
+/* --deep: per thread accumulators, reduced once all the records are decoded */
+typedef struct {
+    uint64_t n_records;
+    uint64_t n_samples;
+    std::vector<uint64_t> read_lens;            // len_raw_signal of every record, for N50
+    std::vector<uint64_t> rg_records;           // indexed by read group
+    std::vector<uint64_t> rg_samples;
+    std::map<int64_t, uint64_t> channel_records; // by channel_number
+    std::vector<uint64_t> end_reason_records;   // indexed by the end_reason enum value
+} stats_deep_t;
+
+typedef struct {
+    slow5_file_t *sp;
+    int64_t batch_size;
+    int flag_end_of_file;
+    int ret;
+    int has_channel;            // channel_number is a string auxiliary field
+    uint8_t n_end_reasons;      // number of end_reason enum labels (0 if there is no such field)
+    stats_deep_t *acc;          // one per thread
+} stats_deep_arg_t;
+
+static db_t *stats_deep_read_batch(core_t *core, db_t *db, void *arg) {
+    stats_deep_arg_t *da = (stats_deep_arg_t *) arg;
+    if (da->flag_end_of_file) {
+        return NULL;
+    }
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = db_batch_init(da->batch_size);
+    }
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while (record_count < da->batch_size) {
+        if (!(mem = (char *) slow5_get_next_mem(&bytes, da->sp))) {
+            if (slow5_errno != SLOW5_ERR_EOF) {
+                ERROR("Reading the records failed.%s", "");
+                da->ret = EXIT_FAILURE;
+            }
+            da->flag_end_of_file = 1;
+            break;
+        }
+        db->mem_records[record_count] = mem;
+        db->mem_bytes[record_count] = bytes;
+        record_count++;
+    }
+    if (record_count == 0 || da->ret != 0) {
+        for (int64_t i = 0; i < record_count; i++) {
+            free(db->mem_records[i]);
+        }
+        if (new_db) {
+            db_batch_free(new_db);
+        }
+        return NULL;
+    }
+    db->n_batch = record_count;
+    return db;
+}
+
+// decode a record and add it to the accumulator of the calling thread
+static void stats_deep_rec(core_t *core, db_t *db, int32_t i) {
+    stats_deep_arg_t *da = (stats_deep_arg_t *) core->param;
+    stats_deep_t *acc = &da->acc[work_thread_index()];
+    struct slow5_rec **read = core_rec(core);
+    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, read, core->fp) != 0) {
+        ERROR("Could not decode record %d of the batch.", i);
+        exit(EXIT_FAILURE);
+    }
+    free(db->mem_records[i]);
+    const slow5_rec_t *rec = *read;
+
+    acc->n_records++;
+    acc->n_samples += rec->len_raw_signal;
+    acc->read_lens.push_back(rec->len_raw_signal);
+    if (rec->read_group < acc->rg_records.size()) {
+        acc->rg_records[rec->read_group]++;
+        acc->rg_samples[rec->read_group] += rec->len_raw_signal;
+    }
+
+    int err;
+    if (da->has_channel) {
+        uint64_t len;
+        const char *channel = slow5_aux_get_string(rec, "channel_number", &len, &err);
+        if (err == 0 && channel && len > 0) { // not null terminated
+            int64_t channel_number = 0;
+            uint64_t j = 0;
+            for (; j < len && channel[j] >= '0' && channel[j] <= '9'; j++) {
+                channel_number = channel_number * 10 + (channel[j] - '0');
+            }
+            if (j == len) {
+                acc->channel_records[channel_number]++;
+            }
+        }
+    }
+    if (da->n_end_reasons) {
+        uint8_t end_reason = slow5_aux_get_enum(rec, "end_reason", &err);
+        if (err == 0 && end_reason < da->n_end_reasons) {
+            acc->end_reason_records[end_reason]++;
+        }
+    }
+}
+
+static int stats_deep_write_batch(core_t *core, db_t *db, void *arg) {
+    db->n_batch = 0; // the records were consumed by stats_deep_rec
+    return 0;
+}
+
+// decode all the records with num_threads threads and print the deep statistics, returns the number of records or -1 on error
+static int64_t stats_deep(slow5_file_t *sp, int32_t num_threads, int64_t batch_size) {
+    slow5_hdr_t *header = sp->header;
+    int32_t n_acc = num_threads > 1 ? num_threads : 1;
+
+    stats_deep_arg_t da;
+    da.sp = sp;
+    da.batch_size = batch_size;
+    da.flag_end_of_file = 0;
+    da.ret = 0;
+    da.has_channel = 0;
+    da.n_end_reasons = 0;
+    uint32_t aux_index;
+    if (header->aux_meta && check_aux_fields_in_header(header, "channel_number", 0, &aux_index) == 0) {
+        da.has_channel = header->aux_meta->types[aux_index] == SLOW5_STRING;
+    }
+    const char **end_reason_labels = NULL;
+    if (header->aux_meta && check_aux_fields_in_header(header, "end_reason", 0, &aux_index) == 0 && header->aux_meta->types[aux_index] == SLOW5_ENUM) {
+        end_reason_labels = (const char **) slow5_get_aux_enum_labels(header, "end_reason", &da.n_end_reasons);
+        if (!end_reason_labels) {
+            da.n_end_reasons = 0;
+        }
+    }
+    std::vector<stats_deep_t> acc(n_acc);
+    for (stats_deep_t &a : acc) {
+        a.n_records = 0;
+        a.n_samples = 0;
+        a.rg_records.assign(header->num_read_groups, 0);
+        a.rg_samples.assign(header->num_read_groups, 0);
+        a.end_reason_records.assign(da.n_end_reasons, 0);
+    }
+    da.acc = acc.data();
+
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = sp;
+    core.pool = pool_init(core.num_thread, 0);
+    core.param = &da;
+    core_rec_init(&core);
+
+    pipeline_t pl = { 0 };
+    pl.read_db = stats_deep_read_batch;
+    pl.func = stats_deep_rec;
+    pl.write_db = stats_deep_write_batch;
+    pl.arg = &da;
+    pl.depth = PIPELINE_DEPTH;
+    int ret = pipeline_db(&core, &pl);
+    core_rec_free(&core);
+    pool_free(core.pool);
+
+    DEBUG("time_read\t%.3fs", pl.time_read);
+    DEBUG("time_decode\t%.3fs", pl.time_work);
+
+    if (ret != 0 || da.ret != 0) {
+        return -1;
+    }
+
+    // reduce the per thread accumulators into the first one
+    stats_deep_t &total = acc[0];
+    for (int32_t t = 1; t < n_acc; t++) {
+        total.n_records += acc[t].n_records;
+        total.n_samples += acc[t].n_samples;
+        total.read_lens.insert(total.read_lens.end(), acc[t].read_lens.begin(), acc[t].read_lens.end());
+        for (uint32_t g = 0; g < header->num_read_groups; g++) {
+            total.rg_records[g] += acc[t].rg_records[g];
+            total.rg_samples[g] += acc[t].rg_samples[g];
+        }
+        for (const auto &c : acc[t].channel_records) {
+            total.channel_records[c.first] += c.second;
+        }
+        for (uint8_t e = 0; e < da.n_end_reasons; e++) {
+            total.end_reason_records[e] += acc[t].end_reason_records[e];
+        }
+        std::vector<uint64_t>().swap(acc[t].read_lens);
+    }
+
+    uint64_t max_len = 0;
+    uint64_t n50 = 0;
+    if (!total.read_lens.empty()) {
+        std::sort(total.read_lens.begin(), total.read_lens.end(), std::greater<uint64_t>());
+        max_len = total.read_lens[0];
+        uint64_t sum = 0;
+        for (uint64_t len : total.read_lens) {
+            sum += len;
+            if (2 * sum >= total.n_samples) {
+                n50 = len;
+                break;
+            }
+        }
+    }
+
+    fprintf(stdout, "total number of samples\t%" PRIu64 "\n", total.n_samples);
+    fprintf(stdout, "mean read length (samples)\t%.1f\n", total.n_records ? (double) total.n_samples / total.n_records : 0.0);
+    fprintf(stdout, "max read length (samples)\t%" PRIu64 "\n", max_len);
+    fprintf(stdout, "N50 read length (samples)\t%" PRIu64 "\n", n50);
+    fprintf(stdout, "records per read group\t");
+    for (uint32_t g = 0; g < header->num_read_groups; g++) {
+        fprintf(stdout, "%s%u:%" PRIu64, g ? "," : "", g, total.rg_records[g]);
+    }
+    fprintf(stdout, "\n");
+    fprintf(stdout, "samples per read group\t");
+    for (uint32_t g = 0; g < header->num_read_groups; g++) {
+        fprintf(stdout, "%s%u:%" PRIu64, g ? "," : "", g, total.rg_samples[g]);
+    }
+    fprintf(stdout, "\n");
+    if (da.has_channel) {
+        fprintf(stdout, "records per channel\t");
+        int first = 1;
+        for (const auto &c : total.channel_records) {
+            fprintf(stdout, "%s%" PRId64 ":%" PRIu64, first ? "" : ",", c.first, c.second);
+            first = 0;
+        }
+        fprintf(stdout, "\n");
+    }
+    if (da.n_end_reasons) {
+        fprintf(stdout, "records per end_reason\t");
+        for (uint8_t e = 0; e < da.n_end_reasons; e++) {
+            fprintf(stdout, "%s%s:%" PRIu64, e ? "," : "", end_reason_labels[e], total.end_reason_records[e]);
+        }
+        fprintf(stdout, "\n");
+    }
+    return total.n_records;
+}
+
 int stats_main(int argc, char **argv, struct program_meta *meta){
 
     // Debug: print arguments
@@ -64,15 +359,23 @@ int stats_main(int argc, char **argv, struct program_meta *meta){
 
     static struct option long_opts[] = {
             {"help", no_argument, NULL, 'h' }, //0
+            {"mmap", no_argument, NULL, 0 }, //1
+            {"deep", no_argument, NULL, 0 }, //2
+            {"threads", required_argument, NULL, 't' }, //3
+            {"batchsize", required_argument, NULL, 'K' }, //4
             {NULL, 0, NULL, 0 }
     };
 
     // Input arguments
     int longindex = 0;
     int opt;
+    int flag_mmap = 0;
+    int flag_deep = 0;
+    opt_t user_opts;
+    init_opt(&user_opts);
 
     // Parse options
-    while ((opt = getopt_long(argc, argv, "h", long_opts, &longindex)) != -1) {
+    while ((opt = getopt_long(argc, argv, "ht:K:", long_opts, &longindex)) != -1) {
         DEBUG("opt='%c', optarg=\"%s\", optind=%d, opterr=%d, optopt='%c'",
                   opt, optarg, optind, opterr, optopt);
         switch (opt) {
@@ -82,12 +385,33 @@ int stats_main(int argc, char **argv, struct program_meta *meta){
 
                 EXIT_MSG(EXIT_SUCCESS, argv, meta);
                 exit(EXIT_SUCCESS);
+            case 't':
+                user_opts.arg_num_threads = optarg;
+                break;
+            case 'K':
+                user_opts.arg_batch = optarg;
+                break;
+            case 0:
+                if (longindex == 1) {
+                    flag_mmap = 1;
+                } else if (longindex == 2) {
+                    flag_deep = 1;
+                }
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
                 return EXIT_FAILURE;
         }
     }
+    if(parse_num_threads(&user_opts,argc,argv,meta) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
+    if(parse_batch_size(&user_opts,argc,argv) < 0){
+        EXIT_MSG(EXIT_FAILURE, argv, meta);
+        return EXIT_FAILURE;
+    }
     fprintf(stdout,"file path\t%s\n", argv[optind]);
 
     slow5_file_t* slow5File = slow5_open(argv[optind], "r");
@@ -154,19 +478,34 @@ int stats_main(int argc, char **argv, struct program_meta *meta){
 
     VERBOSE("counting number of slow5 records...%s","");
 
-    int64_t record_count = 0;
-    size_t bytes;
-    char *mem;
-    double time_get_to_mem = slow5_realtime();
-    while ((mem = (char *) slow5_get_next_mem(&bytes, slow5File))) {
-        free(mem);
-        record_count++;
+    double time_count = slow5_realtime();
+    int64_t record_count = -1;
+    const char *count_method = "index";
+    if (flag_deep) {
+        count_method = "deep";
+        record_count = stats_deep(slow5File, user_opts.num_threads, user_opts.read_id_batch_capacity);
+    } else if (!flag_mmap) {
+        record_count = count_records_idx(slow5File, argv[optind]);
+    }
+    if (record_count < 0 && !flag_deep) {
+        blow5_mmap_t *map = flag_mmap ? blow5_mmap_init(slow5File) : NULL;
+        if (map) {
+            count_method = "mmap";
+            record_count = count_records_mmap(map);
+            blow5_mmap_free(map);
+        } else if (slow5File->format == SLOW5_FORMAT_BINARY) {
+            count_method = "size prefixes";
+            record_count = count_records_blow5(slow5File);
+        } else {
+            count_method = "records";
+            record_count = count_records_slow5(slow5File);
+        }
     }
-    if (slow5_errno != SLOW5_ERR_EOF) {
+    if (record_count < 0) {
         ERROR("Error reading the file.%s","");
         return EXIT_FAILURE;
     }
-    DEBUG("time_get_to_mem\t%.3fs", slow5_realtime()-time_get_to_mem);
+    DEBUG("time_count (%s)\t%.3fs", count_method, slow5_realtime()-time_count);
 
     slow5_close(slow5File);
 
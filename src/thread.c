@@ -5,6 +5,13 @@
  * @date 27/02/2021
  */
 #include "thread.h"
+#include "misc.h"
+#include <limits.h>
+#include <sys/uio.h>
+
+extern int slow5tools_verbosity_level;
+
+static __thread int32_t thread_index = 0; //set by the worker threads, stays 0 on the calling thread
 
 /**********************************
  * what you may have to modify *
@@ -37,11 +44,11 @@ static inline int32_t steal_work(pthread_arg_t* all_args, int32_t n_threads) {
 }
 
 
-void* pthread_single(void* voidargs) {
+static void run_work(pthread_arg_t* args) {
     int32_t i;
-    pthread_arg_t* args = (pthread_arg_t*)voidargs;
     db_t* db = args->db;
     core_t* core = args->core;
+    thread_index = args->thread_index;
 
 #ifndef WORK_STEAL
     for (i = args->starti; i < args->endi; i++) {
@@ -61,23 +68,21 @@ void* pthread_single(void* voidargs) {
 		args->func(core,db,i);
     }
 #endif
+}
+
+void* pthread_single(void* voidargs) {
+    pthread_arg_t* args = (pthread_arg_t*)voidargs;
+    run_work(args);
 
     //fprintf(stderr,"Thread %d done\n",(myargs->position)/THREADS);
     pthread_exit(0);
 }
 
-void pthread_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
-    //create threads
-    pthread_t tids[core->num_thread];
-    pthread_arg_t pt_args[core->num_thread];
-    int32_t t, ret;
+//split the batch evenly among the threads
+static void set_pthread_args(pthread_arg_t* pt_args, int32_t num_thread, core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)) {
+    int32_t t;
     int32_t i = 0;
-    int32_t num_thread = core->num_thread;
     int32_t step = (db->n_batch + num_thread - 1) / num_thread;
-    //todo : check for higher num of threads than the data
-    //current works but many threads are created despite
-
-    //set the data structures
     for (t = 0; t < num_thread; t++) {
         pt_args[t].core = core;
         pt_args[t].db = db;
@@ -89,13 +94,30 @@ void pthread_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
             pt_args[t].endi = i;
         }
         pt_args[t].func=func;
+        pt_args[t].thread_index = t;
     #ifdef WORK_STEAL
         pt_args[t].all_pthread_args =  (void *)pt_args;
     #endif
         //fprintf(stderr,"t%d : %d-%d\n",t,pt_args[t].starti,pt_args[t].endi);
+    }
+}
 
+void pthread_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
+    if (core->pool && core->pool->num_thread == core->num_thread) {
+        pool_db(core->pool, core, db, func);
+        return;
     }
 
+    //create threads
+    pthread_t tids[core->num_thread];
+    pthread_arg_t pt_args[core->num_thread];
+    int32_t t, ret;
+    //todo : check for higher num of threads than the data
+    //current works but many threads are created despite
+
+    //set the data structures
+    set_pthread_args(pt_args, core->num_thread, core, db, func);
+
     //create threads
     for(t = 0; t < core->num_thread; t++){
         ret = pthread_create(&tids[t], NULL, pthread_single,
@@ -110,6 +132,117 @@ void pthread_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
     }
 }
 
+static void* pool_worker(void* voidargs) {
+    pthread_arg_t* args = (pthread_arg_t*)voidargs;
+    pool_t* pool = args->pool;
+    int64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->batch == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->batch;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_work(args);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_exit(0);
+}
+
+static void pin_thread(pthread_t tid, int32_t t) {
+#ifdef __linux__
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu <= 0) {
+        return;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(t % ncpu, &cpuset);
+    int ret = pthread_setaffinity_np(tid, sizeof cpuset, &cpuset);
+    if (ret != 0) {
+        WARNING("Could not pin thread %d to CPU %ld - %s.", t, t % ncpu, strerror(ret));
+    }
+#else
+    if (t == 0) {
+        WARNING("%s", "Pinning threads to CPUs is only supported on Linux. Ignoring.");
+    }
+#endif
+}
+
+pool_t* pool_init(int32_t num_thread, int pin) {
+    if (num_thread <= 1) {
+        return NULL;
+    }
+    pool_t* pool = (pool_t*) calloc(1, sizeof *pool);
+    MALLOC_CHK(pool);
+    pool->num_thread = num_thread;
+    pool->tids = (pthread_t*) malloc(num_thread * sizeof *pool->tids);
+    MALLOC_CHK(pool->tids);
+    pool->pt_args = (pthread_arg_t*) calloc(num_thread, sizeof *pool->pt_args);
+    MALLOC_CHK(pool->pt_args);
+
+    int ret = pthread_mutex_init(&pool->lock, NULL);
+    NEG_CHK(ret);
+    ret = pthread_cond_init(&pool->start, NULL);
+    NEG_CHK(ret);
+    ret = pthread_cond_init(&pool->done, NULL);
+    NEG_CHK(ret);
+
+    for (int32_t t = 0; t < num_thread; t++) {
+        pool->pt_args[t].pool = pool;
+        pool->pt_args[t].thread_index = t;
+        ret = pthread_create(&pool->tids[t], NULL, pool_worker, (void*)(&pool->pt_args[t]));
+        NEG_CHK(ret);
+        if (pin) {
+            pin_thread(pool->tids[t], t);
+        }
+    }
+    return pool;
+}
+
+void pool_db(pool_t* pool, core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)) {
+    pthread_mutex_lock(&pool->lock);
+    //workers are all idle here, safe to reset their arguments
+    set_pthread_args(pool->pt_args, pool->num_thread, core, db, func);
+    pool->busy = pool->num_thread;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int32_t t = 0; t < pool->num_thread; t++) {
+        int ret = pthread_join(pool->tids[t], NULL);
+        NEG_CHK(ret);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->pt_args);
+    free(pool->tids);
+    free(pool);
+}
+
 /* process all reads in the given batch db */
 void work_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
 
@@ -125,3 +258,314 @@ void work_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
         pthread_db(core,db,func);
     }
 }
+
+int32_t work_thread_index(void) {
+    return thread_index;
+}
+
+void core_press_init(core_t* core) {
+    int32_t n = core->num_thread > 1 ? core->num_thread : 1;
+    core->press_ptrs = (struct slow5_press**) calloc(n, sizeof *core->press_ptrs);
+    MALLOC_CHK(core->press_ptrs);
+    for (int32_t t = 0; t < n; t++) {
+        core->press_ptrs[t] = slow5_press_init(core->press_method);
+        if (!core->press_ptrs[t]) {
+            ERROR("Could not initialize the slow5 compression method%s","");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void core_press_free(core_t* core) {
+    if (core->press_ptrs == NULL) {
+        return;
+    }
+    int32_t n = core->num_thread > 1 ? core->num_thread : 1;
+    for (int32_t t = 0; t < n; t++) {
+        slow5_press_free(core->press_ptrs[t]);
+    }
+    free(core->press_ptrs);
+    core->press_ptrs = NULL;
+}
+
+struct slow5_press* core_press(core_t* core) {
+    return core->press_ptrs[thread_index];
+}
+
+void core_rec_init(core_t* core) {
+    int32_t n = core->num_thread > 1 ? core->num_thread : 1;
+    core->rec_ptrs = (slow5_rec_t**) calloc(n, sizeof *core->rec_ptrs);
+    MALLOC_CHK(core->rec_ptrs);
+}
+
+void core_rec_free(core_t* core) {
+    if (core->rec_ptrs == NULL) {
+        return;
+    }
+    int32_t n = core->num_thread > 1 ? core->num_thread : 1;
+    for (int32_t t = 0; t < n; t++) {
+        slow5_rec_free(core->rec_ptrs[t]);
+    }
+    free(core->rec_ptrs);
+    core->rec_ptrs = NULL;
+}
+
+slow5_rec_t** core_rec(core_t* core) {
+    return &core->rec_ptrs[thread_index];
+}
+
+db_t* db_batch_init(int64_t cap) {
+    db_t* db = (db_t*) calloc(1, sizeof *db);
+    MALLOC_CHK(db);
+    db->capacity = cap;
+    db->mem_records = (char**) malloc(cap * sizeof *db->mem_records);
+    MALLOC_CHK(db->mem_records);
+    db->mem_bytes = (size_t*) malloc(cap * sizeof *db->mem_bytes);
+    MALLOC_CHK(db->mem_bytes);
+    db->read_record = (raw_record_t*) malloc(cap * sizeof *db->read_record);
+    MALLOC_CHK(db->read_record);
+    return db;
+}
+
+void db_batch_free(db_t* db) {
+    free(db->mem_records);
+    free(db->mem_bytes);
+    free(db->read_record);
+    free(db);
+}
+
+void db_mem_record_own(db_t* db, int32_t i) {
+    char* mem = (char*) malloc(db->mem_bytes[i]);
+    MALLOC_CHK(mem);
+    memcpy(mem, db->mem_records[i], db->mem_bytes[i]);
+    db->mem_records[i] = mem;
+}
+
+void queue_init(queue_t* q, int32_t cap) {
+    q->items = (void **) malloc(cap * sizeof *q->items);
+    MALLOC_CHK(q->items);
+    q->cap = cap;
+    q->head = 0;
+    q->count = 0;
+    q->closed = 0;
+    int ret = pthread_mutex_init(&q->lock, NULL);
+    NEG_CHK(ret);
+    ret = pthread_cond_init(&q->not_empty, NULL);
+    NEG_CHK(ret);
+    ret = pthread_cond_init(&q->not_full, NULL);
+    NEG_CHK(ret);
+}
+
+/* blocks while the queue is full */
+void queue_push(queue_t* q, void* item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->cap) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->items[(q->head + q->count) % q->cap] = item;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* blocks while the queue is empty, returns NULL once the queue is closed and drained */
+void* queue_pop(queue_t* q) {
+    void *item = NULL;
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    if (q->count > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+int raw_records_fwrite(FILE* fp, const raw_record_t* records, int64_t n) {
+    size_t total = 0;
+    for (int64_t i = 0; i < n; i++) {
+        total += records[i].len;
+    }
+
+    //small batches are cheaper through the stdio buffer
+    if (total < WRITEV_MIN_BYTES) {
+        for (int64_t i = 0; i < n; i++) {
+            if (fwrite(records[i].buffer, 1, records[i].len, fp) != (size_t) records[i].len) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    //anything still in the stdio buffer (e.g. the header) must go first
+    if (fflush(fp) == EOF) {
+        return -1;
+    }
+    int fd = fileno(fp);
+#ifdef IOV_MAX
+    const int iov_max = IOV_MAX;
+#else
+    const int iov_max = 1024;
+#endif
+    struct iovec iov[iov_max];
+    int64_t i = 0;
+    while (i < n) {
+        int cnt = 0;
+        for (; i < n && cnt < iov_max; i++) {
+            if (records[i].len > 0) {
+                iov[cnt].iov_base = records[i].buffer;
+                iov[cnt].iov_len = records[i].len;
+                cnt++;
+            }
+        }
+        struct iovec *v = iov;
+        while (cnt > 0) {
+            ssize_t ret = writev(fd, v, cnt);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            //partial write, skip what has been written
+            size_t done = ret;
+            while (cnt > 0 && done >= v->iov_len) {
+                done -= v->iov_len;
+                v++;
+                cnt--;
+            }
+            if (cnt > 0) {
+                v->iov_base = (char *) v->iov_base + done;
+                v->iov_len -= done;
+            }
+        }
+    }
+    return 0;
+}
+
+/* does not block, NULL if the queue is empty */
+void* queue_trypop(queue_t* q) {
+    void *item = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+/* no more pushes, wakes up the consumers */
+void queue_close(queue_t* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void queue_free(queue_t* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+}
+
+typedef struct {
+    core_t* core;
+    pipeline_t* pl;
+    queue_t work_q;
+    queue_t write_q;
+    queue_t free_q; //written batches waiting to be refilled by the reader
+    int ret;
+    volatile int stop;
+} pipeline_state_t;
+
+static void* pipeline_reader(void* voidargs) {
+    pipeline_state_t* ps = (pipeline_state_t*)voidargs;
+    pipeline_t* pl = ps->pl;
+    db_t* db;
+    while (!ps->stop) {
+        double realtime = slow5_realtime();
+        db_t* reuse = (db_t*)queue_trypop(&ps->free_q);
+        db = pl->read_db(ps->core, reuse, pl->arg);
+        pl->time_read += slow5_realtime() - realtime;
+        if (db == NULL) {
+            if (reuse) {
+                queue_push(&ps->free_q, reuse);
+            }
+            break;
+        }
+        queue_push(&ps->work_q, db);
+    }
+    queue_close(&ps->work_q);
+    pthread_exit(0);
+}
+
+static void* pipeline_writer(void* voidargs) {
+    pipeline_state_t* ps = (pipeline_state_t*)voidargs;
+    pipeline_t* pl = ps->pl;
+    db_t* db;
+    while ((db = (db_t*)queue_pop(&ps->write_q)) != NULL) {
+        if (ps->ret == 0) { //after an error keep draining so that the other stages do not block
+            double realtime = slow5_realtime();
+            int ret = pl->write_db(ps->core, db, pl->arg);
+            pl->time_write += slow5_realtime() - realtime;
+            if (ret != 0) {
+                ps->ret = ret;
+                ps->stop = 1;
+            }
+        }
+        queue_push(&ps->free_q, db);
+    }
+    pthread_exit(0);
+}
+
+int pipeline_db(core_t* core, pipeline_t* pl) {
+    pipeline_state_t ps;
+    ps.core = core;
+    ps.pl = pl;
+    ps.ret = 0;
+    ps.stop = 0;
+    int32_t depth = pl->depth > 0 ? pl->depth : PIPELINE_DEPTH;
+    queue_init(&ps.work_q, depth);
+    queue_init(&ps.write_q, depth);
+    //a new batch is only allocated when none is free, so at most one per stage plus the queued ones ever exist
+    queue_init(&ps.free_q, 2 * depth + 3);
+    pl->time_read = pl->time_work = pl->time_write = 0;
+
+    pthread_t reader, writer;
+    int ret = pthread_create(&reader, NULL, pipeline_reader, (void*)(&ps));
+    NEG_CHK(ret);
+    ret = pthread_create(&writer, NULL, pipeline_writer, (void*)(&ps));
+    NEG_CHK(ret);
+
+    //the calling thread drives the worker threads
+    db_t* db;
+    while ((db = (db_t*)queue_pop(&ps.work_q)) != NULL) {
+        double realtime = slow5_realtime();
+        work_db(core, db, pl->func);
+        pl->time_work += slow5_realtime() - realtime;
+        queue_push(&ps.write_q, db);
+    }
+    queue_close(&ps.write_q);
+
+    ret = pthread_join(reader, NULL);
+    NEG_CHK(ret);
+    ret = pthread_join(writer, NULL);
+    NEG_CHK(ret);
+
+    void (*free_db)(db_t*) = pl->free_db ? pl->free_db : db_batch_free;
+    while ((db = (db_t*)queue_trypop(&ps.free_q)) != NULL) {
+        free_db(db);
+    }
+    queue_free(&ps.work_q);
+    queue_free(&ps.write_q);
+    queue_free(&ps.free_q);
+    return ps.ret;
+}
@@ -23,15 +23,22 @@
 
 #define WORK_STEAL 1 //simple work stealing enabled or not (no work stealing mean no load balancing)
 #define STEAL_THRESH 1 //stealing threshold
+#define PIPELINE_DEPTH 2 //max number of batches waiting between two pipeline stages
+#define WRITEV_MIN_BYTES (1024*1024) //batches smaller than this are written through stdio instead of writev
 
 #define NEG_CHK(ret) neg_chk(ret, __func__, __FILE__, __LINE__ - 1)
 
+typedef struct pool_s pool_t;
+
 /* core data structure that has information that are global to all the threads */
 typedef struct {
     int32_t num_thread;
+    pool_t* pool; //persistent worker threads shared across batches (NULL to create threads per batch)
     slow5_file_t *fp;
     slow5_fmt format_out;
     slow5_press_method_t press_method;
+    struct slow5_press** press_ptrs; //one compression context per thread for press_method, see core_press_init
+    slow5_rec_t** rec_ptrs; //one parsed record per thread reused across records, see core_rec_init
     //for view
     bool benchmark;
     //for merge
@@ -49,14 +56,17 @@ typedef struct{
 
 /* data structure for a batch of reads*/
 typedef struct {
+    int64_t capacity;   // number of records the arrays below can hold (db_batch_init)
     int64_t n_batch;    // number of records in this batch
     int64_t n_err;      // number of errors in this batch
     raw_record_t *read_record; // the list of read records (output) //change to whatever the data type
     //for get
     char **read_id;     // the list of read ids (input)
+    void *param;        // per batch state of the tool
     //for view
     char** mem_records; // list of slow5_get_next_mem() records
     size_t* mem_bytes; // lengths of slow5_get_next_mem() records
+    bool mapped;       // mem_records point into a blow5_mmap_t mapping (--mmap), see db_mem_record_own
     //for merge
     std::vector<std::string> slow5_files;
     std::vector<std::vector<size_t>> list;
@@ -78,8 +88,49 @@ typedef struct {
 #ifdef WORK_STEAL
     void *all_pthread_args;
 #endif
+    pool_t* pool;
 } pthread_arg_t;
 
+/* long-lived worker threads that process the batches submitted through pool_db */
+struct pool_s {
+    int32_t num_thread;
+    pthread_t* tids;
+    pthread_arg_t* pt_args;     // per worker arguments for the current batch
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // a new batch was submitted
+    pthread_cond_t done;        // all workers finished the current batch
+    int64_t batch;              // number of batches submitted so far
+    int32_t busy;               // workers yet to finish the current batch
+    int8_t quit;
+};
+
+
+/* bounded blocking FIFO used to pass batches between pipeline stages */
+typedef struct {
+    void **items;
+    int32_t cap;
+    int32_t head;
+    int32_t count;
+    int8_t closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue_t;
+
+/* read -> process -> write pipeline over batches
+ * batch N+1 is read while batch N is processed and batch N-1 is written, batches are written in the order they were read */
+typedef struct {
+    db_t* (*read_db)(core_t*,db_t*,void*);  // fills the given recycled batch (allocates one if NULL) and returns it, NULL when there is nothing more to read (or on error)
+    void (*func)(core_t*,db_t*,int);        // per record work done through work_db
+    int (*write_db)(core_t*,db_t*,void*);   // writes a batch and releases its records (the batch itself is recycled), returns non-zero on error
+    void (*free_db)(db_t*);                 // frees a batch at the end (db_batch_free if NULL)
+    void* arg;                              // passed to read_db and write_db
+    int32_t depth;                          // queue capacity between two stages (PIPELINE_DEPTH if <= 0)
+    //time spent in each stage, filled by pipeline_db
+    double time_read;
+    double time_work;
+    double time_write;
+} pipeline_t;
 
 /*
 int main(void) {
@@ -116,4 +167,38 @@ void work_per_single_read(core_t* core,db_t* db, int32_t i);
 /* process all reads in the given batch db */
 void work_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int));
 
+/* start num_thread workers (NULL if num_thread <= 1), pin them to cores if pin is set */
+pool_t* pool_init(int32_t num_thread, int pin);
+/* process all reads in the given batch db on the pool and wait until done */
+void pool_db(pool_t* pool, core_t* core, db_t* db, void (*func)(core_t*,db_t*,int));
+void pool_free(pool_t* pool);
+
+/* create one compression context per thread for core->press_method, to be reused across records and batches */
+void core_press_init(core_t* core);
+void core_press_free(core_t* core);
+/* compression context of the calling worker thread */
+struct slow5_press* core_press(core_t* core);
+/* one reusable slow5_rec_t slot per thread, pass core_rec(core) to slow5_rec_depress_parse instead of a fresh record */
+void core_rec_init(core_t* core);
+void core_rec_free(core_t* core);
+slow5_rec_t** core_rec(core_t* core);
+/* a batch whose mem_records, mem_bytes and read_record arrays hold cap records, reuse it across batches */
+db_t* db_batch_init(int64_t cap);
+void db_batch_free(db_t* db);
+/* copy mem_records[i] out of a memory mapped file into its own malloc'd buffer, as slow5lib decoders free their input */
+void db_mem_record_own(db_t* db, int32_t i);
+/* write n records in order to fp, large batches go straight to the file descriptor with writev, returns 0 on success and -1 on error */
+int raw_records_fwrite(FILE* fp, const raw_record_t* records, int64_t n);
+/* index of the calling worker thread within the current work_db (0 when single threaded) */
+int32_t work_thread_index(void);
+
+void queue_init(queue_t* q, int32_t cap);
+void queue_push(queue_t* q, void* item);
+void* queue_pop(queue_t* q);
+void* queue_trypop(queue_t* q);
+void queue_close(queue_t* q);
+void queue_free(queue_t* q);
+/* run the read, process and write stages concurrently until read_db returns NULL */
+int pipeline_db(core_t* core, pipeline_t* pl);
+
 #endif
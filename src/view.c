@@ -24,36 +24,105 @@
     HELP_MSG_PRESS \
     HELP_MSG_THREADS \
     HELP_MSG_BATCH \
+    HELP_MSG_PIN \
+    HELP_MSG_MMAP \
     "        --from FORMAT             specify input file format [auto]\n" \
     HELP_MSG_HELP \
     HELP_FORMATS_METHODS
 
 extern int slow5tools_verbosity_level;
 
-int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int64_t batch_size, struct program_meta *meta);
+int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int pin_threads, int use_mmap, int64_t batch_size, struct program_meta *meta);
 
 void depress_parse_rec_to_mem(core_t *core, db_t *db, int32_t i) {
     //
-    struct slow5_rec *read = NULL;
-    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, &read, core->fp) != 0) {
+    struct slow5_rec **read = core_rec(core); // reused by this thread for every record
+    if (db->mapped) {
+        db_mem_record_own(db, i);
+    }
+    if (slow5_rec_depress_parse(&db->mem_records[i], &db->mem_bytes[i], NULL, read, core->fp) != 0) {
         exit(EXIT_FAILURE);
     } else {
         free(db->mem_records[i]);
     }
-    struct slow5_press *press_ptr = slow5_press_init(core->press_method);
-    if(!press_ptr){
-        ERROR("Could not initialize the slow5 compression method%s","");
-        exit(EXIT_FAILURE);
-    }
+    struct slow5_press *press_ptr = core_press(core);
     size_t len;
-    if ((db->read_record[i].buffer = slow5_rec_to_mem(read, core->fp->header->aux_meta, core->format_out, press_ptr, &len)) == NULL) {
-        slow5_press_free(press_ptr);
-        slow5_rec_free(read);
+    if (core->format_out == SLOW5_FORMAT_ASCII) {
+        db->read_record[i].buffer = rec_to_ascii_mem(*read, core->fp->header->aux_meta, press_ptr, &len);
+    } else {
+        db->read_record[i].buffer = slow5_rec_to_mem(*read, core->fp->header->aux_meta, core->format_out, press_ptr, &len);
+    }
+    if (db->read_record[i].buffer == NULL) {
         exit(EXIT_FAILURE);
     }
-    slow5_press_free(press_ptr);
     db->read_record[i].len = len;
-    slow5_rec_free(read);
+}
+
+typedef struct {
+    struct slow5_file *from;
+    blow5_mmap_t *map; // NULL unless --mmap
+    FILE *to_fp;
+    int64_t batch_size;
+    int flag_end_of_file;
+    int ret;
+} convert_arg_t;
+
+// reader stage: fill a (recycled) batch with raw records, NULL at the end of the file or on error (ca->ret is set)
+static db_t *convert_read_batch(core_t *core, db_t *db, void *arg) {
+    convert_arg_t *ca = (convert_arg_t *) arg;
+    if (ca->flag_end_of_file) {
+        return NULL;
+    }
+
+    db_t *new_db = NULL;
+    if (db == NULL) {
+        db = new_db = db_batch_init(ca->batch_size);
+    }
+    db->mapped = ca->map != NULL;
+    int64_t record_count = 0;
+    size_t bytes;
+    char *mem;
+    while (record_count < ca->batch_size) {
+        mem = ca->map ? blow5_mmap_next(ca->map, &bytes) : (char *) slow5_get_next_mem(&bytes, ca->from);
+        if (!mem) {
+            if (slow5_errno != SLOW5_ERR_EOF) {
+                ca->ret = EXIT_FAILURE;
+            }
+            ca->flag_end_of_file = 1;
+            break;
+        } else {
+            db->mem_records[record_count] = mem;
+            db->mem_bytes[record_count] = bytes;
+            record_count++;
+        }
+    }
+
+    if (record_count == 0 || ca->ret != 0) {
+        for (int64_t i = 0; i < record_count && !db->mapped; i++) {
+            free(db->mem_records[i]);
+        }
+        if (new_db) {
+            db_batch_free(new_db);
+        }
+        return NULL;
+    }
+
+    db->n_batch = record_count;
+    return db;
+}
+
+// writer stage: write the converted records in order, the batch arrays are recycled by the pipeline
+static int convert_write_batch(core_t *core, db_t *db, void *arg) {
+    convert_arg_t *ca = (convert_arg_t *) arg;
+    int ret = raw_records_fwrite(ca->to_fp, db->read_record, db->n_batch);
+    if (ret != 0) {
+        ERROR("Writing the converted records failed - %s.", strerror(errno));
+    }
+    for (int64_t i = 0; i < db->n_batch; i++) {
+        free(db->read_record[i].buffer);
+    }
+    db->n_batch = 0;
+    return ret;
 }
 
 int view_main(int argc, char **argv, struct program_meta *meta) {
@@ -78,6 +147,8 @@ int view_main(int argc, char **argv, struct program_meta *meta) {
         {"to",              required_argument,  NULL, 'b'},
         {"threads",         required_argument,  NULL, 't' },
         {"batchsize",       required_argument, NULL, 'K'},
+        {"pin",             no_argument,        NULL, 0},
+        {"mmap",            no_argument,        NULL, 0},
         {NULL, 0, NULL, 0}
     };
 
@@ -119,6 +190,13 @@ int view_main(int argc, char **argv, struct program_meta *meta) {
             case 't':
                 user_opts.arg_num_threads = optarg;
                 break;
+            case 0:
+                if (!strcmp(long_opts[longindex].name, "pin")) {
+                    user_opts.flag_pin_threads = 1;
+                } else if (!strcmp(long_opts[longindex].name, "mmap")) {
+                    user_opts.flag_mmap = 1;
+                }
+                break;
             default: // case '?'
                 fprintf(stderr, HELP_SMALL_MSG, argv[0]);
                 EXIT_MSG(EXIT_FAILURE, argv, meta);
@@ -199,7 +277,7 @@ int view_main(int argc, char **argv, struct program_meta *meta) {
 
         // TODO if output is the same format just duplicate file
         slow5_press_method_t press_out = {user_opts.record_press_out,user_opts.signal_press_out};
-        if (slow5_convert_parallel(s5p, user_opts.f_out, (enum slow5_fmt) user_opts.fmt_out, press_out, user_opts.num_threads, user_opts.read_id_batch_capacity, meta) != 0) {
+        if (slow5_convert_parallel(s5p, user_opts.f_out, (enum slow5_fmt) user_opts.fmt_out, press_out, user_opts.num_threads, user_opts.flag_pin_threads, user_opts.flag_mmap, user_opts.read_id_batch_capacity, meta) != 0) {
             ERROR("File conversion failed.%s", "");
             view_ret = EXIT_FAILURE;
         }
@@ -238,7 +316,7 @@ int view_main(int argc, char **argv, struct program_meta *meta) {
     return view_ret;
 }
 
-int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int64_t batch_size, struct program_meta *meta) {
+int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt to_format, slow5_press_method_t to_compress, size_t num_threads, int pin_threads, int use_mmap, int64_t batch_size, struct program_meta *meta) {
     if (from == NULL || to_fp == NULL || to_format == SLOW5_FORMAT_UNKNOWN) {
         return -1;
     }
@@ -247,77 +325,52 @@ int slow5_convert_parallel(struct slow5_file *from, FILE *to_fp, enum slow5_fmt
         return -2;
     }
 
-    double time_get_to_mem = 0;
-    double time_thread_execution = 0;
-    double time_write = 0;
-    int flag_end_of_file = 0;
-    while(1) {
-
-        db_t db = { 0 };
-        db.mem_records = (char **) malloc(batch_size * sizeof(char*));
-        db.mem_bytes = (size_t *) malloc(batch_size * sizeof(size_t));
-        MALLOC_CHK(db.mem_records);
-        MALLOC_CHK(db.mem_bytes);
-        int64_t record_count = 0;
-        size_t bytes;
-        char *mem;
-        double realtime = slow5_realtime();
-        while (record_count < batch_size) {
-            if (!(mem = (char *) slow5_get_next_mem(&bytes, from))) {
-                if (slow5_errno != SLOW5_ERR_EOF) {
-                    return EXIT_FAILURE;
-                } else {
-                    flag_end_of_file = 1;
-                    break;
-                }
-            } else {
-                db.mem_records[record_count] = mem;
-                db.mem_bytes[record_count] = bytes;
-                record_count++;
-            }
-        }
-        time_get_to_mem += slow5_realtime() - realtime;
-
-        realtime = slow5_realtime();
-        // Setup multithreading structures
-        core_t core;
-        core.num_thread = num_threads;
-        core.fp = from;
-        core.format_out = to_format;
-        core.press_method = to_compress;
-
-        db.n_batch = record_count;
-        db.read_record = (raw_record_t*) malloc(record_count * sizeof *db.read_record);
-        MALLOC_CHK(db.read_record);
-        work_db(&core,&db,depress_parse_rec_to_mem);
-        time_thread_execution += slow5_realtime() - realtime;
-
-        realtime = slow5_realtime();
-        for (int64_t i = 0; i < record_count; i++) {
-            fwrite(db.read_record[i].buffer,1,db.read_record[i].len,to_fp);
-            free(db.read_record[i].buffer);
-        }
-        time_write += slow5_realtime() - realtime;
-
-        // Free everything
-        free(db.mem_bytes);
-        free(db.mem_records);
-        free(db.read_record);
-
-        if(flag_end_of_file == 1){
-            break;
-        }
-
+    // Setup multithreading structures
+    core_t core = { 0 };
+    core.num_thread = num_threads;
+    core.fp = from;
+    core.format_out = to_format;
+    core.press_method = to_compress;
+    core.pool = pool_init(core.num_thread, pin_threads);
+    core_press_init(&core);
+    core_rec_init(&core);
+
+    convert_arg_t ca;
+    ca.from = from;
+    ca.map = use_mmap ? blow5_mmap_init(from) : NULL;
+    ca.to_fp = to_fp;
+    ca.batch_size = batch_size;
+    ca.flag_end_of_file = 0;
+    ca.ret = 0;
+
+    // read, depress-parse and write the batches concurrently
+    pipeline_t pl = { 0 };
+    pl.read_db = convert_read_batch;
+    pl.func = depress_parse_rec_to_mem;
+    pl.write_db = convert_write_batch;
+    pl.arg = &ca;
+    pl.depth = PIPELINE_DEPTH;
+    int ret = pipeline_db(&core, &pl);
+    core_rec_free(&core);
+    core_press_free(&core);
+    pool_free(core.pool);
+    blow5_mmap_free(ca.map);
+    if (ca.ret != 0) {
+        return EXIT_FAILURE;
+    }
+    if (ret != 0) {
+        return -2;
     }
+
     if (to_format == SLOW5_FORMAT_BINARY) {
         if (slow5_eof_fwrite(to_fp) == -1) {
             return -2;
         }
     }
 
-    DEBUG("time_get_to_mem\t%.3fs", time_get_to_mem);
-    DEBUG("time_depress_parse\t%.3fs", time_thread_execution);
-    DEBUG("time_write\t%.3fs", time_write);
+    DEBUG("time_get_to_mem\t%.3fs", pl.time_read);
+    DEBUG("time_depress_parse\t%.3fs", pl.time_work);
+    DEBUG("time_write\t%.3fs", pl.time_write);
 
     return 0;
 }
@@ -677,6 +677,40 @@ echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
 
 TESTCASE_NO=8.15 TEST_FAST5_VERSION single_fast5_v1.0_starttime0
 
+TESTCASE_NO=9.1
+echo "------------------- f2s testcase $TESTCASE_NO: compression threads -------------------"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5/ssm1.fast5 --iop 1 -t 3 -K 1 --to slow5 > $OUTPUT_DIR/stdout.slow5 || die "testcase $TESTCASE_NO failed"
+diff -q $EXP_SLOW5_DIR/multi-fast5-output/file_multi-fast5.slow5 $OUTPUT_DIR/stdout.slow5 || die "ERROR: diff failed f2s_test testcase $TESTCASE_NO"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5/ssm1.fast5 --iop 1 -t 1 -o $OUTPUT_DIR/t1.blow5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5/ssm1.fast5 --iop 1 -t 4 -K 2 -o $OUTPUT_DIR/t4.blow5 || die "testcase $TESTCASE_NO failed"
+cmp $OUTPUT_DIR/t1.blow5 $OUTPUT_DIR/t4.blow5 || die "ERROR: f2s output differs with the number of threads in testcase $TESTCASE_NO"
+echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
+
+TESTCASE_NO=9.2
+echo "------------------- f2s testcase $TESTCASE_NO: multiple processes writing one merged file -------------------"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5 --iop 3 --to slow5 > $OUTPUT_DIR/merged.slow5 || die "testcase $TESTCASE_NO failed"
+diff -q $EXP_SLOW5_DIR/multi-fast5-output/directory_multi-fast5.slow5 $OUTPUT_DIR/merged.slow5 || die "ERROR: diff failed f2s_test testcase $TESTCASE_NO"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5 --iop 2 -o $OUTPUT_DIR/merged.blow5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC quickcheck $OUTPUT_DIR/merged.blow5 || die "ERROR: quickcheck failed f2s_test testcase $TESTCASE_NO"
+diff -q <(grep -v '^[#@]' $EXP_SLOW5_DIR/multi-fast5-output/directory_multi-fast5.slow5) <($SLOW5_EXEC view $OUTPUT_DIR/merged.blow5 | grep -v '^[#@]') || die "ERROR: blow5 record diff failed f2s_test testcase $TESTCASE_NO"
+$SLOW5_EXEC f2s $FAST5_DIR/multi-fast5 --iop 1 -o $OUTPUT_DIR/single.blow5 || die "testcase $TESTCASE_NO failed"
+cmp $OUTPUT_DIR/single.blow5 $OUTPUT_DIR/merged.blow5 || die "ERROR: blow5 diff failed f2s_test testcase $TESTCASE_NO"
+echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
+
+TESTCASE_NO=9.3
+echo "------------------- f2s testcase $TESTCASE_NO: multiple processes writing one merged file with different run_ids -------------------"
+RUN_ID_DIR=$FAST5_DIR/run_id_conflicts/multi_fast5
+$SLOW5_EXEC_WITHOUT_VALGRIND f2s $RUN_ID_DIR/ssm1.fast5 $RUN_ID_DIR/ssm1_different_run_id.fast5 --iop 2 --to slow5 > $OUTPUT_DIR/merged_run_id.slow5 2> $OUTPUT_DIR/err.log && die "testcase $TESTCASE_NO failed"
+grep -q -i "ERROR.*Ancient fast5: Different run_ids found in an individual multi-fast5 file. Cannot create a single header slow5/blow5" $OUTPUT_DIR/err.log || die "Error in testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $RUN_ID_DIR/ssm1.fast5 $RUN_ID_DIR/ssm1_different_run_id.fast5 --iop 1 --allow --to slow5 > $OUTPUT_DIR/run_id_p1.slow5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $RUN_ID_DIR/ssm1.fast5 $RUN_ID_DIR/ssm1_different_run_id.fast5 --iop 2 --allow --to slow5 > $OUTPUT_DIR/merged_run_id.slow5 2> $OUTPUT_DIR/err.log || die "testcase $TESTCASE_NO failed"
+grep -q "WARNING.*Ancient fast5: Different run_ids found in an individual multi-fast5 file. First seen run_id will be set in slow5 header" $OUTPUT_DIR/err.log || die "ERROR: run_id warning expected in f2s_test testcase $TESTCASE_NO"
+diff -q $OUTPUT_DIR/run_id_p1.slow5 $OUTPUT_DIR/merged_run_id.slow5 || die "ERROR: diff failed f2s_test testcase $TESTCASE_NO"
+$SLOW5_EXEC f2s $RUN_ID_DIR/ssm1.fast5 $RUN_ID_DIR/ssm1_different_run_id.fast5 --iop 1 --allow -o $OUTPUT_DIR/run_id_p1.blow5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $RUN_ID_DIR/ssm1.fast5 $RUN_ID_DIR/ssm1_different_run_id.fast5 --iop 2 --allow -o $OUTPUT_DIR/merged_run_id.blow5 || die "testcase $TESTCASE_NO failed"
+cmp $OUTPUT_DIR/run_id_p1.blow5 $OUTPUT_DIR/merged_run_id.blow5 || die "ERROR: blow5 diff failed f2s_test testcase $TESTCASE_NO"
+echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
+
 rm -r $OUTPUT_DIR || die "Removing $OUTPUT_DIR failed"
 
 exit 0
@@ -191,5 +191,57 @@ if [ $? -ne 0 ]; then
 fi
 info "testcase $TESTCASE passed"
 
+TESTCASE=12
+info "------------------- slow5tools get testcase $TESTCASE -------------------"
+# records are fetched in file order but must come out in the requested order
+$SLOW5_EXEC view "$RAW_DIR/example2.slow5" -o "$OUTPUT_DIR/example2.blow5" || die "testcase $TESTCASE failed"
+$SLOW5_EXEC index "$OUTPUT_DIR/example2.blow5" || die "testcase $TESTCASE failed"
+printf "r1\nr5\nr3\n" | $SLOW5_EXEC get "$OUTPUT_DIR/example2.blow5" -t 2 -K 2 --to slow5 > "$OUTPUT_DIR/extracted_reads12.slow5" || die "testcase $TESTCASE failed"
+diff -q "$EXP_DIR/expected_extracted_reads2.slow5" "$OUTPUT_DIR/extracted_reads12.slow5" &>/dev/null
+if [ $? -ne 0 ]; then
+    info "${RED}ERROR: diff failed for 'slow5tools get testcase $TESTCASE'${NC}"
+    exit 1
+fi
+$SLOW5_EXEC get "$OUTPUT_DIR/example2.blow5" --list "$RAW_DIR/list.txt" -t 3 --to slow5 > "$OUTPUT_DIR/extracted_reads12.slow5" || die "testcase $TESTCASE failed"
+diff -q "$EXP_DIR/expected_extracted_reads3.slow5" "$OUTPUT_DIR/extracted_reads12.slow5" &>/dev/null
+if [ $? -ne 0 ]; then
+    info "${RED}ERROR: diff failed for 'slow5tools get testcase $TESTCASE'${NC}"
+    exit 1
+fi
+info "testcase $TESTCASE passed"
+
+TESTCASE=13
+info "------------------- slow5tools get testcase $TESTCASE -------------------"
+# read ids spanning several batches, the last one without a newline
+printf "r1\nr5\r\n\nr3" | $SLOW5_EXEC get "$RAW_DIR/example2.slow5" -t 2 -K 1 --to slow5 > "$OUTPUT_DIR/extracted_reads13.slow5" || die "testcase $TESTCASE failed"
+diff -q "$EXP_DIR/expected_extracted_reads2.slow5" "$OUTPUT_DIR/extracted_reads13.slow5" &>/dev/null
+if [ $? -ne 0 ]; then
+    info "${RED}ERROR: diff failed for 'slow5tools get testcase $TESTCASE'${NC}"
+    exit 1
+fi
+info "testcase $TESTCASE passed"
+
+TESTCASE=14
+info "------------------- slow5tools get testcase $TESTCASE -------------------"
+# read ids looked up across several files
+mkdir "$OUTPUT_DIR/split" || die "testcase $TESTCASE failed"
+printf "r0\nr1\nr2\n" | $SLOW5_EXEC get "$RAW_DIR/example2.slow5" --to blow5 -o "$OUTPUT_DIR/split/a.blow5" || die "testcase $TESTCASE failed"
+printf "r3\nr4\nr5\n" | $SLOW5_EXEC get "$RAW_DIR/example2.slow5" --to blow5 -o "$OUTPUT_DIR/split/b.blow5" || die "testcase $TESTCASE failed"
+$SLOW5_EXEC index "$OUTPUT_DIR/split/a.blow5" || die "testcase $TESTCASE failed"
+$SLOW5_EXEC index "$OUTPUT_DIR/split/b.blow5" || die "testcase $TESTCASE failed"
+printf "r1\nr5\nr3\n" | $SLOW5_EXEC get "$OUTPUT_DIR/split/a.blow5" "$OUTPUT_DIR/split/b.blow5" -t 2 --to slow5 > "$OUTPUT_DIR/extracted_reads14.slow5" || die "testcase $TESTCASE failed"
+diff -q "$EXP_DIR/expected_extracted_reads2.slow5" "$OUTPUT_DIR/extracted_reads14.slow5" &>/dev/null
+if [ $? -ne 0 ]; then
+    info "${RED}ERROR: diff failed for 'slow5tools get testcase $TESTCASE'${NC}"
+    exit 1
+fi
+$SLOW5_EXEC get "$OUTPUT_DIR/split" r1 r5 r3 --to slow5 > "$OUTPUT_DIR/extracted_reads14.slow5" || die "testcase $TESTCASE failed"
+diff -q "$EXP_DIR/expected_extracted_reads2.slow5" "$OUTPUT_DIR/extracted_reads14.slow5" &>/dev/null
+if [ $? -ne 0 ]; then
+    info "${RED}ERROR: diff failed for 'slow5tools get testcase $TESTCASE'${NC}"
+    exit 1
+fi
+info "testcase $TESTCASE passed"
+
 rm -r $OUTPUT_DIR || die "Removing $OUTPUT_DIR failed" 1>&3 2>&4
 exit 0
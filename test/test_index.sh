@@ -117,6 +117,18 @@ echo "------------------- slow5tools index testcase ${TESTCASE_NO} -------------
 $SLOW5_EXEC index $SLOW5_DIR/duplicate_read.blow5 && die "testcase ${TESTCASE_NO} failed"
 echo -e "${GREEN}testcase ${TESTCASE_NO} passed${NC}"  1>&3 2>&4
 
+if [ -z "$bigend" ]; then
+echo
+TESTCASE_NO=7
+echo "------------------- slow5tools index testcase ${TESTCASE_NO} -------------------"
+# the single threaded and the multi-threaded indexers must produce the same index
+$SLOW5_EXEC index -t 1 $SLOW5_DIR/example_multi_rg_v0.2.0.blow5 || die "testcase ${TESTCASE_NO} failed"
+diff -q $SLOW5_DIR/example_multi_rg_v0.2.0.blow5.idx.exp $SLOW5_DIR/example_multi_rg_v0.2.0.blow5.idx || die "ERROR: diff failed for testcase ${TESTCASE_NO}"
+$SLOW5_EXEC index -t 3 -K 2 $SLOW5_DIR/example_multi_rg_v0.2.0.blow5 || die "testcase ${TESTCASE_NO} failed"
+diff -q $SLOW5_DIR/example_multi_rg_v0.2.0.blow5.idx.exp $SLOW5_DIR/example_multi_rg_v0.2.0.blow5.idx || die "ERROR: diff failed for testcase ${TESTCASE_NO}"
+echo -e "${GREEN}testcase ${TESTCASE_NO} passed${NC}"  1>&3 2>&4
+fi
+
 
 rm -r $OUTPUT_DIR || die "Removing $OUTPUT_DIR failed"
 
@@ -190,6 +190,57 @@ $SLOW5_EXEC merge $INPUT_FILES -o $OUTPUT_DIR/diff_rg_aux_order.slow5 || die "te
 diff -q $REL_PATH/data/exp/merge/diff_rg_aux_order.slow5  $OUTPUT_DIR/diff_rg_aux_order.slow5 || die "testcase $TESTCASE: diff for $TESTNAME"
 echo -e "${GREEN}testcase $TESTCASE passed${NC}" 1>&3 2>&4
 
+TESTCASE=1.13
+TESTNAME="lossless merging with one reader and with small batches"
+info "-------------------testcase $TESTCASE: $TESTNAME-------------------"
+INPUT_FILES="$RAW_DIR/rg0.slow5 $RAW_DIR/rg1.slow5 $RAW_DIR/rg2.slow5 $RAW_DIR/rg3.slow5"
+OUTPUT_FILE=merged_different_rg.slow5
+$SLOW5_EXEC merge $INPUT_FILES -o $OUTPUT_DIR/$OUTPUT_FILE --readers 1 || die "testcase $TESTCASE: $TESTNAME failed"
+diff -q $REL_PATH/data/exp/merge/$OUTPUT_FILE $OUTPUT_DIR/$OUTPUT_FILE || die "testcase $TESTCASE: diff for $TESTNAME failed"
+$SLOW5_EXEC merge $INPUT_FILES -o $OUTPUT_DIR/$OUTPUT_FILE --readers 4 -K 1 || die "testcase $TESTCASE: $TESTNAME failed"
+diff -q $REL_PATH/data/exp/merge/$OUTPUT_FILE $OUTPUT_DIR/$OUTPUT_FILE || die "testcase $TESTCASE: diff for $TESTNAME failed"
+echo -e "${GREEN}testcase $TESTCASE passed${NC}" 1>&3 2>&4
+
+TESTCASE=1.14
+TESTNAME="lossless merging with --unordered"
+info "-------------------testcase $TESTCASE: $TESTNAME-------------------"
+$SLOW5_EXEC merge $INPUT_FILES -o $OUTPUT_DIR/$OUTPUT_FILE --unordered -K 2 || die "testcase $TESTCASE: $TESTNAME failed"
+diff -q <(grep '^[#@]' $REL_PATH/data/exp/merge/$OUTPUT_FILE) <(grep '^[#@]' $OUTPUT_DIR/$OUTPUT_FILE) || die "testcase $TESTCASE: header diff for $TESTNAME failed"
+diff -q <(grep -v '^[#@]' $REL_PATH/data/exp/merge/$OUTPUT_FILE | sort) <(grep -v '^[#@]' $OUTPUT_DIR/$OUTPUT_FILE | sort) || die "testcase $TESTCASE: record diff for $TESTNAME failed"
+echo -e "${GREEN}testcase $TESTCASE passed${NC}" 1>&3 2>&4
+
+TESTCASE=1.15
+TESTNAME="merging BLOW5 files that already have the output compression"
+info "-------------------testcase $TESTCASE: $TESTNAME-------------------"
+BLOW5_INPUT_FILES=""
+for rg in rg0 rg1 rg2 rg3; do
+    $SLOW5_EXEC view $RAW_DIR/$rg.slow5 -c zlib -s svb-zd -o $OUTPUT_DIR/$rg.blow5 || die "testcase $TESTCASE: converting $rg.slow5 failed"
+    BLOW5_INPUT_FILES="$BLOW5_INPUT_FILES $OUTPUT_DIR/$rg.blow5"
+done
+$SLOW5_EXEC -v 4 merge $BLOW5_INPUT_FILES -c zlib -s svb-zd -o $OUTPUT_DIR/merged_passthrough.blow5 2> $OUTPUT_DIR/err.log || die "testcase $TESTCASE: $TESTNAME failed"
+grep -q "of 1 input files copied with a new read_group or auxiliary field order, of 3 input files re-encoded" $OUTPUT_DIR/err.log || die "testcase $TESTCASE: records of rg2 were re-encoded in $TESTNAME"
+$SLOW5_EXEC view $OUTPUT_DIR/merged_passthrough.blow5 --to slow5 -o $OUTPUT_DIR/merged_passthrough.slow5 || die "testcase $TESTCASE: $TESTNAME failed"
+diff -q $REL_PATH/data/exp/merge/merged_different_rg.slow5 $OUTPUT_DIR/merged_passthrough.slow5 || die "testcase $TESTCASE: diff for $TESTNAME failed"
+$SLOW5_EXEC -v 4 merge $OUTPUT_DIR/merged_passthrough.blow5 -c zlib -s svb-zd -o $OUTPUT_DIR/merged_copy.blow5 2> $OUTPUT_DIR/err.log || die "testcase $TESTCASE: $TESTNAME failed"
+grep -q "Records of 1 input files copied as they are" $OUTPUT_DIR/err.log || die "testcase $TESTCASE: records of $TESTNAME were not copied"
+diff -q $OUTPUT_DIR/merged_passthrough.slow5 <($SLOW5_EXEC view $OUTPUT_DIR/merged_copy.blow5 --to slow5) || die "testcase $TESTCASE: diff for $TESTNAME failed"
+echo -e "${GREEN}testcase $TESTCASE passed${NC}" 1>&3 2>&4
+
+TESTCASE=1.16
+TESTNAME="merging BLOW5 files with the auxiliary fields in fast5 order"
+info "-------------------testcase $TESTCASE: $TESTNAME-------------------"
+# rg2 has the fields in the order f2s writes them (start_time read_number start_mux median_before end_reason channel_number)
+$SLOW5_EXEC view $RAW_DIR/rg2.slow5 -c zlib -s svb-zd -o $OUTPUT_DIR/rg2_zlib.blow5 || die "testcase $TESTCASE: converting rg2.slow5 failed"
+$SLOW5_EXEC view $RAW_DIR/rg2.slow5 -c none -s none -o $OUTPUT_DIR/rg2_none.blow5 || die "testcase $TESTCASE: converting rg2.slow5 failed"
+$SLOW5_EXEC merge $RAW_DIR/rg2.slow5 --to slow5 -o $OUTPUT_DIR/rg2_reencoded.slow5 || die "testcase $TESTCASE: $TESTNAME failed"
+for press in "zlib -s svb-zd" "none -s none"; do
+    name=$(echo $press | cut -d ' ' -f 1)
+    $SLOW5_EXEC -v 4 merge $OUTPUT_DIR/rg2_$name.blow5 -c $press -o $OUTPUT_DIR/rg2_merged_$name.blow5 2> $OUTPUT_DIR/err.log || die "testcase $TESTCASE: $TESTNAME failed"
+    grep -q "of 1 input files copied with a new read_group or auxiliary field order" $OUTPUT_DIR/err.log || die "testcase $TESTCASE: records of $TESTNAME with $name were re-encoded"
+    diff -q $OUTPUT_DIR/rg2_reencoded.slow5 <($SLOW5_EXEC view $OUTPUT_DIR/rg2_merged_$name.blow5 --to slow5) || die "testcase $TESTCASE: diff for $TESTNAME with $name failed"
+done
+echo -e "${GREEN}testcase $TESTCASE passed${NC}" 1>&3 2>&4
+
 ## bloody enum
 
 # merging with and without enum data type
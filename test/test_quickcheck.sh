@@ -71,5 +71,24 @@ do
     TESTCASE=$((TESTCASE + 1))
 done
 
+GOOD_FILES=""
+for each in $GOOD_LIST
+do
+    GOOD_FILES="$GOOD_FILES $RAW_DIR/${each}"
+done
+
+info "testcase$TESTCASE: many files"
+$SLOW5TOOLS quickcheck -t 2 $GOOD_FILES > /dev/null 2> /dev/null || die "testcase$TESTCASE: quickcheck on many good files failed"
+TESTCASE=$((TESTCASE + 1))
+
+info "testcase$TESTCASE: many files with --full"
+$SLOW5TOOLS quickcheck --full -t 3 -K 2 $GOOD_FILES > /dev/null 2> /dev/null || die "testcase$TESTCASE: quickcheck --full on good files failed"
+TESTCASE=$((TESTCASE + 1))
+
+info "testcase$TESTCASE: a bad file among good files"
+$SLOW5TOOLS quickcheck -t 2 $GOOD_FILES $RAW_DIR/exp_1_lossy_bad_eof.blow5 > /dev/null 2> /dev/null && die "testcase$TESTCASE: quickcheck did not fail on a bad file"
+test "$($SLOW5TOOLS quickcheck -t 2 $GOOD_FILES $RAW_DIR/exp_1_lossy_bad_eof.blow5 2> /dev/null | grep -c FAIL)" = "1" || die "testcase$TESTCASE: wrong number of failed files"
+TESTCASE=$((TESTCASE + 1))
+
 info "all $TESTCASE testcases passed"
 exit 0
@@ -126,6 +126,29 @@ $SLOW5_EXEC s2f $RAW_DIR/median_before_nan.blow5 -o $OUTPUT_DIR/median_before_na
 echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
 fi
 
+TESTCASE_NO=9
+TESTNAME="multiple decoding threads and small batches"
+echo "-------------------testcase:$TESTCASE_NO: $TESTNAME-------------------"
+$SLOW5_EXEC s2f $RAW_DIR/a.slow5 -t 4 -K 2 -o $OUTPUT_DIR/a_threads.fast5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $OUTPUT_DIR/a.fast5 -o $OUTPUT_DIR/a_single.slow5 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC f2s $OUTPUT_DIR/a_threads.fast5 -o $OUTPUT_DIR/a_threads.slow5 || die "testcase $TESTCASE_NO failed"
+diff $OUTPUT_DIR/a_single.slow5 $OUTPUT_DIR/a_threads.slow5 > /dev/null || die "testcase $TESTCASE_NO failed: records differ from single threaded s2f"
+echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
+
+TESTCASE_NO=10
+TESTNAME="--reads-per-file"
+echo "-------------------testcase:$TESTCASE_NO: $TESTNAME-------------------"
+$SLOW5_EXEC s2f $RAW_DIR/a.slow5 --reads-per-file 1 -d $OUTPUT_DIR/reads_per_file || die "testcase $TESTCASE_NO failed"
+NUM_READS=$(grep -v '^[#@]' $RAW_DIR/a.slow5 | wc -l)
+NUM_FILES=$(ls $OUTPUT_DIR/reads_per_file/a_*.fast5 | wc -l)
+[ "$NUM_READS" -eq "$NUM_FILES" ] || die "testcase $TESTCASE_NO failed: expected $NUM_READS fast5 files, found $NUM_FILES"
+$SLOW5_EXEC f2s $OUTPUT_DIR/reads_per_file -o $OUTPUT_DIR/reads_per_file.slow5 -p 1 || die "testcase $TESTCASE_NO failed"
+$SLOW5_EXEC view $OUTPUT_DIR/a_single.slow5 | grep -v '^[#@]' | sort > $OUTPUT_DIR/a_single_records.txt || die "testcase $TESTCASE_NO failed"
+grep -v '^[#@]' $OUTPUT_DIR/reads_per_file.slow5 | sort > $OUTPUT_DIR/reads_per_file_records.txt || die "testcase $TESTCASE_NO failed"
+diff $OUTPUT_DIR/a_single_records.txt $OUTPUT_DIR/reads_per_file_records.txt > /dev/null || die "testcase $TESTCASE_NO failed: records differ"
+$SLOW5_EXEC s2f $RAW_DIR/a.slow5 --reads-per-file 1 -o $OUTPUT_DIR/reads_per_file.fast5 && die "testcase $TESTCASE_NO failed: --reads-per-file without -d should fail"
+echo -e "${GREEN}testcase $TESTCASE_NO passed${NC}" 1>&3 2>&4
+
 #rm -r $OUTPUT_DIR || die "Removing $OUTPUT_DIR failed"
 
 exit 0
@@ -77,6 +77,30 @@ info "testcase$TESTCASE"
 $SLOW5TOOLS skim $RAW_DIR/sequin_rna.blow5 > $OUTPUT_DIR/sequin_rna.txt  || die "testcase$TESTCASE: skim failed"
 diff $OUTPUT_DIR/sequin_rna.txt "$EXP_DIR/sequin_rna.exp"  > /dev/null || die "testcase$TESTCASE: diff failed"
 
+TESTCASE=3
+info "testcase$TESTCASE: --fields projection"
+FIELDS=read_id,read_group,digitisation,len_raw_signal,channel_number
+CH_COL=$(head -n1 "$EXP_DIR/sp1_dna.exp" | tr '\t' '\n' | grep -n "^channel_number$" | cut -d: -f1)
+cut -f1,2,3,7,$CH_COL "$EXP_DIR/sp1_dna.exp" > $OUTPUT_DIR/sp1_dna_fields.exp || die "testcase$TESTCASE: cut failed"
+$SLOW5TOOLS skim --fields $FIELDS $RAW_DIR/sp1_dna.blow5 > $OUTPUT_DIR/sp1_dna_fields.txt || die "testcase$TESTCASE: skim --fields failed"
+diff $OUTPUT_DIR/sp1_dna_fields.txt $OUTPUT_DIR/sp1_dna_fields.exp > /dev/null || die "testcase$TESTCASE: diff failed"
+$SLOW5TOOLS skim --fields $FIELDS --mmap -t 3 -K 2 $RAW_DIR/sp1_dna.blow5 > $OUTPUT_DIR/sp1_dna_fields.txt || die "testcase$TESTCASE: skim --fields --mmap failed"
+diff $OUTPUT_DIR/sp1_dna_fields.txt $OUTPUT_DIR/sp1_dna_fields.exp > /dev/null || die "testcase$TESTCASE: diff failed for --mmap"
+$SLOW5TOOLS view $RAW_DIR/sp1_dna.blow5 -o $OUTPUT_DIR/sp1_dna.slow5 || die "testcase$TESTCASE: view failed"
+$SLOW5TOOLS skim --fields $FIELDS $OUTPUT_DIR/sp1_dna.slow5 > $OUTPUT_DIR/sp1_dna_fields.txt || die "testcase$TESTCASE: skim --fields on SLOW5 failed"
+diff $OUTPUT_DIR/sp1_dna_fields.txt $OUTPUT_DIR/sp1_dna_fields.exp > /dev/null || die "testcase$TESTCASE: diff failed for SLOW5"
+$SLOW5TOOLS skim --fields read_id,raw_signal $RAW_DIR/sp1_dna.blow5 && die "testcase$TESTCASE: projecting raw_signal should fail"
+
+TESTCASE=4
+info "testcase$TESTCASE: --arrow export"
+$SLOW5TOOLS skim --arrow $OUTPUT_DIR/sp1_dna.arrow --signal -t 3 -K 2 $RAW_DIR/sp1_dna.blow5 > $OUTPUT_DIR/arrow.txt || die "testcase$TESTCASE: skim --arrow failed"
+test -s $OUTPUT_DIR/arrow.txt && die "testcase$TESTCASE: nothing should be printed with --arrow"
+cmp $OUTPUT_DIR/sp1_dna.arrow $EXP_DIR/sp1_dna.arrow || die "testcase$TESTCASE: cmp failed"
+if python3 -c "import pyarrow" 2>/dev/null; then
+    python3 -c "import pyarrow.ipc as ipc, sys; t = ipc.open_file(sys.argv[1]).read_all(); assert t.num_rows == int(sys.argv[2]), t.num_rows" $OUTPUT_DIR/sp1_dna.arrow $(($(wc -l < $EXP_DIR/sp1_dna.exp) - 1)) || die "testcase$TESTCASE: pyarrow could not read the file"
+fi
+$SLOW5TOOLS skim --signal $RAW_DIR/sp1_dna.blow5 && die "testcase$TESTCASE: --signal without --arrow should fail"
+
 fi
 
 info "all $TESTCASE testcases passed"
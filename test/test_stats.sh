@@ -97,6 +97,21 @@ TESTCASE=7
 info "testcase$TESTCASE"
 $SLOW5TOOLS stats $RAW_DIR/zlib_svb-zd_multi_rg_v1.1.0.blow5> $OUTPUT_DIR/output.log && die "testcase$TESTCASE: stats failed"
 
+TESTCASE=8
+info "testcase$TESTCASE: count from the index"
+cp $RAW_DIR/zlib_svb-zd_multi_rg_v1.0.0.blow5 $OUTPUT_DIR/indexed.blow5 || die "testcase$TESTCASE: copy failed"
+$SLOW5TOOLS index $OUTPUT_DIR/indexed.blow5 || die "testcase$TESTCASE: index failed"
+$SLOW5TOOLS stats $OUTPUT_DIR/indexed.blow5 > $OUTPUT_DIR/output.log || die "testcase$TESTCASE: stats failed"
+grep -q "^number of records[[:space:]]7$" $OUTPUT_DIR/output.log || die "testcase$TESTCASE: wrong record count"
+
+TESTCASE=9
+info "testcase$TESTCASE: deep statistics"
+$SLOW5TOOLS stats --deep -t 1 $RAW_DIR/zlib_svb-zd_multi_rg_v1.0.0.blow5 > $OUTPUT_DIR/deep_t1.log || die "testcase$TESTCASE: stats --deep -t 1 failed"
+$SLOW5TOOLS stats --deep -t 3 -K 2 $RAW_DIR/zlib_svb-zd_multi_rg_v1.0.0.blow5 > $OUTPUT_DIR/deep_t3.log || die "testcase$TESTCASE: stats --deep -t 3 failed"
+diff $OUTPUT_DIR/deep_t1.log $OUTPUT_DIR/deep_t3.log > /dev/null || die "testcase$TESTCASE: outputs differ between thread counts"
+grep -q "^number of records[[:space:]]7$" $OUTPUT_DIR/deep_t3.log || die "testcase$TESTCASE: wrong record count"
+grep -q "^N50 read length (samples)" $OUTPUT_DIR/deep_t3.log || die "testcase$TESTCASE: N50 missing"
+
 rm -r "$OUTPUT_DIR" || die "could not delete $OUTPUT_DIR"
 info "all $TESTCASE testcases passed"
 exit 0
@@ -230,6 +230,15 @@ fi
     fi
 done
 
+# small batches and many threads so that several batches are in flight at once, records must come out in order
+ex "$S5T" view "$EXP/cat/expected_multi_group.slow5" --to blow5 -K 3 -t 4 -o "$OUT/multi_batch.blow5"
+ex "$S5T" view "$OUT/multi_batch.blow5" --to slow5 -K 5 -t 3 -o "$OUT/multi_batch.slow5"
+my_diff "$EXP/cat/expected_multi_group.slow5" "$OUT/multi_batch.slow5"
+ex "$S5T" view "$OUT/multi_batch.blow5" --to slow5 -K 2 -t 4 --pin -o "$OUT/multi_batch.slow5"
+my_diff "$EXP/cat/expected_multi_group.slow5" "$OUT/multi_batch.slow5"
+ex "$S5T" view "$OUT/multi_batch.blow5" --to slow5 -K 3 -t 4 --mmap -o "$OUT/multi_batch.slow5"
+my_diff "$EXP/cat/expected_multi_group.slow5" "$OUT/multi_batch.slow5"
+
 # the following should exit with error
 
 #conflict in --to format and -o format